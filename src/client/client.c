@@ -1,6 +1,11 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "client.h"
 
@@ -19,74 +24,279 @@
 }
 
 
-glc_client *glc_client_create(glc_client_options *options, int *err) {
-    glc_client_options def = {0600, 1024 * 1024 * 25};
-    glc_client *c = malloc(sizeof(*c));
-    if(!c) {
-        *err = ENOMEM;
-        return NULL;
-    }
+static int glc_client_buffer_create(ps_buffer_t *buffer, ps_packet_t *packet, int flags, int mmode, size_t size) {
+    int err;
+    ps_bufferattr_t attr;
+    if((err = ps_bufferattr_init(&attr)))
+        return err;
 
-    if(!options) {
-        options = &def;
+    if((err = ps_bufferattr_setflags(&attr, PS_BUFFER_PSHARED | flags)))
+        goto error;
+
+    if((err = ps_bufferattr_setshmmode(&attr, mmode)))
+        goto error;
+
+    if((err = ps_bufferattr_setsize(&attr, size)))
+        goto error;
+
+    if((err = ps_buffer_init(buffer, &attr)))
+        goto error;
+
+    if((err = ps_packet_init(packet, buffer))) {
+        ps_buffer_destroy(buffer);
+        goto error;
     }
 
-    c->id = -1;
-    c->state = GLC_CLIENT_NONE;
+error:
+    ps_bufferattr_destroy(&attr);
+    return err;
+}
 
-    int e;
+static int glc_client_buffer_attach(ps_buffer_t *buffer, ps_packet_t *packet, int shmid) {
+    int err;
     ps_bufferattr_t attr;
-    if((e = ps_bufferattr_init(&attr))) {
-        *err = e;
-        return NULL;
+    if((err = ps_bufferattr_init(&attr)))
+        return err;
+
+    if((err = ps_bufferattr_setflags(&attr, PS_BUFFER_PSHARED)))
+        goto error;
+
+    if((err = ps_bufferattr_setshmid(&attr, shmid)))
+        goto error;
+
+    if((err = ps_buffer_init(buffer, &attr)))
+        goto error;
+
+    if((err = ps_packet_init(packet, buffer))) {
+        ps_buffer_detach(buffer);
+        goto error;
     }
 
-    if((e = ps_bufferattr_setflags(&attr, PS_BUFFER_PSHARED | PS_SHM_CREATE))) {
-        *err = e;
-        return NULL;
+error:
+    ps_bufferattr_destroy(&attr);
+    return err;
+}
+
+/* take a ring pair from the server's lease pool, they are ready to use */
+static int glc_client_lease(glc_client *client, key_t key) {
+    glc_lease_table_t *table;
+    glc_lease_t *lease;
+    u_int32_t i, expected;
+    int shmid, err = EBUSY;
+
+    if((shmid = shmget(key + GLC_LEASE_KEY_OFFSET, 0, 0)) == -1)
+        return errno;
+
+    if((table = shmat(shmid, NULL, 0)) == (void *) -1)
+        return errno;
+
+    if(__atomic_load_n(&table->signature, __ATOMIC_ACQUIRE) != GLC_SIGNATURE) {
+        err = EAGAIN;
+        goto out;
     }
 
-    if((e = ps_bufferattr_setshmmode(&attr, options->mmode))) {
-        *err = e;
-        return NULL;
+    if(table->msize < client->options.msize || table->rsize < client->options.rsize) {
+        err = ENOSPC;
+        goto out;
     }
 
-    if((e = ps_bufferattr_setsize(&attr, options->msize))) {
-        *err = e;
-        return NULL;
+    for(i = 0; i < table->count; i++) {
+        lease = &((glc_lease_t *) (table + 1))[i];
+        expected = GLC_LEASE_FREE;
+        if(!__atomic_compare_exchange_n(&lease->state, &expected, GLC_LEASE_TAKEN, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            continue;
+
+        /* the server looks for this pid before we connect */
+        __atomic_store_n(&lease->pid, getpid(), __ATOMIC_RELEASE);
+
+        if((err = glc_client_buffer_attach(&client->buffer, &client->packet, lease->shmid)))
+            goto release;
+
+        if((err = glc_client_buffer_attach(&client->data_buffer, &client->data_packet, lease->data_shmid))) {
+            ps_packet_destroy(&client->packet);
+            ps_buffer_detach(&client->buffer);
+            goto release;
+        }
+
+        client->leased = 1;
+        client->msize = table->msize;
+        goto out;
+
+release:
+        __atomic_store_n(&lease->pid, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&lease->state, GLC_LEASE_FREE, __ATOMIC_RELEASE);
+        break;
     }
 
-    if((e = ps_buffer_init(&c->buffer, &attr))) {
-        *err = e;
-        return NULL;
+out:
+    shmdt(table);
+    return err;
+}
+
+/* give a leased ring pair back after the rings are detached, the server recycles it */
+static void glc_client_lease_return(key_t key, int shmid, int data_shmid) {
+    glc_lease_table_t *table;
+    glc_lease_t *lease;
+    u_int32_t i, expected;
+    int table_shmid;
+
+    if((table_shmid = shmget(key + GLC_LEASE_KEY_OFFSET, 0, 0)) == -1)
+        return;
+
+    if((table = shmat(table_shmid, NULL, 0)) == (void *) -1)
+        return;
+
+    for(i = 0; i < table->count; i++) {
+        lease = &((glc_lease_t *) (table + 1))[i];
+        if(lease->shmid != shmid || lease->data_shmid != data_shmid ||
+           __atomic_load_n(&lease->pid, __ATOMIC_ACQUIRE) != getpid())
+            continue;
+
+        expected = GLC_LEASE_TAKEN;
+        __atomic_compare_exchange_n(&lease->state, &expected, GLC_LEASE_RETURNED, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        break;
     }
 
-    ps_bufferattr_destroy(&attr);
+    shmdt(table);
+}
+
+/* flags is PS_SHM_CREATE or PS_SHM_MEMFD */
+static int glc_client_rings_create(glc_client *client, int flags) {
+    int err;
+
+    if((err = glc_client_buffer_create(&client->buffer, &client->packet, flags, client->options.mmode, client->options.rsize)))
+        return err;
+
+    if((err = glc_client_buffer_create(&client->data_buffer, &client->data_packet, flags, client->options.mmode, client->options.msize))) {
+        ps_packet_destroy(&client->packet);
+        ps_buffer_destroy(&client->buffer);
+        return err;
+    }
+
+    client->leased = 0;
+    client->msize = client->options.msize;
+    return 0;
+}
+
+static void glc_client_rings_destroy(glc_client *client) {
+    ps_packet_destroy(&client->data_packet);
+    ps_packet_destroy(&client->packet);
 
-    if((e = ps_packet_init(&c->packet, &c->buffer))) {
-        ps_buffer_destroy(&c->buffer);
-        *err = e;
+    /* leased rings belong to the server, it resets them for the next client */
+    if(client->leased) {
+        ps_buffer_detach(&client->data_buffer);
+        ps_buffer_detach(&client->buffer);
+    } else {
+        ps_buffer_destroy(&client->data_buffer);
+        ps_buffer_destroy(&client->buffer);
+    }
+}
+
+glc_client *glc_client_create(glc_client_options *options, int *err) {
+    glc_client_options def = {0600, 1024 * 1024 * 25, 1024 * 64, 0, 0, 0};
+    glc_client *c = malloc(sizeof(*c));
+    if(!c) {
+        *err = ENOMEM;
         return NULL;
     }
 
-    // TODO start thread which handles client timeouts
+    if(!options) {
+        options = &def;
+    }
+
+    c->id = -1;
+    c->state = GLC_CLIENT_NONE;
+    c->options = *options;
+    c->leased = 0;
+    c->sock = -1;
+    c->caps = 0;
+
+    /* the rings are leased from the server or created when connecting;
+       no timeout handling needed, the server watches this process and
+       reclaims both rings if it dies without disconnecting */
 
     *err = 0;
     return c;
 }
 
+static void glc_client_disconnect(glc_client *client) {
+    if(!(client->state & GLC_CLIENT_CONNECTED))
+        return;
+
+    if(client->sock != -1) {
+        close(client->sock);
+        client->sock = -1;
+    } else {
+        ps_packet_destroy(&client->server_packet);
+        ps_buffer_detach(&client->server_buffer);
+    }
+    glc_client_rings_destroy(client);
+
+    client->id = -1;
+    client->state = GLC_CLIENT_NONE;
+}
+
 void glc_client_destroy(glc_client *client) {
     assert(client != NULL);
 
-    ps_packet_destroy(&client->packet);
-    ps_buffer_destroy(&client->buffer);
+    glc_client_disconnect(client);
     free(client);
 }
 
+/* whether the data ring is close enough to the server's recommendation */
+static int glc_client_ring_fits(glc_client *client, size_t msize) {
+    if(!msize)
+        return 1;
+
+    /* leased memory is spent anyway, it only must not be too small */
+    if(client->leased)
+        return client->msize >= msize;
+
+    return client->msize >= msize && client->msize / 2 <= msize;
+}
+
+static int glc_client_connect_key(glc_client *client, key_t key, size_t *msize);
+static int glc_client_connect_memfd(glc_client *client, const char *name, size_t *msize);
+
 int glc_client_connect(glc_client *client, key_t key, size_t timeout) {
     UNUSED(timeout);
+    size_t msize;
+    int err;
+
+    if((err = glc_client_connect_key(client, key, &msize)))
+        return err;
+
+    if(glc_client_ring_fits(client, msize))
+        return 0;
+
+    /* connect again with the size the server asks for, it reaps the
+       first connection once its rings are detached */
+    glc_client_disconnect(client);
+    client->options.msize = msize;
+    return glc_client_connect_key(client, key, &msize);
+}
+
+int glc_client_connect_socket(glc_client *client, const char *name, size_t timeout) {
+    UNUSED(timeout);
+    size_t msize;
+    int err;
+
+    if((err = glc_client_connect_memfd(client, name, &msize)))
+        return err;
 
+    if(glc_client_ring_fits(client, msize))
+        return 0;
+
+    glc_client_disconnect(client);
+    client->options.msize = msize;
+    return glc_client_connect_memfd(client, name, &msize);
+}
+
+static int glc_client_connect_key(glc_client *client, key_t key, size_t *msize) {
     int err = 0;
+    int shmid, data_shmid, leased;
 
     if(client->state != GLC_CLIENT_NONE)
          return EALREADY;
@@ -109,6 +319,9 @@ int glc_client_connect(glc_client *client, key_t key, size_t timeout) {
     if((err = ps_packet_init(&client->server_packet, &client->server_buffer)))
         goto error3;
 
+    if(glc_client_lease(client, key) && (err = glc_client_rings_create(client, PS_SHM_CREATE)))
+        goto error4;
+
 
     glc_message_header_t hdr;
     hdr.type = GLC_MESSAGE_CONNECT;
@@ -116,9 +329,13 @@ int glc_client_connect(glc_client *client, key_t key, size_t timeout) {
     glc_connect_message_t msg;
     msg.node = -1;
     msg.shmid = client->buffer.shmid;
+    msg.data_shmid = client->data_buffer.shmid;
+    msg.frame_size = client->options.frame_size;
+    msg.frame_rate = client->options.frame_rate;
+    msg.msize = 0;
 
     if((err = glc_client_message_sent(client, &hdr, &msg, sizeof(msg), 0)))
-        goto error4;
+        goto error5;
 
 
     glc_message_header_t *rhdr = NULL;
@@ -127,18 +344,36 @@ int glc_client_connect(glc_client *client, key_t key, size_t timeout) {
 
 
     if((err = glc_client_message_receive(client, &rhdr, (void *)&rmsg, &rmsg_size, 0)))
-        goto error4;
+        goto error5;
 
-    if(rhdr->type != GLC_MESSAGE_CONNECT || rmsg->node == -1)
-        return ECONNREFUSED;
+    if(rhdr->type != GLC_MESSAGE_CONNECT || rmsg->node == -1) {
+        free(rhdr);
+        err = ECONNREFUSED;
+        goto error5;
+    }
 
     client->id = rmsg->node;
+    client->state = GLC_CLIENT_CONNECTED;
+    /* older servers do not recommend a size */
+    *msize = rmsg_size >= sizeof(*rmsg) ? rmsg->msize : 0;
+    free(rhdr);
 
+    ps_bufferattr_destroy(&attr);
     return 0;
 
+error5:
+    /* the ids are gone with the rings */
+    shmid = client->buffer.shmid;
+    data_shmid = client->data_buffer.shmid;
+    leased = client->leased;
+    glc_client_rings_destroy(client);
+    /* the server only reclaims leases of dead processes on its own */
+    if(leased)
+        glc_client_lease_return(key, shmid, data_shmid);
 error4:
     ps_packet_destroy(&client->server_packet);
 error3:
+    ps_buffer_detach(&client->server_buffer);
 error2:
     ps_bufferattr_destroy(&attr);
 error1:
@@ -146,10 +381,111 @@ error1:
     return err;
 }
 
+static int glc_client_connect_memfd(glc_client *client, const char *name, size_t *msize) {
+    struct sockaddr_un addr;
+    glc_hello_message_t hello;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct iovec iov = {&hello, sizeof(hello)};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fds[2], sock, err = 0;
+    size_t len;
+
+    if(client->state != GLC_CLIENT_NONE)
+         return EALREADY;
+
+    if(!name)
+        name = GLC_SOCKET_NAME;
+    if((len = strlen(name)) + 1 > sizeof(addr.sun_path))
+        return ENAMETOOLONG;
+    client->state = GLC_CLIENT_CONNECTING;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(&addr.sun_path[1], name, len);
+
+    if((sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1) {
+        err = errno;
+        goto error1;
+    }
+
+    if(connect(sock, (struct sockaddr *) &addr, offsetof(struct sockaddr_un, sun_path) + 1 + len)) {
+        err = errno;
+        goto error2;
+    }
+
+    if((err = glc_client_rings_create(client, PS_SHM_MEMFD)))
+        goto error2;
+
+    ps_buffer_getfd(&client->buffer, &fds[0]);
+    ps_buffer_getfd(&client->data_buffer, &fds[1]);
+
+    /* rings, sizes and capabilities in one round-trip */
+    hello.signature = GLC_SIGNATURE;
+    hello.version = GLC_HELLO_VERSION;
+    hello.node = -1;
+    hello.caps = client->options.caps;
+    hello.rsize = client->options.rsize;
+    hello.msize = client->options.msize;
+    hello.frame_size = client->options.frame_size;
+    hello.frame_rate = client->options.frame_rate;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if(sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(hello)) {
+        err = errno;
+        goto error3;
+    }
+
+    switch(recv(sock, &hello, sizeof(hello), 0)) {
+    case -1:
+        err = errno;
+        goto error3;
+    case sizeof(hello):
+        if(hello.signature == GLC_SIGNATURE && hello.node > 0)
+            break;
+        /* fall through */
+    default:
+        err = ECONNREFUSED;
+        goto error3;
+    }
+
+    client->id = hello.node;
+    client->caps = hello.caps;
+    *msize = hello.msize;
+    client->sock = sock;
+    client->state = GLC_CLIENT_CONNECTED;
+    return 0;
+
+error3:
+    glc_client_rings_destroy(client);
+error2:
+    close(sock);
+error1:
+    client->state = GLC_CLIENT_NONE;
+    return err;
+}
+
 int glc_client_message_sent(glc_client *client, glc_message_header_t *phdr, void *pmsg, size_t pmsg_size, int flags) {
     if(!(client->state & GLC_CLIENT_CONNECTING) && !(client->state & GLC_CLIENT_CONNECTED))
         return ENOTCONN;
 
+    /* socket clients have no control ring, messages go with their data */
+    if(client->sock != -1)
+        return glc_client_data_sent(client, phdr, pmsg, pmsg_size, flags);
+
     glc_message_header_t hdr;
     hdr.type = GLC_MESSAGE_NETWORK;
 
@@ -159,14 +495,14 @@ int glc_client_message_sent(glc_client *client, glc_message_header_t *phdr, void
     network.payload_size = pmsg_size;
 
     int err = 0;
-    if((err = ps_packet_open(&client->server_packet, PS_PACKET_WRITE | flags)))
+    if((err = ps_packet_open_sized(&client->server_packet, PS_PACKET_WRITE | flags, sizeof(hdr) + sizeof(network) + pmsg_size)))
         return err;
 
-    if((err = ps_packet_write(&client->server_packet, &hdr, sizeof(hdr))))
+    if((err = ps_packet_write_sized(&client->server_packet, &hdr, sizeof(hdr))))
         return err;
-    if((err = ps_packet_write(&client->server_packet, &network, sizeof(network))))
+    if((err = ps_packet_write_sized(&client->server_packet, &network, sizeof(network))))
         return err;
-    if((err = ps_packet_write(&client->server_packet, pmsg, pmsg_size)))
+    if((err = ps_packet_write_sized(&client->server_packet, pmsg, pmsg_size)))
         return err;
 
     if((err = ps_packet_close(&client->server_packet)))
@@ -175,6 +511,25 @@ int glc_client_message_sent(glc_client *client, glc_message_header_t *phdr, void
     return 0;
 }
 
+int glc_client_data_sent(glc_client *client, glc_message_header_t *hdr, void *msg, size_t msg_size, int flags) {
+    if(!(client->state & GLC_CLIENT_CONNECTED))
+        return ENOTCONN;
+
+    int err = 0;
+    if((err = ps_packet_open_sized(&client->data_packet, PS_PACKET_WRITE | flags, sizeof(*hdr) + msg_size)))
+        return err;
+
+    if((err = ps_packet_write_sized(&client->data_packet, hdr, sizeof(*hdr))))
+        return err;
+    if((err = ps_packet_write_sized(&client->data_packet, msg, msg_size)))
+        return err;
+
+    if((err = ps_packet_close(&client->data_packet)))
+        return err;
+
+    return 0;
+}
+
 int glc_client_message_receive(glc_client *client, glc_message_header_t **phdr, void **pmsg, size_t *pmsg_size, int flags) {
     int err = 0;
     if((err = ps_packet_open(&client->packet, PS_PACKET_READ | flags)))
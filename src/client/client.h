@@ -29,15 +29,37 @@ enum glc_client_state {
 typedef struct glc_client_options_s {
     /** memory mode */
     int mmode;
-    /** memory size; buffer size */
+    /** memory size; data buffer size */
     size_t msize;
+    /** size of the buffer the server answers on */
+    size_t rsize;
+    /** GLC_CAP_* flags asked for when connecting on a socket */
+    glc_flags_t caps;
+    /** expected size of a captured frame in bytes, 0 to keep msize */
+    size_t frame_size;
+    /** expected frames per second, 0 if unknown */
+    double frame_rate;
 } glc_client_options;
 
 typedef struct glc_client_s {
     int id;
     enum glc_client_state state;
+    glc_client_options options;
+    /** the rings are leased from the server's pool */
+    int leased;
+    /** size of the data ring */
+    size_t msize;
+    /** connection to the server if connected on its socket, -1 otherwise */
+    int sock;
+    /** GLC_CAP_* flags the server agreed to */
+    glc_flags_t caps;
+    /** answers from the server */
     ps_buffer_t buffer;
     ps_packet_t packet;
+    /** data sent to the server */
+    ps_buffer_t data_buffer;
+    ps_packet_t data_packet;
+    /** the server's control buffer */
     ps_buffer_t server_buffer;
     ps_packet_t server_packet;
 } glc_client;
@@ -47,10 +69,42 @@ glc_client *glc_client_create(glc_client_options *options, int *err);
 
 void glc_client_destroy(glc_client *client);
 
+/**
+ * \brief connect to the server at key
+ *
+ * Leases a ring pair from the server's pool if a free one is at least
+ * as large as the options ask for, otherwise creates the rings. If the
+ * options declare a frame size, the server recommends a data ring size
+ * and the client connects once more with a ring of that size if its
+ * own is too small or more than twice as large.
+ */
 int glc_client_connect(glc_client *client, key_t key, size_t timeout);
 
+/**
+ * \brief connect to the server on its abstract UNIX socket
+ *
+ * The rings are created as memfds and passed to the server with the
+ * hello message, which also agrees on the capabilities and the data
+ * ring size like glc_client_connect() does. Messages go with the data
+ * afterwards, there is no control ring involved.
+ * \param client the client
+ * \param name socket name or NULL for GLC_SOCKET_NAME
+ * \param timeout unused
+ * \return 0 on success otherwise an error code
+ */
+int glc_client_connect_socket(glc_client *client, const char *name, size_t timeout);
+
 int glc_client_message_sent(glc_client *client, glc_message_header_t *phdr, void *pmsg, size_t pmsg_size, int flags);
 
+/**
+ * \brief send a message on the client's data buffer
+ *
+ * Unlike glc_client_message_sent() the message does not go through the
+ * shared control buffer, so this is the path for bulk data like video
+ * frames.
+ */
+int glc_client_data_sent(glc_client *client, glc_message_header_t *hdr, void *msg, size_t msg_size, int flags);
+
 int glc_client_message_receive(glc_client *client, glc_message_header_t **phdr, void **pmsg, size_t *pmsg_size, int flags);
 
 #ifdef __cplusplus
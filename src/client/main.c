@@ -26,7 +26,7 @@
 
 void glc_init();
 void glc_destroy();
-void glc_start();
+void glc_start(opengl_ctx *ctx, void *udata);
 void glc_stop();
 
 
@@ -46,7 +46,8 @@ __DESTRUCTOR void glc_destroy() {
     hook_destroy();
 }
 
-void glc_start() {
+void glc_start(opengl_ctx *ctx, void *udata) {
+    UNUSED(udata);
     opengl_unregister_context_create(glc_start, NULL);
 
     /* start control thread
@@ -57,14 +58,28 @@ void glc_start() {
 
     // FIXME
     int err = 0;
-    glc_client *client = glc_client_create(NULL, &err);
+    glc_client_options options = {0600, 1024 * 1024 * 25, 1024 * 64, 0, 0, 0};
+
+    /* declare the frames the server should size the data ring for: the
+       drawable as BGRA, or the whole screen if it has no size yet. the
+       rate is not known before the first swaps, 0 lets the server assume
+       a minimum number of frames */
+    options.frame_size = (size_t) ctx->width * ctx->height * 4;
+    if(!options.frame_size)
+        options.frame_size = (size_t) DisplayWidth(ctx->dpy, DefaultScreen(ctx->dpy)) *
+                             DisplayHeight(ctx->dpy, DefaultScreen(ctx->dpy)) * 4;
+    options.frame_rate = 0;
+
+    glc_client *client = glc_client_create(&options, &err);
     if(!client) {
         fprintf(stderr, "glc_client_create failed: %s (%d)\n", strerror(err), err);
         exit(err);
     }
 
+    /* the socket first, older servers only have the shared memory key */
     key_t key = 0x676C6332;
-    if((err = glc_client_connect(client, key, -1))) {
+    if((err = glc_client_connect_socket(client, NULL, -1)) &&
+       (err = glc_client_connect(client, key, -1))) {
         fprintf(stderr, "glc_client_connect failed: %s (%d)\n", strerror(err), err);
         glc_client_destroy(client);
         exit(err);
@@ -0,0 +1,164 @@
+/**
+ * \file src/common/delta.c
+ * \brief video delta frames
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup delta
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "delta.h"
+
+int glc_delta_geometry(const glc_video_format_message_t *format, unsigned int *bpp, size_t *stride)
+{
+	switch (format->format) {
+	case GLC_VIDEO_BGRA:
+		*bpp = 4;
+		break;
+	case GLC_VIDEO_BGR:
+	case GLC_VIDEO_RGB:
+		*bpp = 3;
+		break;
+	default:
+		return EINVAL;
+	}
+
+	*stride = (size_t) format->width * *bpp;
+	if (format->flags & GLC_VIDEO_DWORD_ALIGNED)
+		*stride = (*stride + 7) & ~((size_t) 7);
+	return 0;
+}
+
+int glc_delta_apply(void *frame, const glc_video_format_message_t *format, const void *msg, size_t size)
+{
+	const unsigned char *p = msg, *end = p + size;
+	glc_video_delta_header_t header;
+	unsigned char *dst = frame;
+	unsigned int bpp, tiles_x, tiles_y, x, y, w, h, row;
+	u_int32_t index, prev = 0;
+	const unsigned char *indices;
+	size_t stride, tile_bytes;
+	u_int32_t i;
+
+	if (glc_delta_geometry(format, &bpp, &stride))
+		return EINVAL;
+
+	if (size < sizeof(header))
+		return EINVAL;
+	memcpy(&header, p, sizeof(header));
+	p += sizeof(header);
+
+	if (!header.tile || header.count > (size_t) (end - p) / sizeof(index))
+		return EINVAL;
+
+	tiles_x = (format->width + header.tile - 1) / header.tile;
+	tiles_y = (format->height + header.tile - 1) / header.tile;
+	indices = p;
+	p += header.count * sizeof(index);
+
+	for (i = 0; i < header.count; i++) {
+		memcpy(&index, &indices[i * sizeof(index)], sizeof(index));
+		if (index >= (u_int64_t) tiles_x * tiles_y || (i && index <= prev))
+			return EINVAL;
+		prev = index;
+
+		x = (index % tiles_x) * header.tile;
+		y = (index / tiles_x) * header.tile;
+		w = format->width - x < header.tile ? format->width - x : header.tile;
+		h = format->height - y < header.tile ? format->height - y : header.tile;
+		tile_bytes = (size_t) w * bpp;
+
+		if ((size_t) (end - p) < tile_bytes * h)
+			return EINVAL;
+
+		for (row = 0; row < h; row++) {
+			memcpy(&dst[(y + row) * stride + (size_t) x * bpp], p, tile_bytes);
+			p += tile_bytes;
+		}
+	}
+
+	return 0;
+}
+
+glc_delta_stream_t *glc_delta_stream(glc_delta_stream_t **streams, glc_stream_id_t id, size_t size, int create)
+{
+	glc_delta_stream_t *stream;
+
+	for (stream = *streams; stream; stream = stream->next) {
+		if (stream->id == id)
+			return stream;
+	}
+
+	if (!create || !(stream = calloc(1, size)))
+		return NULL;
+
+	stream->id = id;
+	stream->next = *streams;
+	*streams = stream;
+	return stream;
+}
+
+int glc_delta_read(const struct iovec *iov, int count, void *dst, size_t size)
+{
+	size_t pos = 0, len;
+	int i;
+
+	for (i = 0; i < count && pos < size; i++) {
+		len = iov[i].iov_len < size - pos ? iov[i].iov_len : size - pos;
+		memcpy((unsigned char *) dst + pos, iov[i].iov_base, len);
+		pos += len;
+	}
+
+	return pos < size ? EINVAL : 0;
+}
+
+int glc_delta_copy(glc_delta_scratch_t *scratch, const struct iovec *iov, int count, size_t *size)
+{
+	unsigned char *data;
+	size_t pos = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+		pos += iov[i].iov_len;
+
+	if (pos > scratch->size) {
+		if (!(data = realloc(scratch->data, pos)))
+			return ENOMEM;
+		scratch->data = data;
+		scratch->size = pos;
+	}
+
+	*size = pos;
+	for (i = 0, pos = 0; i < count; i++) {
+		memcpy(&scratch->data[pos], iov[i].iov_base, iov[i].iov_len);
+		pos += iov[i].iov_len;
+	}
+
+	return 0;
+}
+
+int glc_delta_join(glc_delta_scratch_t *scratch, const struct iovec *iov, int count,
+		   const unsigned char **data, size_t *size)
+{
+	int err;
+
+	if (count == 1) {
+		*data = iov[0].iov_base;
+		*size = iov[0].iov_len;
+		return 0;
+	}
+
+	if ((err = glc_delta_copy(scratch, iov, count, size)))
+		return err;
+	*data = scratch->data;
+	return 0;
+}
+
+/**  \} */
@@ -0,0 +1,125 @@
+/**
+ * \file src/common/delta.h
+ * \brief video delta frames
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup delta delta frames
+ *  GLC_MESSAGE_VIDEO_DELTA messages carry only the tiles of a frame which
+ *  changed since the previous frame of the stream, see
+ *  glc_video_delta_header_t. A reader keeps the last full frame of each
+ *  stream and applies deltas to it to get the next frame. Streams start
+ *  and regularly continue with full GLC_MESSAGE_VIDEO_FRAME messages, so
+ *  a reader can start decoding at any full frame.
+ *  \{
+ */
+
+#ifndef GLC2_DELTA_H
+#define GLC2_DELTA_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief get the memory layout of a packed video format
+ * \param format video format message
+ * \param bpp returned bytes per pixel
+ * \param stride returned bytes per row
+ * \return 0 on success or EINVAL if the format is not packed
+ */
+__PUBLIC int glc_delta_geometry(const glc_video_format_message_t *format, unsigned int *bpp, size_t *stride);
+
+/**
+ * \brief apply a GLC_MESSAGE_VIDEO_DELTA payload to a frame
+ * \param frame pixels of the previous frame of the stream, without the
+ *        glc_video_frame_header_t, updated in place
+ * \param format video format message of the stream
+ * \param msg message payload, starting with glc_video_delta_header_t
+ * \param size payload size
+ * \return 0 on success or EINVAL if the delta does not fit the format
+ */
+__PUBLIC int glc_delta_apply(void *frame, const glc_video_format_message_t *format, const void *msg, size_t size);
+
+/**
+ * \brief per-stream state of a stage which rewrites video messages
+ *
+ * A stage puts this first in its own stream structure and keeps a list of
+ * them with glc_delta_stream().
+ */
+typedef struct glc_delta_stream_s {
+	/** stream id */
+	glc_stream_id_t id;
+	/** next stream of the stage */
+	struct glc_delta_stream_s *next;
+} glc_delta_stream_t;
+
+/** buffer a message payload is copied to, grown as needed */
+typedef struct {
+	/** buffer */
+	unsigned char *data;
+	/** allocated bytes */
+	size_t size;
+} glc_delta_scratch_t;
+
+/**
+ * \brief find the state of a stream
+ * \param streams list of streams of the stage
+ * \param id stream id
+ * \param size size of the stage's stream structure, new streams are zeroed
+ * \param create add the stream to the list if it is not there yet
+ * \return stream or NULL if it does not exist and create is 0 or on ENOMEM
+ */
+glc_delta_stream_t *glc_delta_stream(glc_delta_stream_t **streams, glc_stream_id_t id, size_t size, int create);
+
+/**
+ * \brief copy the start of a message payload
+ *
+ * A payload is split across two iovecs when it wraps around the end of a
+ * ring, this copies the first bytes wherever they are.
+ * \param iov payload
+ * \param count number of iovecs
+ * \param dst destination
+ * \param size bytes to copy
+ * \return 0 on success or EINVAL if the payload is shorter than size
+ */
+int glc_delta_read(const struct iovec *iov, int count, void *dst, size_t size);
+
+/**
+ * \brief copy a message payload to a scratch buffer
+ * \param scratch scratch buffer
+ * \param iov payload
+ * \param count number of iovecs
+ * \param size returned payload size
+ * \return 0 on success or ENOMEM
+ */
+int glc_delta_copy(glc_delta_scratch_t *scratch, const struct iovec *iov, int count, size_t *size);
+
+/**
+ * \brief get a message payload in one piece
+ *
+ * Only a payload which is split is copied to the scratch buffer.
+ * \param scratch scratch buffer
+ * \param iov payload
+ * \param count number of iovecs
+ * \param data returned payload
+ * \param size returned payload size
+ * \return 0 on success or ENOMEM
+ */
+int glc_delta_join(glc_delta_scratch_t *scratch, const struct iovec *iov, int count,
+		   const unsigned char **data, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
@@ -20,6 +20,9 @@
 extern "C" {
 #endif
 
+/** exported from the shared objects, everything else is hidden */
+#define __PUBLIC __attribute__ ((visibility ("default")))
+
 /** stream version */
 #define GLC_STREAM_VERSION                  0x5
 /** file signature = "GLC" */
@@ -108,6 +111,12 @@ typedef u_int8_t glc_message_type_t;
 #define GLC_MESSAGE_NETWORK            0x0e
 /** network */
 #define GLC_MESSAGE_CONNECT            0x0f
+/** save the replay buffer, no payload */
+#define GLC_MESSAGE_REPLAY             0x10
+/** previous video frame shown again */
+#define GLC_MESSAGE_VIDEO_REPEAT       0x11
+/** video frame as changed tiles of the previous frame */
+#define GLC_MESSAGE_VIDEO_DELTA        0x12
 
 /**
  * \brief stream message header
@@ -148,6 +157,21 @@ typedef struct {
 	glc_message_header_t header;
 } __attribute__((packed)) glc_lzjb_header_t;
 
+/**
+ * \brief block of a compressed message
+ *
+ * The payload of a compressed message is split into blocks which are
+ * compressed independently. Each block starts with this header, blocks
+ * follow each other until the uncompressed size is reached. A block
+ * which did not shrink is stored as is, compressed_size equals size then.
+ */
+typedef struct {
+	/** compressed size of the block data following this header */
+	glc_size_t compressed_size;
+	/** uncompressed block size */
+	glc_size_t size;
+} __attribute__((packed)) glc_compressed_block_t;
+
 /** video format type */
 typedef u_int8_t glc_video_format_t;
 /** 24bit BGR, last row first */
@@ -188,6 +212,39 @@ typedef struct {
 	glc_utime_t time;
 } __attribute__((packed)) glc_video_frame_header_t;
 
+/**
+ * \brief video repeat message
+ *  replaces a video frame which is byte-identical to the previous
+ *  frame of the same stream
+ */
+typedef struct {
+	/** stream identifier */
+	glc_stream_id_t id;
+	/** time of the replaced frame */
+	glc_utime_t time;
+} __attribute__((packed)) glc_video_repeat_message_t;
+
+/**
+ * \brief video delta message header
+ *  A delta frame is the previous frame of the stream with some tiles
+ *  replaced. The frame is split into tile x tile pixel tiles, numbered
+ *  row by row in memory order; tiles at the right and bottom edge may be
+ *  smaller. The header is followed by count u_int32_t tile numbers in
+ *  ascending order and then by the pixels of each of these tiles, row by
+ *  row in memory order without padding. Only packed formats (BGR, BGRA,
+ *  RGB) are sent as deltas.
+ */
+typedef struct {
+	/** stream identifier */
+	glc_stream_id_t id;
+	/** time */
+	glc_utime_t time;
+	/** edge length of a tile in pixels */
+	u_int32_t tile;
+	/** number of tiles which follow */
+	u_int32_t count;
+} __attribute__((packed)) glc_video_delta_header_t;
+
 /** audio format type */
 typedef u_int8_t glc_audio_format_t;
 /** signed 16bit little-endian */
@@ -246,6 +303,54 @@ typedef struct {
 	float blue;
 } __attribute__((packed)) glc_color_message_t;
 
+/** index signature = "GLCI" */
+#define GLC_INDEX_SIGNATURE          0x49434c47
+/** index version */
+#define GLC_INDEX_VERSION                   0x1
+
+/**
+ * \brief stream index entry
+ *
+ * A stream file may end with an index behind its GLC_MESSAGE_CLOSE
+ * message, so readers which stop at the close message never see it:
+ * [count] index entries followed by a glc_index_footer_t.
+ *
+ * Indexed are format and color messages and the messages a reader can
+ * start decoding at, full video frames and audio data. Entries are in
+ * file order and their times never decrease; messages without a time
+ * get the time of the message before them.
+ *
+ * While a file is written the entries are also appended to a sidecar
+ * file [path].idx from time to time. It starts with a glc_index_footer_t
+ * whose offset and count are 0, entries follow until the end of the
+ * file. After a crash it still indexes the part of the stream which made
+ * it to disk; it is removed when the trailing index is written.
+ */
+typedef struct {
+	/** message time */
+	glc_utime_t time;
+	/** file offset of the size in front of the message */
+	u_int64_t offset;
+	/** stream identifier */
+	glc_stream_id_t id;
+	/** message type, compressed messages by the type of the original */
+	glc_message_type_t type;
+} __attribute__((packed)) glc_index_entry_t;
+
+/**
+ * \brief stream index footer, last bytes of an indexed stream file
+ */
+typedef struct {
+	/** file offset of the first entry */
+	u_int64_t offset;
+	/** number of entries */
+	u_int64_t count;
+	/** index version */
+	u_int32_t version;
+	/** index signature */
+	u_int32_t signature;
+} __attribute__((packed)) glc_index_footer_t;
+
 /**
  * \brief container message header
  */
@@ -312,15 +417,103 @@ typedef struct {
  * \brief connect message
  *  sending connect message with node == -1 is a connect
  *  request, the server answeres with the same message
- *  and node > 0
+ *  and node > 0. The answer's msize is the data ring size the
+ *  server recommends for the declared frames; a client with a
+ *  ring far off connects again with a ring of that size.
  */
 typedef struct {
     /** node id (-1:unknown, 0:server, n>0:clients) */
     glc_node_id_t node;
-    /** */
+    /** shared memory id of the ring the server answers on */
     glc_shmid_t shmid;
+    /** shared memory id of the ring the client sends its data on */
+    glc_shmid_t data_shmid;
+    /** expected size of a captured frame in bytes, 0 if unknown */
+    glc_size_t frame_size;
+    /** expected frames per second, 0 if unknown */
+    double frame_rate;
+    /** recommended data ring size in the answer, 0 for none */
+    glc_size_t msize;
 } __attribute__((packed)) glc_connect_message_t;
 
+/** default abstract UNIX socket name of the server, without the leading zero byte */
+#define GLC_SOCKET_NAME                 "glc2"
+/** version of the socket handshake */
+#define GLC_HELLO_VERSION               2
+/** peer handles GLC_MESSAGE_LZJB messages */
+#define GLC_CAP_LZJB                    0x1
+
+/**
+ * \brief hello message
+ *  first message a client sends on the server socket, along with
+ *  the memfds of the ring the server answers on and of its data ring
+ *  (SCM_RIGHTS, in this order). The server answers with the same
+ *  message, node > 0, the capabilities both sides have and the data
+ *  ring size it recommends for the declared frames, or node == -1 if
+ *  it refuses the client.
+ */
+typedef struct {
+    /** GLC_SIGNATURE */
+    u_int32_t signature;
+    /** GLC_HELLO_VERSION */
+    u_int32_t version;
+    /** node id (-1:unknown, n>0:clients) */
+    glc_node_id_t node;
+    /** GLC_CAP_* flags */
+    glc_flags_t caps;
+    /** size of the ring the server answers on */
+    glc_size_t rsize;
+    /** size of the data ring, the recommended size in the answer */
+    glc_size_t msize;
+    /** expected size of a captured frame in bytes, 0 if unknown */
+    glc_size_t frame_size;
+    /** expected frames per second, 0 if unknown */
+    double frame_rate;
+} __attribute__((packed)) glc_hello_message_t;
+
+/** the lease table is at the server's shared memory key plus this */
+#define GLC_LEASE_KEY_OFFSET            1
+/** ring pair is ready to be leased */
+#define GLC_LEASE_FREE                  0
+/** ring pair is leased or being recycled by the server */
+#define GLC_LEASE_TAKEN                 1
+/** ring pair was given back by a client which did not connect */
+#define GLC_LEASE_RETURNED              2
+
+/**
+ * \brief ring pair the server keeps ready for a client
+ *  A client claims a free entry by changing its state atomically
+ *  from GLC_LEASE_FREE to GLC_LEASE_TAKEN, stores its pid and connects
+ *  with the entry's shared memory ids. The server sets the entry free
+ *  again when the client is gone. A client which fails to connect sets
+ *  its entry to GLC_LEASE_RETURNED after detaching, the server recycles
+ *  it like the entry of a dead client.
+ */
+typedef struct {
+    /** GLC_LEASE_FREE, GLC_LEASE_TAKEN or GLC_LEASE_RETURNED */
+    u_int32_t state;
+    /** process which leased the rings, 0 until it is stored */
+    int32_t pid;
+    /** shared memory id of the ring the server answers on */
+    glc_shmid_t shmid;
+    /** shared memory id of the ring the client sends its data on */
+    glc_shmid_t data_shmid;
+} glc_lease_t;
+
+/**
+ * \brief table of leasable ring pairs, followed by count glc_lease_t
+ */
+typedef struct {
+    /** GLC_SIGNATURE once the table is ready */
+    u_int32_t signature;
+    /** number of entries */
+    u_int32_t count;
+    /** size of the rings the server answers on */
+    glc_size_t rsize;
+    /** size of the data rings */
+    glc_size_t msize;
+} glc_lease_table_t;
+
 #ifdef __cplusplus
 }
 #endif
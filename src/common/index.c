@@ -0,0 +1,304 @@
+/**
+ * \file src/common/index.c
+ * \brief stream file index reader
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup index
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "index.h"
+
+/** entries of one stream, as positions in the entry array */
+struct glc_index_stream_s {
+	glc_stream_id_t id;
+	/** full video frames and audio data, by time */
+	size_t *points;
+	size_t points_count;
+	/** format and color messages, by offset */
+	size_t *states;
+	size_t states_count;
+};
+
+struct glc_index_s {
+	glc_index_entry_t *entries;
+	size_t count;
+	struct glc_index_stream_s *streams;
+	size_t streams_count;
+};
+
+static int glc_index_read(int fd, void *data, size_t size, off_t offset);
+static int glc_index_load_trailer(glc_index *index, int fd, off_t size);
+static int glc_index_load_sidecar(glc_index *index, const char *path, off_t size);
+static int glc_index_build(glc_index *index);
+static struct glc_index_stream_s *glc_index_stream(glc_index *index, glc_stream_id_t id);
+
+int glc_index_open(glc_index **index, const char *path)
+{
+	struct stat st;
+	glc_index *ix;
+	int fd, err;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+		return errno;
+
+	if (fstat(fd, &st)) {
+		err = errno;
+		close(fd);
+		return err;
+	}
+
+	if (!(ix = calloc(1, sizeof(*ix)))) {
+		close(fd);
+		return ENOMEM;
+	}
+
+	err = glc_index_load_trailer(ix, fd, st.st_size);
+	close(fd);
+	if (err == ENOENT)
+		err = glc_index_load_sidecar(ix, path, st.st_size);
+	if (!err)
+		err = glc_index_build(ix);
+
+	if (err) {
+		glc_index_destroy(ix);
+		return err;
+	}
+
+	*index = ix;
+	return 0;
+}
+
+void glc_index_destroy(glc_index *index)
+{
+	size_t i;
+
+	for (i = 0; i < index->streams_count; i++) {
+		free(index->streams[i].points);
+		free(index->streams[i].states);
+	}
+
+	free(index->streams);
+	free(index->entries);
+	free(index);
+}
+
+const glc_index_entry_t *glc_index_entries(glc_index *index, size_t *count)
+{
+	*count = index->count;
+	return index->entries;
+}
+
+int glc_index_seek(glc_index *index, glc_stream_id_t id, glc_utime_t time, glc_index_entry_t *entry)
+{
+	struct glc_index_stream_s *stream = glc_index_stream(index, id);
+	size_t lo = 0, hi, mid;
+
+	if (!stream || !stream->points_count)
+		return ENOENT;
+
+	/* first point after time */
+	hi = stream->points_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->entries[stream->points[mid]].time <= time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*entry = index->entries[stream->points[lo ? lo - 1 : 0]];
+	return 0;
+}
+
+int glc_index_state(glc_index *index, glc_stream_id_t id, glc_message_type_t type, u_int64_t offset,
+		    glc_index_entry_t *entry)
+{
+	struct glc_index_stream_s *stream = glc_index_stream(index, id);
+	size_t lo = 0, hi, mid;
+
+	if (!stream)
+		return ENOENT;
+
+	/* first state at or after offset */
+	hi = stream->states_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->entries[stream->states[mid]].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* states of a stream are few, the other types are skipped */
+	while (lo--) {
+		if (index->entries[stream->states[lo]].type == type) {
+			*entry = index->entries[stream->states[lo]];
+			return 0;
+		}
+	}
+
+	return ENOENT;
+}
+
+static int glc_index_read(int fd, void *data, size_t size, off_t offset)
+{
+	unsigned char *p = data;
+	ssize_t ret;
+
+	while (size) {
+		if ((ret = pread(fd, p, size, offset)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		} else if (ret == 0)
+			return EINVAL;
+		p += ret;
+		offset += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
+static int glc_index_load_trailer(glc_index *index, int fd, off_t size)
+{
+	glc_index_footer_t footer;
+	int err;
+
+	if (size < (off_t) (sizeof(glc_stream_info_t) + sizeof(footer)))
+		return ENOENT;
+
+	if ((err = glc_index_read(fd, &footer, sizeof(footer), size - sizeof(footer))))
+		return err;
+
+	if (footer.signature != GLC_INDEX_SIGNATURE)
+		return ENOENT;
+	/* the entries fill the space between offset and the footer */
+	if (footer.version != GLC_INDEX_VERSION ||
+	    footer.offset > (u_int64_t) size - sizeof(footer) ||
+	    ((u_int64_t) size - sizeof(footer) - footer.offset) % sizeof(glc_index_entry_t) ||
+	    footer.count != ((u_int64_t) size - sizeof(footer) - footer.offset) / sizeof(glc_index_entry_t))
+		return EINVAL;
+
+	index->count = footer.count;
+	if (!(index->entries = malloc(index->count * sizeof(glc_index_entry_t) + 1)))
+		return ENOMEM;
+	return glc_index_read(fd, index->entries, index->count * sizeof(glc_index_entry_t), footer.offset);
+}
+
+static int glc_index_load_sidecar(glc_index *index, const char *path, off_t size)
+{
+	glc_index_footer_t header;
+	char *sidecar;
+	struct stat st;
+	size_t len = strlen(path);
+	int fd, err;
+
+	if (!(sidecar = malloc(len + sizeof(".idx"))))
+		return ENOMEM;
+	memcpy(sidecar, path, len);
+	memcpy(&sidecar[len], ".idx", sizeof(".idx"));
+
+	fd = open(sidecar, O_RDONLY | O_CLOEXEC);
+	free(sidecar);
+	if (fd == -1)
+		return errno;
+
+	if (fstat(fd, &st)) {
+		err = errno;
+		goto finish;
+	}
+
+	if ((err = glc_index_read(fd, &header, sizeof(header), 0)))
+		goto finish;
+	if (header.signature != GLC_INDEX_SIGNATURE || header.version != GLC_INDEX_VERSION) {
+		err = EINVAL;
+		goto finish;
+	}
+
+	/* a crash may leave half an entry */
+	index->count = (st.st_size - sizeof(header)) / sizeof(glc_index_entry_t);
+	if (!(index->entries = malloc(index->count * sizeof(glc_index_entry_t) + 1))) {
+		err = ENOMEM;
+		goto finish;
+	}
+	if ((err = glc_index_read(fd, index->entries, index->count * sizeof(glc_index_entry_t), sizeof(header))))
+		goto finish;
+
+	/* and entries of messages which did not make it to the stream file */
+	while (index->count && index->entries[index->count - 1].offset + sizeof(glc_size_t) +
+	       sizeof(glc_message_header_t) > (u_int64_t) size)
+		index->count--;
+
+finish:
+	close(fd);
+	return err;
+}
+
+static int glc_index_build(glc_index *index)
+{
+	struct glc_index_stream_s *stream;
+	glc_index_entry_t *entry;
+	size_t i, **list, *count;
+
+	for (i = 0; i < index->count; i++) {
+		entry = &index->entries[i];
+		if (i && (entry->time < entry[-1].time || entry->offset <= entry[-1].offset))
+			return EINVAL;
+
+		if (!(stream = glc_index_stream(index, entry->id))) {
+			stream = realloc(index->streams, (index->streams_count + 1) * sizeof(*stream));
+			if (!stream)
+				return ENOMEM;
+			index->streams = stream;
+			stream = &index->streams[index->streams_count++];
+			memset(stream, 0, sizeof(*stream));
+			stream->id = entry->id;
+		}
+
+		if (entry->type == GLC_MESSAGE_VIDEO_FRAME || entry->type == GLC_MESSAGE_AUDIO_DATA) {
+			list = &stream->points;
+			count = &stream->points_count;
+		} else {
+			list = &stream->states;
+			count = &stream->states_count;
+		}
+
+		/* grow at powers of two */
+		if (!(*count & (*count - 1))) {
+			size_t *grown = realloc(*list, (*count ? *count * 2 : 1) * sizeof(size_t));
+			if (!grown)
+				return ENOMEM;
+			*list = grown;
+		}
+		(*list)[(*count)++] = i;
+	}
+
+	return 0;
+}
+
+static struct glc_index_stream_s *glc_index_stream(glc_index *index, glc_stream_id_t id)
+{
+	size_t i;
+
+	/* a file has a handful of streams */
+	for (i = 0; i < index->streams_count; i++) {
+		if (index->streams[i].id == id)
+			return &index->streams[i];
+	}
+
+	return NULL;
+}
+
+/**  \} */
@@ -0,0 +1,91 @@
+/**
+ * \file src/common/index.h
+ * \brief stream file index reader
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup index stream index
+ *  Reads the index of a stream file, see glc_index_entry_t, and answers
+ *  where to start reading to get to a point in time. The trailing index
+ *  is used if the file has one, otherwise the sidecar file of a stream
+ *  which was not closed properly. Loading sorts the entries by stream
+ *  once; a seek is a binary search in the entries of one stream.
+ *
+ *  To start playback of a stream at a time, glc_index_seek() gives the
+ *  full video frame or audio data to start at, and glc_index_state()
+ *  the format and color messages which were in effect there. A reader
+ *  reads those first and continues at the entry's offset. To seek a file
+ *  with several streams start at the smallest offset of all streams.
+ *  \{
+ */
+
+#ifndef GLC2_INDEX_H
+#define GLC2_INDEX_H
+
+#include <stddef.h>
+
+#include "format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_index_s glc_index;
+
+/**
+ * \brief load the index of a stream file
+ * \param index returned index
+ * \param path stream file
+ * \return 0 on success, ENOENT if the file has no index, EINVAL if the
+ *         index is damaged, otherwise an error code
+ */
+__PUBLIC int glc_index_open(glc_index **index, const char *path);
+
+/**
+ * \brief free an index
+ * \param index the index
+ */
+__PUBLIC void glc_index_destroy(glc_index *index);
+
+/**
+ * \brief get all entries
+ * \param index the index
+ * \param count returned number of entries
+ * \return entries in file order
+ */
+__PUBLIC const glc_index_entry_t *glc_index_entries(glc_index *index, size_t *count);
+
+/**
+ * \brief find where to start decoding a stream
+ * \param index the index
+ * \param id stream identifier
+ * \param time wanted time
+ * \param entry returned last full video frame or audio data of the
+ *        stream at or before time, or the first one if time is earlier
+ * \return 0 on success or ENOENT if the stream has no such message
+ */
+__PUBLIC int glc_index_seek(glc_index *index, glc_stream_id_t id, glc_utime_t time, glc_index_entry_t *entry);
+
+/**
+ * \brief find the message of a type in effect at a point of a stream
+ * \param index the index
+ * \param id stream identifier
+ * \param type GLC_MESSAGE_VIDEO_FORMAT, GLC_MESSAGE_AUDIO_FORMAT or
+ *        GLC_MESSAGE_COLOR
+ * \param offset file offset, e.g. of an entry returned by
+ *        glc_index_seek()
+ * \param entry returned last message of the type and stream before offset
+ * \return 0 on success or ENOENT if there is none
+ */
+__PUBLIC int glc_index_state(glc_index *index, glc_stream_id_t id, glc_message_type_t type, u_int64_t offset,
+			     glc_index_entry_t *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
@@ -0,0 +1,134 @@
+/**
+ * \file src/common/lut.c
+ * \brief colour correction lookup tables
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup lut
+ *  \{
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <immintrin.h>
+
+#include "lut.h"
+
+static int glc_lut_channel(unsigned char *table, float brightness, float contrast, float gamma);
+static void glc_lut_apply_bytes(const unsigned char *first, const unsigned char *second,
+				const unsigned char *third, unsigned int bpp, const unsigned char *src,
+				unsigned char *dst, size_t pixels);
+static size_t glc_lut_gather(const glc_lut_t *lut, const unsigned char *src, unsigned char *dst,
+			     size_t pixels);
+
+int glc_lut_build(glc_lut_t *lut, const glc_color_message_t *color)
+{
+	unsigned int i;
+
+	if (glc_lut_channel(lut->blue, color->brightness, color->contrast, color->blue) ||
+	    glc_lut_channel(lut->green, color->brightness, color->contrast, color->green) ||
+	    glc_lut_channel(lut->red, color->brightness, color->contrast, color->red))
+		return EINVAL;
+
+	lut->identity = 1;
+	for (i = 0; i < 256; i++) {
+		lut->blue32[i] = lut->blue[i];
+		lut->green32[i] = (u_int32_t) lut->green[i] << 8;
+		lut->red32[i] = (u_int32_t) lut->red[i] << 16;
+		if (lut->blue[i] != i || lut->green[i] != i || lut->red[i] != i)
+			lut->identity = 0;
+	}
+
+	return 0;
+}
+
+int glc_lut_apply(const glc_lut_t *lut, glc_video_format_t format, const unsigned char *src,
+		  unsigned char *dst, size_t pixels)
+{
+	size_t done;
+
+	switch (format) {
+	case GLC_VIDEO_BGRA:
+		done = glc_lut_gather(lut, src, dst, pixels);
+		glc_lut_apply_bytes(lut->blue, lut->green, lut->red, 4, &src[done * 4], &dst[done * 4],
+				    pixels - done);
+		return 0;
+	case GLC_VIDEO_BGR:
+		glc_lut_apply_bytes(lut->blue, lut->green, lut->red, 3, src, dst, pixels);
+		return 0;
+	case GLC_VIDEO_RGB:
+		glc_lut_apply_bytes(lut->red, lut->green, lut->blue, 3, src, dst, pixels);
+		return 0;
+	default:
+		return EINVAL;
+	}
+}
+
+static int glc_lut_channel(unsigned char *table, float brightness, float contrast, float gamma)
+{
+	double value;
+	unsigned int i;
+
+	if (!isfinite(brightness) || !isfinite(contrast) || !isfinite(gamma) || gamma <= 0)
+		return EINVAL;
+
+	for (i = 0; i < 256; i++) {
+		value = brightness + contrast * (1 - brightness) * pow(i / 255.0, gamma);
+		value = value * 255 + 0.5;
+		table[i] = value < 0 ? 0 : value > 255 ? 255 : (unsigned char) value;
+	}
+
+	return 0;
+}
+
+static void glc_lut_apply_bytes(const unsigned char *first, const unsigned char *second,
+				const unsigned char *third, unsigned int bpp, const unsigned char *src,
+				unsigned char *dst, size_t pixels)
+{
+	size_t i;
+
+	for (i = 0; i < pixels; i++, src += bpp, dst += bpp) {
+		dst[0] = first[src[0]];
+		dst[1] = second[src[1]];
+		dst[2] = third[src[2]];
+		if (bpp == 4)
+			dst[3] = src[3];
+	}
+}
+
+/* eight BGRA pixels per iteration, each channel fetched with one gather */
+__attribute__ ((target ("avx2")))
+static size_t glc_lut_gather_avx2(const glc_lut_t *lut, const unsigned char *src, unsigned char *dst,
+				  size_t pixels)
+{
+	const __m256i mask = _mm256_set1_epi32(0xff), alpha = _mm256_set1_epi32(0xff000000);
+	__m256i p, out;
+	size_t i;
+
+	for (i = 0; i + 8 <= pixels; i += 8) {
+		p = _mm256_loadu_si256((const __m256i *) &src[i * 4]);
+		out = _mm256_and_si256(p, alpha);
+		out = _mm256_or_si256(out, _mm256_i32gather_epi32((const int *) lut->blue32,
+								  _mm256_and_si256(p, mask), 4));
+		out = _mm256_or_si256(out, _mm256_i32gather_epi32((const int *) lut->green32,
+								  _mm256_and_si256(_mm256_srli_epi32(p, 8), mask), 4));
+		out = _mm256_or_si256(out, _mm256_i32gather_epi32((const int *) lut->red32,
+								  _mm256_and_si256(_mm256_srli_epi32(p, 16), mask), 4));
+		_mm256_storeu_si256((__m256i *) &dst[i * 4], out);
+	}
+
+	return i;
+}
+
+static size_t glc_lut_gather(const glc_lut_t *lut, const unsigned char *src, unsigned char *dst,
+			     size_t pixels)
+{
+	if (!__builtin_cpu_supports("avx2"))
+		return 0;
+	return glc_lut_gather_avx2(lut, src, dst, pixels);
+}
+
+/**  \} */
@@ -0,0 +1,77 @@
+/**
+ * \file src/common/lut.h
+ * \brief colour correction lookup tables
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup lut colour lookup tables
+ *  A GLC_MESSAGE_COLOR message describes the gamma ramp the display
+ *  applied to a video stream, as read by x11_get_calibration(): channel
+ *  value x in [0, 1] is shown as
+ *
+ *    brightness + contrast * (1 - brightness) * x ^ gamma
+ *
+ *  with brightness and contrast as fractions (the calibration values
+ *  divided by 100) and the red, green and blue gamma as exponents. A
+ *  message with brightness 0, contrast 1 and gammas of 1 changes nothing.
+ *
+ *  Instead of evaluating that for every pixel, glc_lut_build() evaluates
+ *  it once for each of the 256 values of each channel, and
+ *  glc_lut_apply() looks pixels up in the tables. Four byte pixels are
+ *  looked up eight at a time with AVX2 gathers if the cpu has them.
+ *  \{
+ */
+
+#ifndef GLC2_LUT_H
+#define GLC2_LUT_H
+
+#include <stddef.h>
+
+#include "format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief lookup tables of one colour correction
+ */
+typedef struct {
+	/** corrected value of each blue, green and red value */
+	unsigned char blue[256], green[256], red[256];
+	/** the same, shifted to their place in a little endian BGRA pixel */
+	u_int32_t blue32[256], green32[256], red32[256];
+	/** the tables change nothing */
+	int identity;
+} glc_lut_t;
+
+/**
+ * \brief build the lookup tables of a colour message
+ * \param lut returned tables
+ * \param color colour message
+ * \return 0 on success or EINVAL if a value is out of range
+ */
+__PUBLIC int glc_lut_build(glc_lut_t *lut, const glc_color_message_t *color);
+
+/**
+ * \brief correct consecutive pixels
+ * \param lut tables
+ * \param format GLC_VIDEO_BGRA, GLC_VIDEO_BGR or GLC_VIDEO_RGB, alpha
+ *        is copied
+ * \param src pixels
+ * \param dst corrected pixels, may be src
+ * \param pixels number of pixels
+ * \return 0 on success or EINVAL if the format is not packed
+ */
+__PUBLIC int glc_lut_apply(const glc_lut_t *lut, glc_video_format_t format, const unsigned char *src,
+			   unsigned char *dst, size_t pixels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
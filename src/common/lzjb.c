@@ -0,0 +1,199 @@
+/**
+ * \file src/common/lzjb.c
+ * \brief lzjb compression
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup lzjb
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "lzjb.h"
+
+#define LZJB_MATCH_BITS		6
+#define LZJB_MATCH_MIN		3
+#define LZJB_MATCH_MAX		((1 << LZJB_MATCH_BITS) + (LZJB_MATCH_MIN - 1))
+#define LZJB_OFFSET_MAX		((1 << (16 - LZJB_MATCH_BITS)) - 1)
+/** items described by one control byte */
+#define LZJB_GROUP		8
+/** log2 of the number of match finder entries */
+#define LZJB_TABLE_BITS		12
+
+/* multiplicative hash of the next four bytes */
+static inline unsigned int glc_lzjb_hash(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v * 2654435761u) >> (32 - LZJB_TABLE_BITS);
+}
+
+size_t glc_lzjb_compress(const void *src, void *dst, size_t src_size, size_t dst_size)
+{
+	const unsigned char *in = src, *ip = in, *in_end = in + src_size, *ref = NULL;
+	unsigned char *op = dst, *out_end = op + dst_size, *control = NULL;
+	/* position + 1 of the last place each hash was seen, 0 if none */
+	size_t table[1 << LZJB_TABLE_BITS];
+	size_t pos, seen, len, max, off;
+	unsigned int items = LZJB_GROUP, h;
+
+	memset(table, 0, sizeof(table));
+
+	while (ip < in_end) {
+		if (items == LZJB_GROUP) {
+			/* the control byte and a group of matches must fit */
+			if ((size_t) (out_end - op) <= 1 + 2 * LZJB_GROUP)
+				return src_size;
+			control = op++;
+			*control = 0;
+			items = 0;
+		}
+
+		len = 0;
+		if (in_end - ip >= 4) {
+			pos = ip - in;
+			h = glc_lzjb_hash(ip);
+			seen = table[h];
+			table[h] = pos + 1;
+
+			if (seen && pos - (seen - 1) <= LZJB_OFFSET_MAX) {
+				ref = &in[seen - 1];
+				max = (size_t) (in_end - ip) < LZJB_MATCH_MAX ? (size_t) (in_end - ip) : LZJB_MATCH_MAX;
+				while (len < max && ref[len] == ip[len])
+					len++;
+			}
+		}
+
+		if (len >= LZJB_MATCH_MIN) {
+			off = ip - ref;
+			*control |= 1 << items;
+			op[0] = (len - LZJB_MATCH_MIN) << (8 - LZJB_MATCH_BITS) | off >> 8;
+			op[1] = off & 0xff;
+			op += 2;
+			ip += len;
+		} else {
+			*op++ = *ip++;
+		}
+		items++;
+	}
+
+	off = op - (unsigned char *) dst;
+	return off < src_size ? off : src_size;
+}
+
+int glc_lzjb_decompress(const void *src, void *dst, size_t src_size, size_t dst_size)
+{
+	const unsigned char *ip = src, *in_end = ip + src_size;
+	unsigned char *out = dst, *op = out, *out_end = out + dst_size;
+	unsigned int control, item;
+	size_t len, off;
+
+	while (op < out_end) {
+		if (ip == in_end)
+			return EINVAL;
+		control = *ip++;
+
+		for (item = 0; item < LZJB_GROUP && op < out_end; item++, control >>= 1) {
+			if (!(control & 1)) {
+				if (ip == in_end)
+					return EINVAL;
+				*op++ = *ip++;
+				continue;
+			}
+
+			if (in_end - ip < 2)
+				return EINVAL;
+			len = (ip[0] >> (8 - LZJB_MATCH_BITS)) + LZJB_MATCH_MIN;
+			off = (size_t) (ip[0] & (0xff >> LZJB_MATCH_BITS)) << 8 | ip[1];
+			ip += 2;
+
+			if (!off || off > (size_t) (op - out) || len > (size_t) (out_end - op))
+				return EINVAL;
+
+			if (off >= len) {
+				memcpy(op, op - off, len);
+				op += len;
+			} else {
+				/* the match overlaps what it produces, e.g. a run */
+				for (; len; len--, op++)
+					*op = op[-off];
+			}
+		}
+	}
+
+	return 0;
+}
+
+int glc_lzjb_message_decompress(const void *msg, size_t size, glc_message_header_t *header,
+				void **data, size_t *data_size)
+{
+	glc_lzjb_header_t lzjb_header;
+	void *out;
+	int ret;
+
+	if (size < sizeof(lzjb_header))
+		return EPROTO;
+	memcpy(&lzjb_header, msg, sizeof(lzjb_header));
+
+	if (!(out = malloc(lzjb_header.size ? lzjb_header.size : 1)))
+		return ENOMEM;
+
+	if ((ret = glc_lzjb_message_decompress_to(msg, size, out, lzjb_header.size))) {
+		free(out);
+		return ret;
+	}
+
+	*header = lzjb_header.header;
+	*data = out;
+	*data_size = lzjb_header.size;
+	return 0;
+}
+
+int glc_lzjb_message_decompress_to(const void *msg, size_t size, void *data, size_t data_size)
+{
+	const unsigned char *p = msg, *end = p + size;
+	unsigned char *out = data;
+	glc_lzjb_header_t lzjb_header;
+	glc_compressed_block_t block;
+	size_t pos = 0;
+	int ret;
+
+	if (size < sizeof(lzjb_header))
+		return EPROTO;
+	memcpy(&lzjb_header, p, sizeof(lzjb_header));
+	p += sizeof(lzjb_header);
+
+	if (lzjb_header.size != data_size)
+		return EINVAL;
+
+	while (pos < lzjb_header.size) {
+		if ((size_t) (end - p) < sizeof(block))
+			return EINVAL;
+		memcpy(&block, p, sizeof(block));
+		p += sizeof(block);
+
+		if ((block.compressed_size > (size_t) (end - p)) ||
+		    (block.size > lzjb_header.size - pos) ||
+		    (block.compressed_size > block.size))
+			return EINVAL;
+
+		if (block.compressed_size == block.size)
+			memcpy(&out[pos], p, block.size);
+		else if ((ret = glc_lzjb_decompress(p, &out[pos], block.compressed_size, block.size)))
+			return ret;
+
+		p += block.compressed_size;
+		pos += block.size;
+	}
+
+	return 0;
+}
+
+/**  \} */
@@ -0,0 +1,86 @@
+/**
+ * \file src/common/lzjb.h
+ * \brief lzjb compression
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup lzjb lzjb
+ *  LZJB is the Lempel-Ziv variant used by ZFS: a one byte copy map
+ *  precedes every eight items, an item is either a literal byte or a two
+ *  byte match of 3-66 bytes at most 1023 bytes back. It compresses less
+ *  than LZO or QuickLZ but is tiny, needs no dictionary setup and runs
+ *  at memory speed, which is what capturing needs.
+ *
+ *  Only the format is shared with ZFS. The codec here is written for
+ *  this tree: matches are found with a multiplicative hash of the next
+ *  four bytes, and the decoder copies non-overlapping matches at once.
+ *
+ *  GLC_MESSAGE_LZJB messages carry a glc_lzjb_header_t followed by
+ *  glc_compressed_block_t blocks, each compressed on its own so blocks
+ *  can be compressed and decompressed in parallel.
+ *  \{
+ */
+
+#ifndef GLC2_LZJB_H
+#define GLC2_LZJB_H
+
+#include <stddef.h>
+
+#include "format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief compress a block
+ * \param src uncompressed data
+ * \param dst destination, dst_size bytes
+ * \param src_size uncompressed size
+ * \param dst_size size of dst
+ * \return compressed size or src_size if the data does not shrink below
+ *         dst_size, dst must not be used then
+ */
+__PUBLIC size_t glc_lzjb_compress(const void *src, void *dst, size_t src_size, size_t dst_size);
+
+/**
+ * \brief decompress a block
+ * \param src compressed data
+ * \param dst destination
+ * \param src_size compressed size
+ * \param dst_size uncompressed size
+ * \return 0 on success or EINVAL if the data is corrupt
+ */
+__PUBLIC int glc_lzjb_decompress(const void *src, void *dst, size_t src_size, size_t dst_size);
+
+/**
+ * \brief decompress a GLC_MESSAGE_LZJB payload
+ * \param msg message payload, starting with glc_lzjb_header_t
+ * \param size payload size
+ * \param header returned header of the original message
+ * \param data returned original payload, must be freed
+ * \param data_size returned original payload size
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_lzjb_message_decompress(const void *msg, size_t size, glc_message_header_t *header,
+					 void **data, size_t *data_size);
+
+/**
+ * \brief decompress a GLC_MESSAGE_LZJB payload into a buffer
+ * \param msg message payload, starting with glc_lzjb_header_t
+ * \param size payload size
+ * \param data destination
+ * \param data_size size of data, must be the size in the header
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_lzjb_message_decompress_to(const void *msg, size_t size, void *data, size_t data_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
@@ -6,19 +6,34 @@
  * For conditions of distribution and use, see copyright notice in packetstream.h
  */
 
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* vmsplice() */
+#endif
+
 #include "packetstream.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
-#include <pthread.h>
-#include <semaphore.h>
+#include <unistd.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/uio.h>
+#endif
 
 #ifdef __PS_SHM
 #include <sys/time.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 /**
@@ -51,55 +66,135 @@
 	__PS_PACKET_CHECK(packet)
 #define __PS_CHECK_CANCEL_READ(state) \
 	if (state->flags & PS_BUFFER_CANCELLED) { \
-		pthread_mutex_unlock(&state->read_mutex); \
+		ps_mutex_unlock(&state->read_mutex); \
 		return EINTR; \
 	}
 #define __PS_CHECK_CANCEL_WRITE(state) \
 	if (state->flags & PS_BUFFER_CANCELLED) { \
-		pthread_mutex_unlock(&state->write_mutex); \
+		ps_mutex_unlock(&state->write_mutex); \
 		return EINTR; \
 	}
 
+/**
+ * \addtogroup spec
+ *  \{
+ */
+
+/** test buffer and packet flags at runtime */
+#define __PS_SPEC_GENERIC        0
+/** buffer is known to collect statistics */
+#define __PS_SPEC_STATS          1
+/** buffer is known to not collect statistics */
+#define __PS_SPEC_NOSTATS        2
+/** packet is known to have constant size set */
+#define __PS_SPEC_SIZE_SET       4
+/** caller guarantees that buffer and packet are valid */
+#define __PS_SPEC_NOCHECK        8
+
+/* spec is always a compile-time constant, so these fold away */
+#define __PS_SPEC_HAS_STATS(spec, state) \
+	((spec) & __PS_SPEC_STATS ? 1 : \
+	 ((spec) & __PS_SPEC_NOSTATS ? 0 : ((state)->flags & PS_BUFFER_STATS)))
+#define __PS_SPEC_HAS_SIZE_SET(spec, packet) \
+	((spec) & __PS_SPEC_SIZE_SET ? 1 : ((packet)->flags & PS_PACKET_SIZE_SET))
+#define __PS_SPEC_PACKET_CHECK(spec, packet) \
+	if (!((spec) & __PS_SPEC_NOCHECK)) \
+		__PS_PACKET_CHECK(packet)
+#define __PS_SPEC_BUFFER_CHECK(spec, buffer) \
+	if (!((spec) & __PS_SPEC_NOCHECK)) \
+		__PS_BUFFER_CHECK(buffer)
+
+/** hot path function which is instantiated once per specialization */
+#define __PS_HOT __inline__ static __attribute__ ((always_inline))
+
+/**  \} */
+
+/**
+ * \addtogroup sync
+ *  \{
+ */
+
+/** 64bit integer with the same alignment on i386 and x86_64 */
+typedef uint64_t ps_u64_t __attribute__ ((aligned (8)));
+/** signed 64bit integer with the same alignment on i386 and x86_64 */
+typedef int64_t ps_s64_t __attribute__ ((aligned (8)));
+
+/**
+ * \brief futex based mutex
+ *
+ * Unlike pthread_mutex_t this has the same size and layout for every
+ * ABI, so 32bit and 64bit processes can share it.
+ */
+typedef struct {
+	/** 0 = unlocked, 1 = locked, 2 = locked and contended */
+	uint32_t lock;
+	/** 0 or FUTEX_PRIVATE_FLAG */
+	uint32_t op_flags;
+} ps_mutex_t;
+
+/**
+ * \brief futex based counting semaphore
+ */
+typedef struct {
+	/** semaphore value */
+	uint32_t value;
+	/** number of threads sleeping in ps_sem_wait() */
+	uint32_t waiters;
+	/** 0 or FUTEX_PRIVATE_FLAG */
+	uint32_t op_flags;
+	/** reserved */
+	uint32_t reserved;
+} ps_sem_t;
+
+/**  \} */
+
+/** state layout version, bump when ps_state_s or ps_packet_header_s changes */
+#define PS_STATE_ABI             0x70730002
+
 /**
  * \ingroup buffer
  * \brief internal buffer state
+ *
+ * This lives in shared memory and may be accessed by i386 and x86_64
+ * processes at the same time, so only fixed-width, explicitly aligned
+ * types are allowed here.
  */
 struct ps_state_s {
 	/** flags */
-	ps_flags_t flags;
+	int32_t flags;
+	/** layout version, PS_STATE_ABI */
+	uint32_t abi;
 	/** buffer size */
-	size_t size;
+	ps_u64_t size;
 	/** position of the first packet opened for reading or next
 	 *  packet to be read if there is no open (read) packets */
-	size_t read_pos;
+	ps_u64_t read_pos;
 	/** position of the first packet opened for writing or next
 	 * packet to be written if there is no open (write) packets */
-	size_t write_pos;
+	ps_u64_t write_pos;
 	/** position of the next packet to be read */
-	size_t read_next;
+	ps_u64_t read_next;
 	/** position of the next packet to be written */
-	size_t write_next;
+	ps_u64_t write_next;
 	/** the first written (possibly also read) packet that has
 	 * not been free'd */
-	size_t read_first;
+	ps_u64_t read_first;
 	/** free bytes */
-	long free_bytes;
+	ps_s64_t free_bytes;
 	/** mutex for ps_buffer_openread() */
-	pthread_mutex_t read_mutex;
+	ps_mutex_t read_mutex;
 	/** mutex for ps_buffer_openwrite()...ps_buffer_setsize() */
-	pthread_mutex_t write_mutex;
+	ps_mutex_t write_mutex;
 	/** mutex for ps_buffer_closeread() */
-	pthread_mutex_t read_close_mutex;
+	ps_mutex_t read_close_mutex;
 	/** mutex for ps_buffer_closewrite() */
-	pthread_mutex_t write_close_mutex;
+	ps_mutex_t write_close_mutex;
 	/** number of consumed packets */
-	sem_t read_packets;
+	ps_sem_t read_packets;
 	/** number of produced packets */
-	sem_t written_packets;
-#ifndef WIN32
-	/** absolute time (since EPOCH) when this buffer was created */
-	struct timeval create_time;
-#endif
+	ps_sem_t written_packets;
+	/** absolute time (since EPOCH) in microseconds when this buffer was created */
+	ps_u64_t create_time;
 };
 
 /**
@@ -108,11 +203,18 @@ struct ps_state_s {
  */
 struct ps_packet_header_s {
 	/** flags */
-	ps_flags_t flags;
+	int32_t flags;
+	/** reserved */
+	uint32_t reserved;
 	/** packet size (excluding header) in bytes */
-	size_t size;
+	ps_u64_t size;
 };
 
+/* the shared layout must not depend on the ABI */
+_Static_assert(sizeof(struct ps_state_s) == 136, "ps_state_s layout changed");
+_Static_assert(sizeof(struct ps_packet_header_s) == 16, "ps_packet_header_s layout changed");
+_Static_assert(sizeof(ps_stats_t) == 56, "ps_stats_t layout changed");
+
 /**
  * \addtogroup packet
  *  \{
@@ -136,6 +238,13 @@ struct ps_fake_dma_s {
 	struct ps_fake_dma_s *next;
 };
 
+/** cache line size assumed by prefetch */
+#define PS_PREFETCH_LINE         64
+/** number of payload cache lines to prefetch */
+#define PS_PREFETCH_LINES        8
+/** packets at least this big are also madvise()'d */
+#define PS_PREFETCH_MADVISE_SIZE (1024 * 1024)
+
 /** packet is written to buffer */
 #define PS_PACKET_HEADER_WRITTEN 1
 /** packet is read from buffer */
@@ -146,13 +255,17 @@ struct ps_fake_dma_s {
 __inline__ static int ps_packet_check(ps_packet_t *packet);
 __inline__ static int ps_buffer_check(ps_buffer_t *buffer);
 
-int ps_packet_openread(ps_packet_t *packet, ps_flags_t flags);
-int ps_packet_openwrite(ps_packet_t *packet, ps_flags_t flags);
+__inline__ static void ps_buffer_prefetch(ps_buffer_t *buffer, size_t pos, size_t size);
+__PS_HOT int ps_packet_openread_spec(ps_packet_t *packet, ps_flags_t flags, const int spec);
+__PS_HOT int ps_packet_openwrite_spec(ps_packet_t *packet, ps_flags_t flags, const int spec);
 
-int ps_packet_closeread(ps_packet_t *packet);
-int ps_packet_closewrite(ps_packet_t *packet);
+__PS_HOT int ps_packet_closeread_spec(ps_packet_t *packet, const int spec);
+__PS_HOT int ps_packet_closewrite_spec(ps_packet_t *packet, const int spec);
 
-int ps_packet_reserve(ps_packet_t *packet, size_t len);
+__PS_HOT int ps_packet_setsize_spec(ps_packet_t *packet, size_t size, const int spec);
+__PS_HOT int ps_packet_reserve_spec(ps_packet_t *packet, size_t len, const int spec);
+__PS_HOT int ps_packet_read_spec(ps_packet_t *packet, void *dest, size_t size, const int spec);
+__PS_HOT int ps_packet_write_spec(ps_packet_t *packet, void *src, size_t size, const int spec);
 
 int ps_packet_fakedma_alloc(ps_packet_t *packet, struct ps_fake_dma_s **fake_dma, size_t size);
 int ps_packet_fakedma_free(ps_packet_t *packet, struct ps_fake_dma_s *fake_dma);
@@ -160,32 +273,227 @@ int ps_packet_fakedma_cut(ps_packet_t *packet, size_t size);
 int ps_packet_fakedma_commitall(ps_packet_t *packet);
 int ps_packet_fakedma_freeall(ps_packet_t *packet);
 
-unsigned long ps_buffer_utime(ps_buffer_t *buffer);
+uint64_t ps_buffer_utime(ps_buffer_t *buffer);
+
+/**
+ * \addtogroup sync
+ *  \{
+ */
+
+__inline__ static int ps_futex(uint32_t *addr, int op, uint32_t val)
+{
+	return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+__inline__ static void ps_mutex_init(ps_mutex_t *mutex, int shared)
+{
+	mutex->lock = 0;
+	mutex->op_flags = shared ? 0 : FUTEX_PRIVATE_FLAG;
+}
+
+__inline__ static int ps_mutex_trylock(ps_mutex_t *mutex)
+{
+	uint32_t c = 0;
+	if (__atomic_compare_exchange_n(&mutex->lock, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 0;
+	return EBUSY;
+}
+
+__inline__ static int ps_mutex_lock(ps_mutex_t *mutex)
+{
+	uint32_t c = 0;
+	if (__atomic_compare_exchange_n(&mutex->lock, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 0;
+
+	if (c != 2)
+		c = __atomic_exchange_n(&mutex->lock, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		ps_futex(&mutex->lock, FUTEX_WAIT | mutex->op_flags, 2);
+		c = __atomic_exchange_n(&mutex->lock, 2, __ATOMIC_ACQUIRE);
+	}
+
+	return 0;
+}
+
+__inline__ static int ps_mutex_unlock(ps_mutex_t *mutex)
+{
+	if (__atomic_exchange_n(&mutex->lock, 0, __ATOMIC_RELEASE) == 2)
+		ps_futex(&mutex->lock, FUTEX_WAKE | mutex->op_flags, 1);
+	return 0;
+}
+
+__inline__ static void ps_sem_init(ps_sem_t *sem, int shared, uint32_t value)
+{
+	sem->value = value;
+	sem->waiters = 0;
+	sem->op_flags = shared ? 0 : FUTEX_PRIVATE_FLAG;
+	sem->reserved = 0;
+}
+
+__inline__ static int ps_sem_trywait(ps_sem_t *sem)
+{
+	uint32_t v = __atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+	while (v > 0) {
+		if (__atomic_compare_exchange_n(&sem->value, &v, v - 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return 0;
+	}
+	return EAGAIN;
+}
+
+__inline__ static int ps_sem_wait(ps_sem_t *sem)
+{
+	while (ps_sem_trywait(sem)) {
+		__atomic_add_fetch(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+		ps_futex(&sem->value, FUTEX_WAIT | sem->op_flags, 0);
+		__atomic_sub_fetch(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+	return 0;
+}
+
+__inline__ static int ps_sem_post(ps_sem_t *sem)
+{
+	if (__atomic_add_fetch(&sem->value, 1, __ATOMIC_SEQ_CST) == 0)
+		return EOVERFLOW;
+	if (__atomic_load_n(&sem->waiters, __ATOMIC_SEQ_CST))
+		ps_futex(&sem->value, FUTEX_WAKE | sem->op_flags, 1);
+	return 0;
+}
+
+__inline__ static int ps_sem_getvalue(ps_sem_t *sem, int *value)
+{
+	uint32_t v = __atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+	*value = v > INT_MAX ? INT_MAX : (int) v;
+	return 0;
+}
+
+/**  \} */
+
+/* (re)initialize the state of a buffer nobody else uses, data is left alone */
+static void ps_buffer_state_init(ps_buffer_t *buffer, size_t size, ps_flags_t flags)
+{
+	struct ps_state_s *state = (struct ps_state_s *) buffer->state;
+	int shared = (flags & PS_BUFFER_PSHARED) ? 1 : 0;
+	struct timeval tv;
+
+	memset(state, 0, sizeof(struct ps_state_s));
+	if (flags & PS_BUFFER_STATS)
+		memset(buffer->stats, 0, sizeof(ps_stats_t));
+
+	state->size = size;
+	state->flags = flags;
+	state->free_bytes = size - sizeof(struct ps_packet_header_s);
+
+	state->abi = PS_STATE_ABI;
+
+	ps_mutex_init(&state->read_mutex, shared);
+	ps_mutex_init(&state->write_mutex, shared);
+
+	ps_mutex_init(&state->read_close_mutex, shared);
+	ps_mutex_init(&state->write_close_mutex, shared);
+
+	ps_sem_init(&state->read_packets, shared, 0);
+	ps_sem_init(&state->written_packets, shared, 0);
+
+	gettimeofday(&tv, NULL);
+	state->create_time = (uint64_t) tv.tv_sec * 1000000 + (uint64_t) tv.tv_usec;
+
+	/* publish the initialized state last */
+	__atomic_or_fetch(&state->flags, PS_BUFFER_READY, __ATOMIC_RELEASE);
+}
+
+#ifdef __PS_SHM
+static int ps_buffer_memfd_map(ps_buffer_t *buffer, ps_bufferattr_t *attr, ps_flags_t *flags)
+{
+	size_t stats_size = (*flags & PS_BUFFER_STATS) ? sizeof(ps_stats_t) : 0;
+	size_t map_size = sizeof(struct ps_state_s) + stats_size + attr->size;
+	struct stat st;
+	int fd = attr->fd, seals, ret;
+
+	if (fd == -1) {
+		fd = memfd_create("packetstream", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (fd == -1)
+			return errno;
+
+		if (ftruncate(fd, map_size) ||
+		    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+			ret = errno;
+			close(fd);
+			return ret;
+		}
+	} else {
+		/* the creator could make our accesses fault by shrinking it */
+		seals = fcntl(fd, F_GET_SEALS);
+		if ((seals == -1) || !(seals & F_SEAL_SHRINK))
+			return EPERM;
+
+		if (fstat(fd, &st))
+			return errno;
+
+		if ((size_t) st.st_size < sizeof(struct ps_state_s) + stats_size + sizeof(struct ps_packet_header_s) * 2)
+			return EPROTO;
+
+		map_size = st.st_size;
+		*flags |= PS_BUFFER_READY;
+	}
+
+	buffer->state = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (buffer->state == MAP_FAILED) {
+		ret = errno;
+		buffer->state = NULL;
+		if (attr->fd == -1)
+			close(fd);
+		return ret;
+	}
+
+	/* the data area must be inside the mapping */
+	if ((*flags & PS_BUFFER_READY) &&
+	    (((struct ps_state_s *) buffer->state)->size > map_size - sizeof(struct ps_state_s) - stats_size)) {
+		munmap(buffer->state, map_size);
+		buffer->state = NULL;
+		return EPROTO;
+	}
+
+	buffer->buffer = &((unsigned char *) buffer->state)[sizeof(struct ps_state_s) + stats_size];
+	if (*flags & PS_BUFFER_STATS)
+		buffer->stats = (ps_stats_t *) &((unsigned char *) buffer->state)[sizeof(struct ps_state_s)];
+	buffer->fd = fd;
+
+	return 0;
+}
+
+static void ps_buffer_memfd_unmap(ps_buffer_t *buffer)
+{
+	struct stat st;
+
+	if (!fstat(buffer->fd, &st))
+		munmap(buffer->state, st.st_size);
+	close(buffer->fd);
+	buffer->fd = -1;
+}
+#endif
 
 int ps_buffer_init(ps_buffer_t *buffer, ps_bufferattr_t *attr)
 {
 	/* 12.35 neon-green midgets will rip out your lungs and laugh at you
 	   if you dare to assume that this is a thread-safe function !!! */
 
-	struct ps_state_s *state;
 	size_t stats_size = 0;
-	int shared = 0;
 	ps_flags_t flags = attr->flags;
 	int shmid = attr->shmid;
-	pthread_mutexattr_t mutexattr;
+	int ret;
 
 	if (buffer == NULL)
 		return EINVAL;
 
 	memset(buffer, 0, sizeof(ps_buffer_t));
-
-	pthread_mutexattr_init(&mutexattr);
+	buffer->fd = -1;
 
 #ifdef __PS_SHM
-	if (flags & PS_BUFFER_PSHARED) {
-		shared = 1;
-		pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_SHARED);
-
+	if ((flags & PS_BUFFER_PSHARED) && (flags & PS_SHM_MEMFD)) {
+		shmid = -1;
+		if ((ret = ps_buffer_memfd_map(buffer, attr, &flags)))
+			return ret;
+	} else if (flags & PS_BUFFER_PSHARED) {
 		if (flags & PS_BUFFER_STATS)
 			stats_size = sizeof(ps_stats_t);
 
@@ -219,6 +527,7 @@ int ps_buffer_init(ps_buffer_t *buffer, ps_bufferattr_t *attr)
 			buffer->stats = (ps_stats_t *) &((unsigned char *) buffer->state)[sizeof(struct ps_state_s)];
 	} else {
 #endif
+		shmid = -1;
 		buffer->state = malloc(sizeof(struct ps_state_s));
 		buffer->buffer = malloc(attr->size);
 		if (flags & PS_BUFFER_STATS)
@@ -233,37 +542,29 @@ int ps_buffer_init(ps_buffer_t *buffer, ps_bufferattr_t *attr)
 	if ((flags & PS_BUFFER_STATS) && (buffer->stats == NULL))
 		return ENOMEM;
 
-	if (flags & PS_BUFFER_READY)
+	if (flags & PS_BUFFER_READY) {
+		/* attached to a buffer created by someone else */
+		buffer->shmid = shmid;
+		if (((struct ps_state_s *) buffer->state)->abi != PS_STATE_ABI)
+			return EPROTO;
 		return 0;
+	}
 
 	memset(buffer->buffer, 0, attr->size);
-	memset(buffer->state, 0, sizeof(struct ps_state_s));
-	if (flags & PS_BUFFER_STATS)
-		memset(buffer->stats, 0, sizeof(ps_stats_t));
-
-	state = (struct ps_state_s *) buffer->state;
-
-	state->size = attr->size;
-	state->flags = flags;
-	state->free_bytes = attr->size - sizeof(struct ps_packet_header_s);
 	buffer->shmid = shmid;
+	ps_buffer_state_init(buffer, attr->size, flags);
 
-	/* TODO should we check for errors? */
-	pthread_mutex_init(&state->read_mutex, &mutexattr);
-	pthread_mutex_init(&state->write_mutex, &mutexattr);
-
-	pthread_mutex_init(&state->read_close_mutex, &mutexattr);
-	pthread_mutex_init(&state->write_close_mutex, &mutexattr);
-
-	sem_init(&state->read_packets, shared, 0);
-	sem_init(&state->written_packets, shared, 0);
-
-	pthread_mutexattr_destroy(&mutexattr);
-
-	gettimeofday(&state->create_time, NULL);
+	return 0;
+}
 
-	state->flags |= PS_BUFFER_READY;
+int ps_buffer_reset(ps_buffer_t *buffer)
+{
+	/* cancelled buffers can be reset too */
+	if (buffer == NULL || buffer->state == NULL)
+		return EINVAL;
+	__PS_BUFFER_VARS(buffer)
 
+	ps_buffer_state_init(buffer, state->size, state->flags & ~(PS_BUFFER_READY | PS_BUFFER_CANCELLED));
 	return 0;
 }
 
@@ -275,21 +576,16 @@ int ps_buffer_destroy(ps_buffer_t *buffer)
 	        and free stuff only if there is 0 active
 	        progs/threads using this buffer */
 
-	pthread_mutex_destroy(&state->read_mutex);
-	pthread_mutex_destroy(&state->write_mutex);
-
-	pthread_mutex_destroy(&state->read_close_mutex);
-	pthread_mutex_destroy(&state->write_close_mutex);
-
-	sem_destroy(&state->read_packets);
-	sem_destroy(&state->written_packets);
-
-	if (state->flags & PS_BUFFER_PSHARED) {
-		shmdt(buffer->state);
+	/* the flags are in the shared state where a peer can change them,
+	   how the buffer was set up is only known from the process' own fields */
+	if (buffer->fd != -1) {
+		ps_buffer_memfd_unmap(buffer);
+	} else if (buffer->shmid != -1) {
+		/* remove while still attached, the id can not be reused yet */
 		shmctl(buffer->shmid, IPC_RMID, 0);
+		shmdt(buffer->state);
 	} else {
-		if (state->flags & PS_BUFFER_STATS)
-			free(buffer->stats);
+		free(buffer->stats);
 		free(buffer->buffer);
 		free(state);
 	}
@@ -297,6 +593,33 @@ int ps_buffer_destroy(ps_buffer_t *buffer)
 	return 0;
 }
 
+int ps_buffer_unlink(ps_buffer_t *buffer)
+{
+	__PS_BUFFER_CHECK(buffer)
+
+	/* a memfd is gone with the last descriptor and mapping */
+	if (buffer->shmid == -1)
+		return 0;
+
+	if (shmctl(buffer->shmid, IPC_RMID, 0))
+		return errno;
+
+	return 0;
+}
+
+int ps_buffer_detach(ps_buffer_t *buffer)
+{
+	if (buffer->fd != -1)
+		ps_buffer_memfd_unmap(buffer);
+	else if (buffer->shmid != -1)
+		shmdt(buffer->state);
+	else
+		return ps_buffer_destroy(buffer);
+	memset(buffer, 0, sizeof(ps_buffer_t));
+
+	return 0;
+}
+
 int ps_packet_init(ps_packet_t *packet, ps_buffer_t *buffer)
 {
 	__PS_BUFFER_CHECK(buffer)
@@ -344,39 +667,41 @@ int ps_packet_open(ps_packet_t *packet, ps_flags_t flags)
 		return EINVAL;
 
 	if (flags & PS_PACKET_READ)
-		return ps_packet_openread(packet, flags);
+		return ps_packet_openread_spec(packet, flags, __PS_SPEC_GENERIC);
 	else
-		return ps_packet_openwrite(packet, flags);
+		return ps_packet_openwrite_spec(packet, flags, __PS_SPEC_GENERIC);
 }
 
-int ps_packet_openread(ps_packet_t *packet, ps_flags_t flags)
+__PS_HOT int ps_packet_openread_spec(ps_packet_t *packet, ps_flags_t flags, const int spec)
 {
 	__PS_BUFFER_VARS(packet->buffer)
 	ps_buffer_t *buffer = packet->buffer;
 	struct ps_packet_header_s *header;
+	size_t next;
+	int ready;
 
 	if (flags & PS_PACKET_TRY) {
-		if (pthread_mutex_trylock(&state->read_mutex))
+		if (ps_mutex_trylock(&state->read_mutex))
 			return EBUSY;
-	} else if (pthread_mutex_lock(&state->read_mutex))
+	} else if (ps_mutex_lock(&state->read_mutex))
 		return EINVAL;
 	__PS_CHECK_CANCEL_READ(state)
 
-	if (state->flags & PS_BUFFER_STATS)
+	if (__PS_SPEC_HAS_STATS(spec, state))
 		buffer->read_wait_start = ps_buffer_utime(buffer);
 
 	if (flags & PS_PACKET_TRY) {
-		if (sem_trywait(&state->written_packets)) {
-			pthread_mutex_unlock(&state->read_mutex);
+		if (ps_sem_trywait(&state->written_packets)) {
+			ps_mutex_unlock(&state->read_mutex);
 			return EBUSY;
 		}
-	} else if (sem_wait(&state->written_packets)) {
-		pthread_mutex_unlock(&state->read_mutex);
+	} else if (ps_sem_wait(&state->written_packets)) {
+		ps_mutex_unlock(&state->read_mutex);
 		return EINVAL;
 	}
 	__PS_CHECK_CANCEL_READ(state)
 
-	if (state->flags & PS_BUFFER_STATS)
+	if (__PS_SPEC_HAS_STATS(spec, state))
 		buffer->stats->read_wait_usec += ps_buffer_utime(buffer) - buffer->read_wait_start;
 
 	packet->flags = flags & ~PS_PACKET_TRY;
@@ -389,22 +714,63 @@ int ps_packet_openread(ps_packet_t *packet, ps_flags_t flags)
 	state->read_next = (sizeof(struct ps_packet_header_s) + state->read_next + header->size) % state->size;
 	if (state->read_next + sizeof(struct ps_packet_header_s) > state->size)
 		state->read_next = 0;
+	next = state->read_next;
 
-	pthread_mutex_unlock(&state->read_mutex);
+	ps_mutex_unlock(&state->read_mutex);
+
+	if (flags & PS_PACKET_PREFETCH) {
+		ps_buffer_prefetch(buffer, packet->buffer_pos, header->size);
+		__builtin_prefetch(&buffer->buffer[next], 0, 3);
+
+		/* next payload only if next packet is already written */
+		if ((!ps_sem_getvalue(&state->written_packets, &ready)) && (ready > 0))
+			ps_buffer_prefetch(buffer, next, ((struct ps_packet_header_s *) &buffer->buffer[next])->size);
+	}
 
 	return 0;
 }
 
-int ps_packet_openwrite(ps_packet_t *packet, ps_flags_t flags)
+__inline__ static void ps_buffer_prefetch(ps_buffer_t *buffer, size_t pos, size_t size)
+{
+	__PS_BUFFER_VARS(buffer)
+	size_t offs, len, i;
+#ifdef __PS_SHM
+	size_t page;
+	uintptr_t start, end;
+#endif
+
+	offs = (pos + sizeof(struct ps_packet_header_s)) % state->size;
+
+	/* size may be stale, so stay inside buffer and don't wrap */
+	len = size;
+	if (len > state->size - offs)
+		len = state->size - offs;
+
+	for (i = 0; (i < PS_PREFETCH_LINES) && (i * PS_PREFETCH_LINE < len); i++)
+		__builtin_prefetch(&buffer->buffer[offs + i * PS_PREFETCH_LINE], 0, 3);
+
+#ifdef __PS_SHM
+	if (len >= PS_PREFETCH_MADVISE_SIZE) {
+		page = (size_t) sysconf(_SC_PAGESIZE);
+		start = ((uintptr_t) &buffer->buffer[offs] + page - 1) & ~((uintptr_t) page - 1);
+		end = ((uintptr_t) &buffer->buffer[offs + len]) & ~((uintptr_t) page - 1);
+		if (end > start)
+			madvise((void *) start, end - start, MADV_WILLNEED);
+	}
+#endif
+}
+
+__PS_HOT int ps_packet_openwrite_spec(ps_packet_t *packet, ps_flags_t flags, const int spec)
 {
 	__PS_BUFFER_VARS(packet->buffer)
 	ps_buffer_t *buffer = packet->buffer;
 	struct ps_packet_header_s *header;
+	(void)(spec);
 
 	if (flags & PS_PACKET_TRY) {
-		if (pthread_mutex_trylock(&state->write_mutex))
+		if (ps_mutex_trylock(&state->write_mutex))
 			return EBUSY;
-	} else if (pthread_mutex_lock(&state->write_mutex))
+	} else if (ps_mutex_lock(&state->write_mutex))
 		return EINVAL;
 	__PS_CHECK_CANCEL_WRITE(state)
 
@@ -423,11 +789,56 @@ int ps_packet_openwrite(ps_packet_t *packet, ps_flags_t flags)
 	return 0;
 }
 
+int ps_packet_open_sized(ps_packet_t *packet, ps_flags_t flags, size_t size)
+{
+	int ret;
+	size_t next, res = 0;
+	__PS_BUFFER_CHECK(packet->buffer)
+	__PS_BUFFER_VARS(packet->buffer)
+
+	if ((!(flags & PS_PACKET_WRITE)) | (flags & PS_PACKET_READ))
+		return EINVAL;
+
+	if ((ret = ps_packet_openwrite_spec(packet, flags, __PS_SPEC_GENERIC)))
+		return ret;
+
+	if (size + sizeof(struct ps_packet_header_s) * 2 > state->size) {
+		ps_packet_cancel(packet);
+		return ENOBUFS;
+	}
+
+	/* reserve everything ps_packet_setsize() will, header->size and
+	   write_next are still untouched if this fails */
+	next = (sizeof(struct ps_packet_header_s) + state->write_next + size) % state->size;
+	if (next + sizeof(struct ps_packet_header_s) > state->size)
+		res = state->size - next;
+
+	if ((ret = ps_packet_reserve_spec(packet, sizeof(struct ps_packet_header_s) + size + res,
+					  __PS_SPEC_GENERIC))) {
+		/* a cancelled buffer released write_mutex already */
+		if (ret == EINTR) {
+			packet->header = NULL;
+			packet->flags = 0;
+		} else
+			ps_packet_cancel(packet);
+		return ret;
+	}
+
+	/* only takes what is reserved already, releases write_mutex */
+	return ps_packet_setsize_spec(packet, size, __PS_SPEC_GENERIC | __PS_SPEC_NOCHECK);
+}
+
 int ps_packet_setsize(ps_packet_t *packet, size_t size)
+{
+	return ps_packet_setsize_spec(packet, size, __PS_SPEC_GENERIC);
+}
+
+__PS_HOT int ps_packet_setsize_spec(ps_packet_t *packet, size_t size, const int spec)
 {
 	int ret;
 	size_t res = 0;
-	__PS_PACKET(packet)
+	__PS_PACKET_VARS(packet)
+	__PS_SPEC_PACKET_CHECK(spec, packet)
 
 	if ((!(packet->flags & PS_PACKET_WRITE)) | (packet->flags & PS_PACKET_SIZE_SET))
 		return EINVAL;
@@ -435,7 +846,7 @@ int ps_packet_setsize(ps_packet_t *packet, size_t size)
 	if (size + sizeof(struct ps_packet_header_s) * 2 > state->size)
 		return ENOBUFS;
 
-	if ((ret = ps_packet_reserve(packet, size)))
+	if ((ret = ps_packet_reserve_spec(packet, size, spec)))
 		return ret;
 
 	header->size = size;
@@ -449,17 +860,17 @@ int ps_packet_setsize(ps_packet_t *packet, size_t size)
 	}
 
 	/* we must set next header NULL */
-	if ((ret = ps_packet_reserve(packet, sizeof(struct ps_packet_header_s) + size + res)))
+	if ((ret = ps_packet_reserve_spec(packet, sizeof(struct ps_packet_header_s) + size + res, spec)))
 		return ret;
 	memset(&buffer->buffer[state->write_next], 0, sizeof(struct ps_packet_header_s));
 
 	/* free bytes */
 	state->free_bytes += packet->reserved - (size + sizeof(struct ps_packet_header_s) + res);
 
-	pthread_mutex_unlock(&state->write_mutex);
+	ps_mutex_unlock(&state->write_mutex);
 
 	/* cut fakedma */
-	if ((ret = ps_packet_fakedma_cut(packet, size)))
+	if ((packet->fake_dma) && (ret = ps_packet_fakedma_cut(packet, size)))
 		return ret; /* if this fails... */
 
 	return 0;
@@ -472,9 +883,9 @@ int ps_packet_close(ps_packet_t *packet)
 	packet->flags &= ~PS_PACKET_TRY; /* too late to cancel */
 
 	if (packet->flags & PS_PACKET_READ)
-		return ps_packet_closeread(packet);
+		return ps_packet_closeread_spec(packet, __PS_SPEC_GENERIC);
 	else
-		return ps_packet_closewrite(packet);
+		return ps_packet_closewrite_spec(packet, __PS_SPEC_GENERIC);
 }
 
 int ps_packet_cancel(ps_packet_t *packet)
@@ -488,7 +899,7 @@ int ps_packet_cancel(ps_packet_t *packet)
 
 	state->free_bytes += packet->reserved; /* correct? */
 	memset(header, 0, sizeof(struct ps_packet_header_s));
-	pthread_mutex_unlock(&state->write_mutex);
+	ps_mutex_unlock(&state->write_mutex);
 
 	ps_packet_fakedma_freeall(packet);
 
@@ -499,7 +910,7 @@ int ps_packet_cancel(ps_packet_t *packet)
 }
 
 /* NOTE len is absolute packet size, not added to current reserved */
-int ps_packet_reserve(ps_packet_t *packet, size_t len)
+__PS_HOT int ps_packet_reserve_spec(ps_packet_t *packet, size_t len, const int spec)
 {
 	__PS_PACKET_VARS(packet)
 
@@ -509,19 +920,21 @@ int ps_packet_reserve(ps_packet_t *packet, size_t len)
 	state->free_bytes -= len - packet->reserved;
 	while (state->free_bytes < 0) {
 		/* "consume" next free (=read) packet */
-		if (state->flags & PS_BUFFER_STATS)
+		if (__PS_SPEC_HAS_STATS(spec, state))
 			buffer->write_wait_start = ps_buffer_utime(buffer);
 
 		if (packet->flags & PS_PACKET_TRY) {
-			if (sem_trywait(&state->read_packets)) {
+			if (ps_sem_trywait(&state->read_packets)) {
 				state->free_bytes += len - packet->reserved;
 				return EBUSY;
 			}
-		} else if (sem_wait(&state->read_packets))
+		} else if (ps_sem_wait(&state->read_packets)) {
+			state->free_bytes += len - packet->reserved;
 			return EINVAL;
+		}
 		__PS_CHECK_CANCEL_WRITE(state)
 
-		if (state->flags & PS_BUFFER_STATS)
+		if (__PS_SPEC_HAS_STATS(spec, state))
 			buffer->stats->write_wait_usec += ps_buffer_utime(buffer) - buffer->write_wait_start;
 
 		do {
@@ -533,7 +946,7 @@ int ps_packet_reserve(ps_packet_t *packet, size_t len)
 				state->free_bytes += state->size - state->read_first;
 				state->read_first = 0;
 			}
-		} while (!sem_trywait(&state->read_packets));
+		} while (!ps_sem_trywait(&state->read_packets));
 	}
 
 	packet->reserved = len;
@@ -541,16 +954,16 @@ int ps_packet_reserve(ps_packet_t *packet, size_t len)
 	return 0;
 }
 
-int ps_packet_closeread(ps_packet_t *packet)
+__PS_HOT int ps_packet_closeread_spec(ps_packet_t *packet, const int spec)
 {
 	__PS_PACKET_VARS(packet)
 	int ret;
 	size_t pos;
 
-	if ((ret = pthread_mutex_lock(&state->read_close_mutex)))
+	if ((ret = ps_mutex_lock(&state->read_close_mutex)))
 		return ret;
 
-	if (state->flags & PS_BUFFER_STATS) {
+	if (__PS_SPEC_HAS_STATS(spec, state)) {
 		buffer->stats->read_packets++;
 		buffer->stats->read_bytes += header->size;
 	}
@@ -565,7 +978,7 @@ int ps_packet_closeread(ps_packet_t *packet)
 			if (pos + sizeof(struct ps_packet_header_s) > state->size)
 				pos = 0;
 
-			if (sem_post(&state->read_packets))
+			if (ps_sem_post(&state->read_packets))
 				return EINVAL;
 
 			header = (struct ps_packet_header_s *) &buffer->buffer[pos];
@@ -574,9 +987,10 @@ int ps_packet_closeread(ps_packet_t *packet)
 		state->read_pos = pos;
 	}
 
-	pthread_mutex_unlock(&state->read_close_mutex);
+	ps_mutex_unlock(&state->read_close_mutex);
 
-	ps_packet_fakedma_freeall(packet);
+	if (packet->fake_dma)
+		ps_packet_fakedma_freeall(packet);
 
 	packet->header = NULL;
 	packet->flags = 0;
@@ -584,24 +998,24 @@ int ps_packet_closeread(ps_packet_t *packet)
 	return 0;
 }
 
-int ps_packet_closewrite(ps_packet_t *packet)
+__PS_HOT int ps_packet_closewrite_spec(ps_packet_t *packet, const int spec)
 {
 	__PS_PACKET_VARS(packet)
 	size_t pos;
 	int ret;
 
-	if (!(packet->flags & PS_PACKET_SIZE_SET)) {
-		if ((ret = ps_packet_setsize(packet, header->size)))
+	if (!__PS_SPEC_HAS_SIZE_SET(spec, packet)) {
+		if ((ret = ps_packet_setsize_spec(packet, header->size, spec & ~__PS_SPEC_SIZE_SET)))
 			return ret;
 	}
 
-	if ((ret = ps_packet_fakedma_commitall(packet)))
+	if ((packet->fake_dma) && (ret = ps_packet_fakedma_commitall(packet)))
 		return ret;
 
-	if ((ret = pthread_mutex_lock(&state->write_close_mutex)))
+	if ((ret = ps_mutex_lock(&state->write_close_mutex)))
 		return ret;
 
-	if (state->flags & PS_BUFFER_STATS) {
+	if (__PS_SPEC_HAS_STATS(spec, state)) {
 		buffer->stats->written_packets++;
 		buffer->stats->written_bytes += header->size;
 	}
@@ -615,7 +1029,7 @@ int ps_packet_closewrite(ps_packet_t *packet)
 			if (pos + sizeof(struct ps_packet_header_s) > state->size)
 				pos = 0;
 
-			if (sem_post(&state->written_packets))
+			if (ps_sem_post(&state->written_packets))
 				return EINVAL;
 
 			header = (struct ps_packet_header_s *) &buffer->buffer[pos];
@@ -624,7 +1038,7 @@ int ps_packet_closewrite(ps_packet_t *packet)
 		state->write_pos = pos;
 	}
 
-	pthread_mutex_unlock(&state->write_close_mutex);
+	ps_mutex_unlock(&state->write_close_mutex);
 
 	packet->header = NULL;
 	packet->flags = 0;
@@ -640,9 +1054,15 @@ int ps_packet_getsize(ps_packet_t *packet, size_t *size)
 }
 
 int ps_packet_read(ps_packet_t *packet, void *dest, size_t size)
+{
+	return ps_packet_read_spec(packet, dest, size, __PS_SPEC_GENERIC);
+}
+
+__PS_HOT int ps_packet_read_spec(ps_packet_t *packet, void *dest, size_t size, const int spec)
 {
 	size_t offs, rlen = size;
-	__PS_PACKET(packet)
+	__PS_PACKET_VARS(packet)
+	__PS_SPEC_PACKET_CHECK(spec, packet)
 
 	if (packet->pos + size > header->size)
 		return EINVAL;
@@ -664,19 +1084,25 @@ int ps_packet_read(ps_packet_t *packet, void *dest, size_t size)
 }
 
 int ps_packet_write(ps_packet_t *packet, void *src, size_t size)
+{
+	return ps_packet_write_spec(packet, src, size, __PS_SPEC_GENERIC);
+}
+
+__PS_HOT int ps_packet_write_spec(ps_packet_t *packet, void *src, size_t size, const int spec)
 {
 	int ret;
 	size_t offs, rlen = size;
-	__PS_PACKET(packet)
+	__PS_PACKET_VARS(packet)
+	__PS_SPEC_PACKET_CHECK(spec, packet)
 
-	if (packet->flags & PS_PACKET_SIZE_SET) {
+	if (__PS_SPEC_HAS_SIZE_SET(spec, packet)) {
 		if (packet->pos + size > header->size)
 			return EINVAL;
 	} else {
 		if (packet->pos + size + sizeof(struct ps_packet_header_s) * 2 > state->size)
 			return ENOBUFS;
 
-		if ((ret = ps_packet_reserve(packet, packet->pos + size)))
+		if ((ret = ps_packet_reserve_spec(packet, packet->pos + size, spec)))
 			return ret;
 	}
 
@@ -698,6 +1124,46 @@ int ps_packet_write(ps_packet_t *packet, void *src, size_t size)
 	return 0;
 }
 
+/**
+ * \brief instantiate the specialized entry points for one configuration
+ * \param SUFFIX entry point name suffix
+ * \param SPEC __PS_SPEC_* flags describing the configuration
+ */
+#define __PS_SPEC_ENTRY_POINTS(SUFFIX, SPEC) \
+	int ps_packet_open##SUFFIX(ps_packet_t *packet, ps_flags_t flags) \
+	{ \
+		if (flags & PS_PACKET_READ) \
+			return ps_packet_openread_spec(packet, flags, (SPEC) | __PS_SPEC_NOCHECK); \
+		return ps_packet_openwrite_spec(packet, flags, (SPEC) | __PS_SPEC_NOCHECK); \
+	} \
+	int ps_packet_setsize##SUFFIX(ps_packet_t *packet, size_t size) \
+	{ \
+		return ps_packet_setsize_spec(packet, size, (SPEC) | __PS_SPEC_NOCHECK); \
+	} \
+	int ps_packet_read##SUFFIX(ps_packet_t *packet, void *dest, size_t size) \
+	{ \
+		return ps_packet_read_spec(packet, dest, size, (SPEC) | __PS_SPEC_NOCHECK); \
+	} \
+	int ps_packet_write##SUFFIX(ps_packet_t *packet, void *src, size_t size) \
+	{ \
+		return ps_packet_write_spec(packet, src, size, (SPEC) | __PS_SPEC_NOCHECK); \
+	} \
+	int ps_packet_close##SUFFIX(ps_packet_t *packet) \
+	{ \
+		packet->flags &= ~PS_PACKET_TRY; \
+		if (packet->flags & PS_PACKET_READ) \
+			return ps_packet_closeread_spec(packet, (SPEC) | __PS_SPEC_NOCHECK); \
+		return ps_packet_closewrite_spec(packet, (SPEC) | __PS_SPEC_NOCHECK); \
+	}
+
+__PS_SPEC_ENTRY_POINTS(_nostats, __PS_SPEC_NOSTATS)
+__PS_SPEC_ENTRY_POINTS(_stats, __PS_SPEC_STATS)
+
+int ps_packet_write_sized(ps_packet_t *packet, void *src, size_t size)
+{
+	return ps_packet_write_spec(packet, src, size, __PS_SPEC_SIZE_SET | __PS_SPEC_NOCHECK);
+}
+
 int ps_packet_dma(ps_packet_t *packet, void **mem, size_t size, ps_flags_t flags)
 {
 	int ret;
@@ -716,7 +1182,7 @@ int ps_packet_dma(ps_packet_t *packet, void **mem, size_t size, ps_flags_t flags
 	if (offs + size <= state->size) {
 		/* real stuff */
 		if ((!(packet->flags & PS_PACKET_SIZE_SET)) && (packet->flags & PS_PACKET_WRITE)) {
-			if ((ret = ps_packet_reserve(packet, packet->pos + size)))
+			if ((ret = ps_packet_reserve_spec(packet, packet->pos + size, __PS_SPEC_GENERIC)))
 				return ret;
 		}
 		*mem = &buffer->buffer[offs];
@@ -733,7 +1199,7 @@ int ps_packet_dma(ps_packet_t *packet, void **mem, size_t size, ps_flags_t flags
 
 	/* we can't give real so lets fake it */
 	if ((!(packet->flags & PS_PACKET_SIZE_SET)) && (packet->flags & PS_PACKET_WRITE)) {
-		if ((ret = ps_packet_reserve(packet, packet->pos + size)))
+		if ((ret = ps_packet_reserve_spec(packet, packet->pos + size, __PS_SPEC_GENERIC)))
 			return ret;
 	}
 
@@ -759,6 +1225,87 @@ int ps_packet_dma(ps_packet_t *packet, void **mem, size_t size, ps_flags_t flags
 	return 0;
 }
 
+#ifndef WIN32
+/* at most two segments since packet may wrap around buffer end */
+static int ps_packet_segments(ps_packet_t *packet, struct iovec *iov, int *iovcnt, size_t size)
+{
+	size_t offs;
+	__PS_PACKET(packet)
+
+	if (!(packet->flags & PS_PACKET_READ))
+		return EINVAL;
+
+	if (packet->pos + size > header->size)
+		return EINVAL;
+
+	offs = (packet->buffer_pos + sizeof(struct ps_packet_header_s) + packet->pos) % state->size;
+	iov[0].iov_base = &buffer->buffer[offs];
+	iov[0].iov_len = size;
+	*iovcnt = 1;
+	if (offs + size > state->size) {
+		iov[0].iov_len = state->size - offs;
+		iov[1].iov_base = buffer->buffer;
+		iov[1].iov_len = size - iov[0].iov_len;
+		*iovcnt = 2;
+	}
+
+	return 0;
+}
+
+int ps_packet_iov(ps_packet_t *packet, struct iovec *iov, int *iovcnt, size_t size)
+{
+	int ret;
+
+	if ((ret = ps_packet_segments(packet, iov, iovcnt, size)))
+		return ret;
+
+	packet->pos += size;
+	return 0;
+}
+
+int ps_packet_to_fd(ps_packet_t *packet, int fd, size_t size, off_t *offset, ps_flags_t flags)
+{
+	struct iovec iov[2];
+	int iovcnt;
+	ssize_t ret;
+
+	if ((ret = ps_packet_segments(packet, iov, &iovcnt, size)))
+		return ret;
+
+	while (iovcnt > 0) {
+		if (flags & PS_FD_SPLICE)
+			ret = vmsplice(fd, iov, iovcnt, 0);
+		else if (offset)
+			ret = pwritev(fd, iov, iovcnt, *offset);
+		else
+			ret = writev(fd, iov, iovcnt);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		packet->pos += ret;
+		if ((offset) && !(flags & PS_FD_SPLICE))
+			*offset += ret;
+
+		while ((iovcnt > 0) && ((size_t) ret >= iov[0].iov_len)) {
+			ret -= iov[0].iov_len;
+			iov[0] = iov[1];
+			iovcnt--;
+		}
+
+		if (iovcnt > 0) {
+			iov[0].iov_base = &((unsigned char *) iov[0].iov_base)[ret];
+			iov[0].iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+#endif
+
 int ps_packet_tell(ps_packet_t *packet, size_t *pos)
 {
 	__PS_PACKET_CHECK(packet)
@@ -780,7 +1327,7 @@ int ps_packet_seek(ps_packet_t *packet, size_t pos)
 		if (pos + sizeof(struct ps_packet_header_s) > state->size)
 			return EINVAL;
 
-		if ((ret = ps_packet_reserve(packet, pos)))
+		if ((ret = ps_packet_reserve_spec(packet, pos, __PS_SPEC_GENERIC)))
 			return ret;
 	}
 
@@ -897,17 +1444,103 @@ int ps_buffer_getshmid(ps_buffer_t *buffer, int *shmid)
 	return 0;
 }
 
+int ps_buffer_getfd(ps_buffer_t *buffer, int *fd)
+{
+	__PS_BUFFER_CHECK(buffer)
+	*fd = buffer->fd;
+	return 0;
+}
+
+int ps_buffer_pending(ps_buffer_t *buffer, int *count)
+{
+	__PS_BUFFER(buffer)
+	return ps_sem_getvalue(&state->written_packets, count);
+}
+
+int ps_buffer_wait_any(ps_buffer_t **buffers, int count, uint32_t *kick, uint32_t kick_val, int timeout_ms)
+{
+	struct futex_waitv waitv[PS_WAIT_ANY_MAX + 1];
+	struct ps_state_s *state;
+	struct timespec ts;
+	int i, n = 0, ready = 0, ret = 0;
+
+	if ((count < 0) | (count > PS_WAIT_ANY_MAX))
+		return EINVAL;
+
+	/* register as waiter first so ps_sem_post() won't skip the wake */
+	for (i = 0; i < count; i++) {
+		state = (struct ps_state_s *) buffers[i]->state;
+		__atomic_add_fetch(&state->written_packets.waiters, 1, __ATOMIC_SEQ_CST);
+		if ((__atomic_load_n(&state->written_packets.value, __ATOMIC_SEQ_CST)) |
+		    (state->flags & PS_BUFFER_CANCELLED))
+			ready = 1;
+
+		waitv[n].val = 0;
+		waitv[n].uaddr = (uintptr_t) &state->written_packets.value;
+		waitv[n].flags = FUTEX_32 | state->written_packets.op_flags;
+		waitv[n].__reserved = 0;
+		n++;
+	}
+
+	if (kick) {
+		if (__atomic_load_n(kick, __ATOMIC_SEQ_CST) != kick_val)
+			ready = 1;
+
+		waitv[n].val = kick_val;
+		waitv[n].uaddr = (uintptr_t) kick;
+		waitv[n].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+		waitv[n].__reserved = 0;
+		n++;
+	}
+
+	if (!ready) {
+		if (timeout_ms >= 0) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			ts.tv_sec += timeout_ms / 1000;
+			ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+		}
+
+		i = syscall(SYS_futex_waitv, waitv, n, 0, timeout_ms >= 0 ? &ts : NULL, CLOCK_MONOTONIC);
+		if (i < 0) {
+			ret = errno;
+			if (ret == EAGAIN) /* changed before we slept */
+				ret = 0;
+			else if (ret == ENOSYS) {
+				/* pre 5.16 kernel, degrade to polling */
+				usleep(1000);
+				ret = 0;
+			}
+		} else if (i < count) {
+			/* we may have eaten a wake meant for a ps_sem_wait() sleeper */
+			state = (struct ps_state_s *) buffers[i]->state;
+			if (__atomic_load_n(&state->written_packets.waiters, __ATOMIC_SEQ_CST) > 1)
+				ps_futex(&state->written_packets.value, FUTEX_WAKE | state->written_packets.op_flags, 1);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		state = (struct ps_state_s *) buffers[i]->state;
+		__atomic_sub_fetch(&state->written_packets.waiters, 1, __ATOMIC_SEQ_CST);
+	}
+
+	return ret;
+}
+
 int ps_buffer_cancel(ps_buffer_t *buffer)
 {
 	__PS_BUFFER(buffer)
 
 	state->flags |= PS_BUFFER_CANCELLED;
 
-	sem_post(&state->read_packets);
-	sem_post(&state->written_packets);
+	ps_sem_post(&state->read_packets);
+	ps_sem_post(&state->written_packets);
 
-	pthread_mutex_unlock(&state->read_mutex);
-	pthread_mutex_unlock(&state->write_mutex);
+	ps_mutex_unlock(&state->read_mutex);
+	ps_mutex_unlock(&state->write_mutex);
 
 	return 0;
 }
@@ -952,6 +1585,7 @@ int ps_bufferattr_init(ps_bufferattr_t *attr)
 	attr->flags = 0;
 	attr->shmmode = 0600;
 	attr->key = IPC_PRIVATE;
+	attr->fd = -1;
 
 	return 0;
 }
@@ -992,6 +1626,9 @@ int ps_bufferattr_setflags(ps_bufferattr_t *attr, ps_flags_t flags)
 		return ENOTSUP;
 #endif
 
+	if ((flags & PS_SHM_MEMFD) && !(flags & PS_BUFFER_PSHARED))
+		return EINVAL;
+
 #ifndef __PS_STATS
 	if (flags & PS_BUFFFER_STATS)
 		return ENOTSUP;
@@ -1044,8 +1681,22 @@ int ps_bufferattr_setshmkey(ps_bufferattr_t *attr, key_t key)
 #endif
 }
 
+int ps_bufferattr_setfd(ps_bufferattr_t *attr, int fd)
+{
+#ifdef __PS_SHM
+	if (attr == NULL)
+		return EINVAL;
+
+	attr->fd = fd;
+
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
 
-unsigned long ps_buffer_utime(ps_buffer_t *buffer)
+uint64_t ps_buffer_utime(ps_buffer_t *buffer)
 {
 #ifdef __PS_STATS
 	__PS_BUFFER_VARS(buffer)
@@ -1053,22 +1704,14 @@ unsigned long ps_buffer_utime(ps_buffer_t *buffer)
 
 	gettimeofday(&tv, NULL);
 
-	tv.tv_sec -= state->create_time.tv_sec;
-	tv.tv_usec -= state->create_time.tv_usec;
-
-	if (tv.tv_usec < 0) {
-		tv.tv_sec--;
-		tv.tv_usec += 1000000;
-	}
-
-	return (unsigned long) tv.tv_sec * 1000000 + (unsigned long) tv.tv_usec;
+	return (uint64_t) tv.tv_sec * 1000000 + (uint64_t) tv.tv_usec - state->create_time;
 #else
 	return 0;
 #endif
 }
 
 
-void ps_stats_text_hbytes(size_t bytes, FILE *stream)
+void ps_stats_text_hbytes(uint64_t bytes, FILE *stream)
 {
 	if (bytes >= 1024 * 1024 * 1024)
 		fprintf(stream, "%.2f GiB\n", (float) bytes / (float) (1024 * 1024 * 1024));
@@ -1092,7 +1735,7 @@ void ps_stats_text_hfloat(float val, FILE *stream)
 		fprintf(stream, "%.2f\n", val);
 }
 
-void ps_stats_text_hnum(size_t num, FILE *stream)
+void ps_stats_text_hnum(uint64_t num, FILE *stream)
 {
 	if (num >= 1000000000)
 		fprintf(stream, "%.2f G\n", (float) num / 1000000000.0f);
@@ -1118,13 +1761,13 @@ int ps_stats_text(ps_stats_t *stats, FILE *stream)
 		fprintf(stream, "   packets   : ");
 		ps_stats_text_hfloat((float) stats->written_packets / secs, stream);
 		fprintf(stream, "   bytes     : ");
-		ps_stats_text_hbytes(stats->written_bytes / (size_t) (secs + 0.5f), stream);
+		ps_stats_text_hbytes(stats->written_bytes / (uint64_t) (secs + 0.5f), stream);
 		fprintf(stream, "   %% waited  : %.2f %%\n", 100.0f * ((float) stats->write_wait_usec / (float) stats->utime));
 		fprintf(stream, "  read\n");
 		fprintf(stream, "   packets   : "); 
 		ps_stats_text_hfloat((float) stats->read_packets / secs, stream);
 		fprintf(stream, "   bytes     : "); 
-		ps_stats_text_hbytes(stats->read_bytes / (size_t) (secs + 0.5f), stream);
+		ps_stats_text_hbytes(stats->read_bytes / (uint64_t) (secs + 0.5f), stream);
 		fprintf(stream, "   %% waited  : %.2f %%\n", 100.0f * ((float) stats->read_wait_usec / (float) stats->utime));
 	}
 
@@ -44,12 +44,15 @@
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 #ifdef WIN32
 # define IPC_PRIVATE 0
 #else
 # include <sys/ipc.h>
+# include <sys/uio.h>
 # define __PS_SHM
 # define __PS_STATS
 #endif
@@ -97,10 +100,26 @@ extern "C" {
  *  try to open multiple packets.
  */
 
+/**
+ *  \defgroup sync synchronization
+ *  Buffer state is shared between 32bit and 64bit processes, so locks and
+ *  semaphores are implemented on top of futexes with a fixed layout instead
+ *  of using pthread_mutex_t and sem_t.
+ */
+
 /**
  *  \defgroup stats statistics
  */
 
+/**
+ *  \defgroup spec specialized entry points
+ *  Packet calls specialized for a buffer configuration known at compile time.
+ *  Flag tests for that configuration are resolved by the compiler and the
+ *  generic argument checks are skipped, so the caller must guarantee that the
+ *  buffer was created with matching flags and the packet is valid. Shared and
+ *  private buffers take identical packet paths, only statistics matter here.
+ */
+
 /**
  * \addtogroup buffer
  *  \{
@@ -129,10 +148,15 @@ extern "C" {
 #define PS_PACKET_SIZE_SET       4
 /** fail if can't proceed immediately */
 #define PS_PACKET_TRY            8
+/** prefetch packet data when opening in read mode */
+#define PS_PACKET_PREFETCH      16
 
 /** accept fake dma */
 #define PS_ACCEPT_FAKE_DMA       1
 
+/** move data with vmsplice(), fd must be a pipe */
+#define PS_FD_SPLICE             1
+
 /**  \} */
 
 /**
@@ -143,10 +167,15 @@ extern "C" {
 /** default buffer size */
 #define PS_DEFAULT_SIZE    1048576
 
+/** maximum number of buffers ps_buffer_wait_any() can wait on */
+#define PS_WAIT_ANY_MAX    127
+
 /** create shm if key does not exist or key is IPC_PRIVATE */
 #define PS_SHM_CREATE    IPC_CREAT
 /** if PS_SHM_CREATE is active, creating new shm fails  */
 #define PS_SHM_EXCL      IPC_EXCL
+/** buffer lives in a sealed memfd instead of SysV shm, see ps_bufferattr_setfd() */
+#define PS_SHM_MEMFD     0x100000
 
 /**  \} */
 
@@ -155,22 +184,24 @@ typedef int ps_flags_t;
 /**
  * \ingroup stats
  * \brief buffer statistics
+ * \note stats of a shared buffer live in shared memory, so all
+ *       members have fixed width and alignment
  */
 typedef struct {
 	/** number of packets read */
-	size_t read_packets;
+	uint64_t read_packets __attribute__ ((aligned (8)));
 	/** number of packets written */
-	size_t written_packets;
+	uint64_t written_packets __attribute__ ((aligned (8)));
 	/** amount of data read */
-	size_t read_bytes;
+	uint64_t read_bytes __attribute__ ((aligned (8)));
 	/** amount of data written */
-	size_t written_bytes;
+	uint64_t written_bytes __attribute__ ((aligned (8)));
 	/** time in microseconds consumer has waited for ready item */
-	unsigned long read_wait_usec;
+	uint64_t read_wait_usec __attribute__ ((aligned (8)));
 	/** time in microseconds producer has waited for free space */
-	unsigned long write_wait_usec;
+	uint64_t write_wait_usec __attribute__ ((aligned (8)));
 	/** time in microseconds since buffer was created */
-	unsigned long utime;
+	uint64_t utime __attribute__ ((aligned (8)));
 } ps_stats_t;
 
 /**
@@ -188,6 +219,8 @@ typedef struct {
 	int shmmode;
 	/** shared memory key */
 	key_t key;
+	/** memfd to attach or -1 to create one */
+	int fd;
 } ps_bufferattr_t;
 
 /**
@@ -203,10 +236,12 @@ typedef struct {
 	ps_stats_t *stats;
 	/** shared memory id */
 	int shmid;
+	/** memfd of a PS_SHM_MEMFD buffer, -1 otherwise */
+	int fd;
 	/** time in microseconds when consumer entered waiting mode last time */
-	unsigned long read_wait_start;
+	uint64_t read_wait_start;
 	/** time in microseconds when producer entered waiting mode last time */
-	unsigned long write_wait_start;
+	uint64_t write_wait_start;
 } ps_buffer_t;
 
 /**
@@ -282,6 +317,18 @@ int ps_bufferattr_setshmmode(ps_bufferattr_t *attr, int mode);
  * \return 0 on success or EINVAL if attr is NULL or mode is not valid
  */
 int ps_bufferattr_setshmkey(ps_bufferattr_t *attr, key_t key);
+/**
+ * \brief set the memfd of a PS_SHM_MEMFD buffer
+ *
+ * Without a memfd ps_buffer_init() creates one, sealed so that it can not
+ * be resized, which can be passed to other processes. A memfd received
+ * from another process is only attached if it is sealed against
+ * shrinking, otherwise the peer could make accesses fault.
+ * \param attr buffer attribute object
+ * \param fd memfd, ps_buffer_init() takes it over on success
+ * \return 0 on success or EINVAL if attr is NULL
+ */
+int ps_bufferattr_setfd(ps_bufferattr_t *attr, int fd);
 
 /**  \} */
 
@@ -303,6 +350,39 @@ int ps_buffer_init(ps_buffer_t *buffer, ps_bufferattr_t *attr);
  * \return 0 on success otherwise an error code
  */
 int ps_buffer_destroy(ps_buffer_t *buffer);
+/**
+ * \brief detach from buffer
+ *
+ * Unlike ps_buffer_destroy() this only unmaps a shared buffer from the
+ * calling process and leaves the shared memory segment alive for its
+ * other users. Private buffers are destroyed.
+ * \param buffer buffer to detach from
+ * \return 0 on success otherwise an error code
+ */
+int ps_buffer_detach(ps_buffer_t *buffer);
+/**
+ * \brief mark a shared buffer for removal
+ *
+ * The shared memory segment is freed by the kernel as soon as the last
+ * process detaches from it, also if that process crashes. Processes which
+ * are attached keep using the buffer and can still attach by shmid, but
+ * not by key anymore. Does nothing for private buffers.
+ * \param buffer buffer to unlink
+ * \return 0 on success otherwise an error code
+ */
+int ps_buffer_unlink(ps_buffer_t *buffer);
+/**
+ * \brief return a buffer to its freshly created state
+ *
+ * Drops all packets and reinitializes locks, semaphores and stats, so
+ * the buffer can be handed to a new producer after the old one is gone,
+ * even if it died while holding a lock or cancelled the buffer. Data
+ * area is not cleared.
+ * \note nobody else may use the buffer during the call
+ * \param buffer buffer to reset
+ * \return 0 on success otherwise an error code
+ */
+int ps_buffer_reset(ps_buffer_t *buffer);
 /**
  * \brief cancel buffer
  *
@@ -334,6 +414,44 @@ int ps_buffer_stats(ps_buffer_t *buffer, ps_stats_t *stats);
  * \return 0 on success otherwise an error code
  */
 int ps_buffer_getshmid(ps_buffer_t *buffer, int *shmid);
+/**
+ * \brief get buffer memfd
+ *
+ * Returns the memfd of a PS_SHM_MEMFD buffer, which stays owned by the
+ * buffer. This is thread-safe function.
+ * \param buffer buffer
+ * \param fd returned memfd or -1
+ * \return 0 on success otherwise an error code
+ */
+int ps_buffer_getfd(ps_buffer_t *buffer, int *fd);
+/**
+ * \brief get number of packets ready for reading
+ *
+ * Returns the number of written packets that have not been opened for
+ * reading yet. The value may be outdated when this returns. This is
+ * thread-safe function.
+ * \param buffer buffer
+ * \param count returned number of packets
+ * \return 0 on success otherwise an error code
+ */
+int ps_buffer_pending(ps_buffer_t *buffer, int *count);
+/**
+ * \brief wait until any of the given buffers has packets to read
+ *
+ * Sleeps until at least one buffer has a written packet which is not
+ * opened yet, a buffer gets cancelled, *kick no longer equals kick_val
+ * or the timeout expires. kick is a process-private word which another
+ * thread can change and FUTEX_WAKE to interrupt the wait. Spurious
+ * returns are possible, so callers should check ps_buffer_pending()
+ * afterwards. This is thread-safe function.
+ * \param buffers array of buffers
+ * \param count number of buffers, at most PS_WAIT_ANY_MAX
+ * \param kick address of kick word or NULL
+ * \param kick_val expected value of *kick
+ * \param timeout_ms timeout in milliseconds or -1 to wait forever
+ * \return 0 on wakeup, ETIMEDOUT, EINTR or an error code
+ */
+int ps_buffer_wait_any(ps_buffer_t **buffers, int count, uint32_t *kick, uint32_t kick_val, int timeout_ms);
 
 /**  \} */
 
@@ -363,11 +481,31 @@ int ps_packet_destroy(ps_packet_t *packet);
  * PS_PACKET_WRITE opens packet in write mode and PS_PACKET_READ in
  * read mode. If PS_PACKET_TRY is specified, all calls return EBUSY
  * instead of blocking if waiting for other threads is necessary.
+ *
+ * PS_PACKET_PREFETCH in read mode prefetches the first cache lines of
+ * the opened packet, the next packet header and, if the next packet is
+ * already written, its first cache lines too. Packets of a megabyte or
+ * more are additionally madvise()'d with MADV_WILLNEED.
  * \param packet packet
  * \param flags PS_PACKET_WRITE or PS_PACKET_READ, possibly PS_PACKET_TRY
+ *        or PS_PACKET_PREFETCH
  * \return 0 on success otherwise an error code
  */
 int ps_packet_open(ps_packet_t *packet, ps_flags_t flags);
+/**
+ * \brief open packet in write mode with a constant size
+ *
+ * Equivalent to ps_packet_open() with PS_PACKET_WRITE followed by
+ * ps_packet_setsize(), but the packet is cancelled if the size can't
+ * be reserved. Buffer space for the whole packet is reserved before
+ * this returns and the buffer write lock is already released, so other
+ * producers can open packets while this one is being filled.
+ * \param packet packet
+ * \param flags PS_PACKET_WRITE, possibly PS_PACKET_TRY
+ * \param size constant size for packet
+ * \return 0 on success otherwise an error code
+ */
+int ps_packet_open_sized(ps_packet_t *packet, ps_flags_t flags, size_t size);
 /**
  * \brief close packet
  * \param packet packet to close
@@ -463,6 +601,104 @@ int ps_packet_write(ps_packet_t *packet, void *src, size_t size);
  * \return 0 on success otherwise an error code
  */
 int ps_packet_dma(ps_packet_t *packet, void **mem, size_t size, ps_flags_t flags);
+/**
+ * \brief move data from packet directly to a file descriptor
+ *
+ * Writes size bytes starting at current read position straight from
+ * buffer data area to fd and moves current position by size bytes.
+ * No intermediate copy is made in user space. Partial writes are
+ * retried until all data is written or an error occurs.
+ *
+ * By default writev() is used, or pwritev() at *offset if offset is
+ * not NULL, in which case *offset is advanced. With PS_FD_SPLICE the
+ * pages are spliced into pipe fd with vmsplice(). The pipe then only
+ * references the buffer, so its contents must be consumed (e.g. with
+ * splice() to a file) before the packet is closed.
+ * \param packet packet open in read mode
+ * \param fd destination file descriptor
+ * \param size bytes to move
+ * \param offset file offset for pwritev() or NULL
+ * \param flags 0 or PS_FD_SPLICE
+ * \return 0 on success otherwise an error code
+ */
+int ps_packet_to_fd(ps_packet_t *packet, int fd, size_t size, off_t *offset, ps_flags_t flags);
+/**
+ * \brief access packet data in place as memory segments
+ *
+ * Returns size bytes starting at current read position as one segment,
+ * or two if the data wraps around the end of the buffer, and moves
+ * current position by size bytes. Unlike ps_packet_dma() nothing is
+ * copied in either case. Segments point into the buffer data area and
+ * are valid until the packet is closed.
+ * \param packet packet open in read mode
+ * \param iov returned segments, must have room for two
+ * \param iovcnt returned number of segments
+ * \param size bytes to access
+ * \return 0 on success otherwise an error code
+ */
+int ps_packet_iov(ps_packet_t *packet, struct iovec *iov, int *iovcnt, size_t size);
+
+/**  \} */
+
+/**
+ * \addtogroup spec
+ *  \{
+ */
+
+/**
+ * \brief ps_packet_open() for a buffer without PS_BUFFER_STATS
+ */
+int ps_packet_open_nostats(ps_packet_t *packet, ps_flags_t flags);
+/**
+ * \brief ps_packet_setsize() for a buffer without PS_BUFFER_STATS
+ */
+int ps_packet_setsize_nostats(ps_packet_t *packet, size_t size);
+/**
+ * \brief ps_packet_read() for a buffer without PS_BUFFER_STATS
+ */
+int ps_packet_read_nostats(ps_packet_t *packet, void *dest, size_t size);
+/**
+ * \brief ps_packet_write() for a buffer without PS_BUFFER_STATS
+ */
+int ps_packet_write_nostats(ps_packet_t *packet, void *src, size_t size);
+/**
+ * \brief ps_packet_close() for a buffer without PS_BUFFER_STATS
+ */
+int ps_packet_close_nostats(ps_packet_t *packet);
+
+/**
+ * \brief ps_packet_open() for a buffer with PS_BUFFER_STATS
+ */
+int ps_packet_open_stats(ps_packet_t *packet, ps_flags_t flags);
+/**
+ * \brief ps_packet_setsize() for a buffer with PS_BUFFER_STATS
+ */
+int ps_packet_setsize_stats(ps_packet_t *packet, size_t size);
+/**
+ * \brief ps_packet_read() for a buffer with PS_BUFFER_STATS
+ */
+int ps_packet_read_stats(ps_packet_t *packet, void *dest, size_t size);
+/**
+ * \brief ps_packet_write() for a buffer with PS_BUFFER_STATS
+ */
+int ps_packet_write_stats(ps_packet_t *packet, void *src, size_t size);
+/**
+ * \brief ps_packet_close() for a buffer with PS_BUFFER_STATS
+ */
+int ps_packet_close_stats(ps_packet_t *packet);
+
+/**
+ * \brief write data to packet which has constant size set
+ *
+ * Same as ps_packet_write() but the packet must be open in write
+ * mode and ps_packet_setsize() must have succeeded. No space is
+ * reserved, so this never blocks and works for any buffer flags.
+ * \param packet packet
+ * \param src source memory area
+ * \param size bytes to write
+ * \return 0 on success or EINVAL if write exceeds packet size
+ */
+int ps_packet_write_sized(ps_packet_t *packet, void *src, size_t size);
 
 /**  \} */
 
@@ -0,0 +1,642 @@
+/**
+ * \file src/glc2/export.c
+ * \brief stream export
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup glc2_export
+ *  \{
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "export.h"
+#include "reader.h"
+#include "pool.h"
+#include "color.h"
+#include "convert.h"
+#include "delta.h"
+
+/** slots per worker */
+#define GLC_EXPORT_WINDOW 4
+/** pipe buffer asked for when writing to a pipe */
+#define GLC_EXPORT_PIPE_SIZE (1024 * 1024)
+
+#define GLC_EXPORT_WAVE_FORMAT_PCM 0x1
+
+struct glc_export_s;
+
+/** message in flight */
+struct glc_export_slot_s {
+    struct glc_export_s *export;
+    glc_reader_msg msg;
+    /** set by the decompression job */
+    int done;
+    int err;
+};
+
+struct glc_export_wav_header_s {
+    char riff[4];
+    u_int32_t riff_size;
+    char wave[4];
+    char fmt[4];
+    u_int32_t fmt_size;
+    u_int16_t format;
+    u_int16_t channels;
+    u_int32_t rate;
+    u_int32_t byte_rate;
+    u_int16_t block_align;
+    u_int16_t bits;
+    char data[4];
+    u_int32_t data_size;
+} __attribute__((packed));
+
+struct glc_export_s {
+    glc_export_options *options;
+    glc_reader *reader;
+    glc_pool *pool;
+    glc_color *color;
+    glc_convert *convert;
+
+    /** protects done and err of the slots */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    /** ring of slots, count of them in flight starting at head */
+    struct glc_export_slot_s *slots;
+    unsigned int window, head, count;
+
+    int video_fd;
+    glc_stream_id_t video_id;
+    glc_video_format_message_t format;
+    /** last full frame with its header, deltas are applied to it */
+    unsigned char *packed;
+    size_t packed_size, packed_alloc;
+    /** size of the y4m frames, 0 until the header is written */
+    unsigned int width, height;
+    /** last converted frame, shown until a newer one is due */
+    unsigned char *frame;
+    size_t frame_size;
+    int have_frame;
+    double fps;
+    /** time of the first frame and frames written since */
+    glc_utime_t start;
+    u_int64_t frames;
+
+    int audio_fd;
+    glc_stream_id_t audio_id;
+    glc_audio_format_message_t audio_format;
+    int have_audio_format;
+    unsigned int sample_size;
+    u_int64_t audio_size;
+    unsigned char *interleaved;
+    size_t interleaved_size;
+};
+
+static int glc_export_wanted(struct glc_export_s *export, glc_message_type_t type);
+static void glc_export_decompress(void *arg);
+static int glc_export_retire(struct glc_export_s *export);
+static int glc_export_message(struct glc_export_s *export, glc_reader_msg *msg);
+static int glc_export_video(struct glc_export_s *export, glc_message_type_t type, const void *data, size_t size);
+static int glc_export_color_output(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata);
+static int glc_export_convert_output(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata);
+static int glc_export_y4m_header(struct glc_export_s *export, const glc_video_format_message_t *format);
+static int glc_export_video_time(struct glc_export_s *export, glc_utime_t time);
+static int glc_export_audio_format(struct glc_export_s *export, glc_reader_msg *msg);
+static int glc_export_audio_data(struct glc_export_s *export, glc_reader_msg *msg);
+static int glc_export_finish(struct glc_export_s *export);
+static void glc_export_gather(const struct iovec *iov, int count, size_t skip, void *dst, size_t size);
+static int glc_export_open(const char *path, int *fd);
+static int glc_export_write(int fd, struct iovec *iov, int count);
+
+int glc_export(const char *path, glc_export_options *options) {
+    struct glc_export_s export;
+    struct glc_export_slot_s *slot;
+    unsigned int i;
+    int err, eof = 0;
+
+    if(!options->video && !options->audio)
+        return EINVAL;
+    if(options->video && options->audio && !strcmp(options->video, "-") && !strcmp(options->audio, "-"))
+        return EINVAL;
+
+    memset(&export, 0, sizeof(export));
+    export.options = options;
+    export.video_fd = export.audio_fd = -1;
+    export.video_id = options->video_id;
+    export.audio_id = options->audio_id;
+    pthread_mutex_init(&export.mutex, NULL);
+    pthread_cond_init(&export.cond, NULL);
+
+    if((err = glc_reader_open(&export.reader, path, 0)))
+        goto finish;
+
+    /* also rejects NaN */
+    export.fps = options->fps > 0 ? options->fps : glc_reader_info(export.reader, NULL, NULL)->fps;
+    if(options->video && !(export.fps >= 0.001 && export.fps <= 1000000)) {
+        err = EINVAL;
+        goto finish;
+    }
+
+    if((err = glc_pool_create(&export.pool, options->threads)) ||
+       (err = glc_color_create(&export.color, export.pool, glc_export_color_output, &export)) ||
+       (err = glc_convert_create(&export.convert, export.pool, NULL, glc_export_convert_output, &export)))
+        goto finish;
+
+    export.window = options->window ? options->window
+                                    : GLC_EXPORT_WINDOW * (unsigned int) glc_pool_threads(export.pool);
+    if(!(export.slots = calloc(export.window, sizeof(*export.slots)))) {
+        err = ENOMEM;
+        goto finish;
+    }
+    for(i = 0; i < export.window; i++)
+        export.slots[i].export = &export;
+
+    if((options->video && (err = glc_export_open(options->video, &export.video_fd))) ||
+       (options->audio && (err = glc_export_open(options->audio, &export.audio_fd))))
+        goto finish;
+
+    while(!err) {
+        /* the oldest message goes first, so the window moves on */
+        if(export.count == export.window || (eof && export.count)) {
+            err = glc_export_retire(&export);
+            continue;
+        }
+        if(eof)
+            break;
+
+        slot = &export.slots[(export.head + export.count) % export.window];
+        if((err = glc_reader_next(export.reader, &slot->msg))) {
+            if(err == ENODATA) {
+                eof = 1;
+                err = 0;
+            }
+            continue;
+        }
+
+        if(!glc_export_wanted(&export, slot->msg.header.type))
+            continue;
+
+        /* the stream of a compressed message is only known once it is decompressed */
+        slot->done = slot->msg.data != NULL;
+        slot->err = 0;
+        if(!slot->done && (err = glc_pool_submit(export.pool, glc_export_decompress, slot)))
+            break;
+        export.count++;
+    }
+
+    if(!err)
+        err = glc_export_finish(&export);
+
+finish:
+    /* jobs still in flight after an error use the slots */
+    if(export.pool)
+        glc_pool_wait(export.pool);
+    if(export.convert)
+        glc_convert_destroy(export.convert);
+    if(export.color)
+        glc_color_destroy(export.color);
+    if(export.pool)
+        glc_pool_destroy(export.pool);
+
+    if(export.slots) {
+        for(i = 0; i < export.window; i++)
+            glc_reader_msg_free(&export.slots[i].msg);
+        free(export.slots);
+    }
+    if(export.reader)
+        glc_reader_close(export.reader);
+
+    if(export.video_fd != -1 && export.video_fd != STDOUT_FILENO)
+        close(export.video_fd);
+    if(export.audio_fd != -1 && export.audio_fd != STDOUT_FILENO)
+        close(export.audio_fd);
+
+    free(export.packed);
+    free(export.frame);
+    free(export.interleaved);
+    pthread_cond_destroy(&export.cond);
+    pthread_mutex_destroy(&export.mutex);
+    return err;
+}
+
+static int glc_export_wanted(struct glc_export_s *export, glc_message_type_t type) {
+    switch(type) {
+    case GLC_MESSAGE_VIDEO_FORMAT:
+    case GLC_MESSAGE_VIDEO_FRAME:
+    case GLC_MESSAGE_VIDEO_DELTA:
+    case GLC_MESSAGE_VIDEO_REPEAT:
+    case GLC_MESSAGE_COLOR:
+        return export->video_fd != -1;
+    case GLC_MESSAGE_AUDIO_FORMAT:
+    case GLC_MESSAGE_AUDIO_DATA:
+        return export->audio_fd != -1;
+    }
+    return 0;
+}
+
+static void glc_export_decompress(void *arg) {
+    struct glc_export_slot_s *slot = arg;
+    struct glc_export_s *export = slot->export;
+    int err = glc_reader_msg_data(&slot->msg);
+
+    pthread_mutex_lock(&export->mutex);
+    slot->err = err;
+    slot->done = 1;
+    pthread_cond_signal(&export->cond);
+    pthread_mutex_unlock(&export->mutex);
+}
+
+static int glc_export_retire(struct glc_export_s *export) {
+    struct glc_export_slot_s *slot = &export->slots[export->head];
+
+    pthread_mutex_lock(&export->mutex);
+    while(!slot->done)
+        pthread_cond_wait(&export->cond, &export->mutex);
+    pthread_mutex_unlock(&export->mutex);
+
+    export->head = (export->head + 1) % export->window;
+    export->count--;
+
+    if(slot->err)
+        return slot->err;
+    return glc_export_message(export, &slot->msg);
+}
+
+static int glc_export_message(struct glc_export_s *export, glc_reader_msg *msg) {
+    const glc_video_format_message_t *format;
+    glc_video_repeat_message_t repeat;
+    glc_video_delta_header_t delta;
+    glc_video_frame_header_t frame;
+    glc_stream_id_t id;
+    unsigned int bpp;
+    size_t stride;
+    int err;
+
+    /* every wanted message starts with its stream id */
+    if(msg->size < sizeof(id))
+        return EINVAL;
+    memcpy(&id, msg->data, sizeof(id));
+
+    if(msg->header.type == GLC_MESSAGE_AUDIO_FORMAT)
+        return glc_export_audio_format(export, msg);
+    if(msg->header.type == GLC_MESSAGE_AUDIO_DATA)
+        return glc_export_audio_data(export, msg);
+
+    if(msg->header.type == GLC_MESSAGE_VIDEO_FORMAT && !export->video_id)
+        export->video_id = id;
+    if(id != export->video_id)
+        return 0;
+
+    switch(msg->header.type) {
+    case GLC_MESSAGE_VIDEO_FORMAT:
+        if((err = glc_reader_video_format(msg, &format)))
+            return err;
+        export->format = *format;
+        /* deltas do not cross format changes */
+        export->packed_size = 0;
+        return glc_export_video(export, GLC_MESSAGE_VIDEO_FORMAT, msg->data, msg->size);
+    case GLC_MESSAGE_COLOR:
+        return glc_export_video(export, GLC_MESSAGE_COLOR, msg->data, msg->size);
+    case GLC_MESSAGE_VIDEO_FRAME:
+        /* keep it for the deltas which may follow */
+        if(msg->size > export->packed_alloc) {
+            unsigned char *packed = realloc(export->packed, msg->size);
+            if(!packed)
+                return ENOMEM;
+            export->packed = packed;
+            export->packed_alloc = msg->size;
+        }
+        memcpy(export->packed, msg->data, msg->size);
+        export->packed_size = msg->size;
+        return glc_export_video(export, GLC_MESSAGE_VIDEO_FRAME, export->packed, export->packed_size);
+    case GLC_MESSAGE_VIDEO_DELTA:
+        if(msg->size < sizeof(delta))
+            return EINVAL;
+        memcpy(&delta, msg->data, sizeof(delta));
+
+        /* a file which starts with a delta, e.g. a damaged one, starts at the next frame */
+        if(!export->packed_size)
+            return 0;
+        if(glc_delta_geometry(&export->format, &bpp, &stride) ||
+           export->packed_size != sizeof(frame) + stride * export->format.height)
+            return EINVAL;
+        if((err = glc_delta_apply(&export->packed[sizeof(frame)], &export->format, msg->data, msg->size)))
+            return err;
+
+        frame.id = delta.id;
+        frame.time = delta.time;
+        memcpy(export->packed, &frame, sizeof(frame));
+        return glc_export_video(export, GLC_MESSAGE_VIDEO_FRAME, export->packed, export->packed_size);
+    case GLC_MESSAGE_VIDEO_REPEAT:
+        if(msg->size < sizeof(repeat))
+            return EINVAL;
+        memcpy(&repeat, msg->data, sizeof(repeat));
+        return glc_export_video_time(export, repeat.time);
+    }
+
+    return 0;
+}
+
+/* frames go through the colour correction and the conversion to the y4m writer */
+static int glc_export_video(struct glc_export_s *export, glc_message_type_t type, const void *data, size_t size) {
+    glc_message_header_t hdr;
+    struct iovec iov;
+
+    hdr.type = type;
+    iov.iov_base = (void *) data;
+    iov.iov_len = size;
+    return glc_color_submit(export->color, &hdr, &iov, 1);
+}
+
+static int glc_export_color_output(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata) {
+    struct glc_export_s *export = udata;
+    return glc_convert_submit(export->convert, hdr, iov, count);
+}
+
+static int glc_export_convert_output(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata) {
+    struct glc_export_s *export = udata;
+    glc_video_format_message_t format;
+    glc_video_frame_header_t frame;
+    size_t size = 0;
+    int err, i;
+
+    for(i = 0; i < count; i++)
+        size += iov[i].iov_len;
+
+    if(hdr->type == GLC_MESSAGE_VIDEO_FORMAT) {
+        if(size < sizeof(format))
+            return EINVAL;
+        glc_export_gather(iov, count, 0, &format, sizeof(format));
+        return glc_export_y4m_header(export, &format);
+    }
+
+    /* color messages the stage could not apply are of no use to y4m */
+    if(hdr->type != GLC_MESSAGE_VIDEO_FRAME || !export->width)
+        return 0;
+    if(size != sizeof(frame) + export->frame_size)
+        return EINVAL;
+    glc_export_gather(iov, count, 0, &frame, sizeof(frame));
+
+    if(!export->have_frame) {
+        export->start = frame.time;
+        export->have_frame = 1;
+    } else if((err = glc_export_video_time(export, frame.time))) {
+        return err;
+    }
+
+    glc_export_gather(iov, count, sizeof(frame), export->frame, export->frame_size);
+    return 0;
+}
+
+static int glc_export_y4m_header(struct glc_export_s *export, const glc_video_format_message_t *format) {
+    unsigned int num, den = 1000, a, b, t;
+    char header[128];
+    struct iovec iov;
+
+    if(format->format != GLC_VIDEO_YCBCR_420JPEG)
+        return ENOTSUP;
+
+    /* y4m frames all have the same size */
+    if(export->width)
+        return format->width == export->width && format->height == export->height ? 0 : ENOTSUP;
+    if(!format->width || !format->height)
+        return EINVAL;
+
+    export->frame_size = (size_t) format->width * format->height +
+                         2 * (size_t) ((format->width + 1) / 2) * ((format->height + 1) / 2);
+    if(!(export->frame = malloc(export->frame_size)))
+        return ENOMEM;
+    export->width = format->width;
+    export->height = format->height;
+
+    num = export->fps * den + 0.5;
+    for(a = num, b = den; b; t = a % b, a = b, b = t)
+        ;
+    num /= a;
+    den /= a;
+
+    iov.iov_base = header;
+    iov.iov_len = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420jpeg\n",
+                           export->width, export->height, num, den);
+    return glc_export_write(export->video_fd, &iov, 1);
+}
+
+/* show the current frame for every frame period which starts before time */
+static int glc_export_video_time(struct glc_export_s *export, glc_utime_t time) {
+    struct iovec iov[2];
+    int err;
+
+    if(!export->have_frame)
+        return 0;
+
+    while(export->start + (glc_utime_t) (export->frames * 1000000.0 / export->fps) < time) {
+        iov[0].iov_base = "FRAME\n";
+        iov[0].iov_len = 6;
+        iov[1].iov_base = export->frame;
+        iov[1].iov_len = export->frame_size;
+        if((err = glc_export_write(export->video_fd, iov, 2)))
+            return err;
+        export->frames++;
+    }
+
+    return 0;
+}
+
+static int glc_export_audio_format(struct glc_export_s *export, glc_reader_msg *msg) {
+    const glc_audio_format_message_t *format;
+    struct glc_export_wav_header_s wav;
+    struct iovec iov;
+    int err;
+
+    if((err = glc_reader_audio_format(msg, &format)))
+        return err;
+
+    if(!export->audio_id)
+        export->audio_id = format->id;
+    if(format->id != export->audio_id)
+        return 0;
+
+    /* a wav file has one format */
+    if(export->have_audio_format)
+        return !memcmp(format, &export->audio_format, sizeof(*format)) ? 0 : ENOTSUP;
+
+    switch(format->format) {
+    case GLC_AUDIO_S16_LE:
+        export->sample_size = 2;
+        break;
+    case GLC_AUDIO_S24_LE:
+        export->sample_size = 3;
+        break;
+    case GLC_AUDIO_S32_LE:
+        export->sample_size = 4;
+        break;
+    default:
+        return ENOTSUP;
+    }
+    if(!format->channels || !format->rate)
+        return EINVAL;
+
+    export->audio_format = *format;
+    export->have_audio_format = 1;
+
+    /* the sizes are unknown yet, readers of a pipe take them as "until the end" */
+    memcpy(wav.riff, "RIFF", 4);
+    wav.riff_size = 0xffffffff;
+    memcpy(wav.wave, "WAVE", 4);
+    memcpy(wav.fmt, "fmt ", 4);
+    wav.fmt_size = 16;
+    wav.format = GLC_EXPORT_WAVE_FORMAT_PCM;
+    wav.channels = format->channels;
+    wav.rate = format->rate;
+    wav.block_align = export->sample_size * format->channels;
+    wav.byte_rate = wav.block_align * format->rate;
+    wav.bits = export->sample_size * 8;
+    memcpy(wav.data, "data", 4);
+    wav.data_size = 0xffffffff;
+
+    iov.iov_base = &wav;
+    iov.iov_len = sizeof(wav);
+    return glc_export_write(export->audio_fd, &iov, 1);
+}
+
+static int glc_export_audio_data(struct glc_export_s *export, glc_reader_msg *msg) {
+    const glc_audio_data_header_t *header;
+    const unsigned char *samples;
+    size_t frames, frame, channel, block;
+    unsigned char *dst;
+    struct iovec iov;
+    int err;
+
+    if((err = glc_reader_audio_data(msg, &header, &samples)))
+        return err;
+    if(header->id != export->audio_id || !export->have_audio_format)
+        return 0;
+
+    block = export->sample_size * export->audio_format.channels;
+    frames = header->size / block;
+    iov.iov_base = (void *) samples;
+    iov.iov_len = frames * block;
+
+    /* wav wants the channels of a frame next to each other */
+    if(!(export->audio_format.flags & GLC_AUDIO_INTERLEAVED) && export->audio_format.channels > 1) {
+        if(iov.iov_len > export->interleaved_size) {
+            unsigned char *interleaved = realloc(export->interleaved, iov.iov_len);
+            if(!interleaved)
+                return ENOMEM;
+            export->interleaved = interleaved;
+            export->interleaved_size = iov.iov_len;
+        }
+
+        dst = export->interleaved;
+        for(frame = 0; frame < frames; frame++) {
+            for(channel = 0; channel < export->audio_format.channels; channel++) {
+                memcpy(dst, &samples[(channel * frames + frame) * export->sample_size], export->sample_size);
+                dst += export->sample_size;
+            }
+        }
+        iov.iov_base = export->interleaved;
+    }
+
+    export->audio_size += iov.iov_len;
+    return glc_export_write(export->audio_fd, &iov, 1);
+}
+
+static int glc_export_finish(struct glc_export_s *export) {
+    struct glc_export_wav_header_s wav;
+    struct iovec iov[2];
+    int err;
+
+    /* the last frame is shown for one period */
+    if(export->have_frame) {
+        iov[0].iov_base = "FRAME\n";
+        iov[0].iov_len = 6;
+        iov[1].iov_base = export->frame;
+        iov[1].iov_len = export->frame_size;
+        if((err = glc_export_write(export->video_fd, iov, 2)))
+            return err;
+        export->frames++;
+    }
+
+    /* files get the real sizes, pipes keep the open ended ones */
+    if(export->have_audio_format && export->audio_size <= 0xffffffff - sizeof(wav) &&
+       pread(export->audio_fd, &wav, sizeof(wav), 0) == sizeof(wav)) {
+        wav.riff_size = sizeof(wav) - 8 + export->audio_size;
+        wav.data_size = export->audio_size;
+        if(pwrite(export->audio_fd, &wav, sizeof(wav), 0) != sizeof(wav))
+            return errno;
+    }
+
+    return 0;
+}
+
+/* copy size bytes starting skip bytes into the segments */
+static void glc_export_gather(const struct iovec *iov, int count, size_t skip, void *dst, size_t size) {
+    unsigned char *d = dst;
+    size_t len;
+    int i;
+
+    for(i = 0; i < count && size; i++) {
+        if(skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+
+        len = iov[i].iov_len - skip < size ? iov[i].iov_len - skip : size;
+        memcpy(d, (const unsigned char *) iov[i].iov_base + skip, len);
+        d += len;
+        size -= len;
+        skip = 0;
+    }
+}
+
+static int glc_export_open(const char *path, int *fd) {
+    if(!strcmp(path, "-")) {
+        *fd = STDOUT_FILENO;
+        /* fewer wakeups of the encoder reading the pipe, fails for anything else */
+        fcntl(*fd, F_SETPIPE_SZ, GLC_EXPORT_PIPE_SIZE);
+        return 0;
+    }
+
+    /* read back to fix the wav header */
+    if((*fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+        return errno;
+    return 0;
+}
+
+static int glc_export_write(int fd, struct iovec *iov, int count) {
+    ssize_t ret;
+
+    while(count) {
+        if((ret = writev(fd, iov, count)) == -1) {
+            if(errno == EINTR)
+                continue;
+            return errno;
+        }
+
+        /* skip what was written, partial writes happen on pipes */
+        while(count && (size_t) ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count) {
+            iov->iov_base = (unsigned char *) iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return 0;
+}
+
+/**  \} */
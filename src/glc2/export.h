@@ -0,0 +1,72 @@
+/**
+ * \file src/glc2/export.h
+ * \brief stream export
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup glc2_export export
+ *  Exports a video stream of a stream file as a YUV4MPEG2 file and an
+ *  audio stream as a WAV file, for encoders which read raw input from
+ *  files or pipes.
+ *
+ *  Messages are read with the stream reader and put into a window of
+ *  slots in file order. Compressed ones are decompressed on the worker
+ *  pool as soon as they are read, so up to window messages are
+ *  decompressed in parallel while the oldest one is handled. Slots are
+ *  handled strictly in order: deltas are applied to the previous frame,
+ *  frames go through the colour correction and the conversion stage,
+ *  which convert each frame in bands on the same pool, and are written
+ *  out. The window bounds the memory the export needs to window
+ *  decompressed messages.
+ *
+ *  Video is written at a constant frame rate: every frame period shows
+ *  the newest frame at its start, frames are repeated to fill gaps and
+ *  dropped if they come faster. Audio samples are written as they come.
+ *  A y4m or wav file has one format, so a stream which changes its video
+ *  size or audio format part way can not be exported (ENOTSUP).
+ *  \{
+ */
+
+#ifndef GLC2_EXPORT_H
+#define GLC2_EXPORT_H
+
+#include "format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_export_options_s {
+    /** y4m output path, "-" for stdout, NULL for no video */
+    const char *video;
+    /** wav output path, "-" for stdout, NULL for no audio */
+    const char *audio;
+    /** video stream to export, 0 for the first one */
+    glc_stream_id_t video_id;
+    /** audio stream to export, 0 for the first one */
+    glc_stream_id_t audio_id;
+    /** output frame rate, 0 for the one of the stream */
+    double fps;
+    /** worker threads, 0 for one per cpu */
+    int threads;
+    /** messages in flight, 0 for four per worker */
+    unsigned int window;
+} glc_export_options;
+
+/**
+ * \brief export a stream file
+ * \param path stream file
+ * \param options what to export where
+ * \return 0 on success otherwise an error code
+ */
+int glc_export(const char *path, glc_export_options *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
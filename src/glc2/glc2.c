@@ -6,23 +6,23 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
 #include <error.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 //#include <glc2-server.h>
 #include "server.h" // FIXME
+#include "export.h"
 
 #define UNUSED(x) (void)(x)
 
 glc_server *server;
 
 void terminate(int sig) {
-    glc_server_destroy(server);
-    server = NULL;
-
-    printf("server addr is %p\n", server);
-    exit(sig);
+    UNUSED(sig);
+    glc_server_stop(server);
 }
 
 int handle_error(int err) {
@@ -30,9 +30,67 @@ int handle_error(int err) {
     return 0;
 }
 
+static void export_usage(void) {
+    fprintf(stderr, "usage: glc2 export [-v video.y4m] [-a audio.wav] [-V id] [-A id] [-f fps]\n"
+                    "                   [-t threads] [-w window] stream.glc\n"
+                    "  -v, -a  output file, - for stdout\n"
+                    "  -V, -A  stream to export, the first one by default\n"
+                    "  -f      output frame rate, the stream's by default\n"
+                    "  -t      worker threads, one per cpu by default\n"
+                    "  -w      messages decompressed ahead, four per thread by default\n");
+}
+
+static int export_main(int argc, char **argv) {
+    glc_export_options options;
+    int opt, err;
+
+    memset(&options, 0, sizeof(options));
+    while((opt = getopt(argc, argv, "v:a:V:A:f:t:w:")) != -1) {
+        switch(opt) {
+        case 'v':
+            options.video = optarg;
+            break;
+        case 'a':
+            options.audio = optarg;
+            break;
+        case 'V':
+            options.video_id = atoi(optarg);
+            break;
+        case 'A':
+            options.audio_id = atoi(optarg);
+            break;
+        case 'f':
+            options.fps = atof(optarg);
+            break;
+        case 't':
+            options.threads = atoi(optarg);
+            break;
+        case 'w':
+            options.window = atoi(optarg);
+            break;
+        default:
+            export_usage();
+            return EINVAL;
+        }
+    }
+
+    if(optind != argc - 1 || (!options.video && !options.audio)) {
+        export_usage();
+        return EINVAL;
+    }
+
+    /* a closed pipe is reported by write() */
+    signal(SIGPIPE, SIG_IGN);
+
+    if((err = glc_export(argv[optind], &options)))
+        fprintf(stderr, "glc_export failed: %s (%d)\n", strerror(err), err);
+    return err;
+}
+
 int main(int argc, char **argv) {
-    UNUSED(argc);
-    UNUSED(argv);
+    if(argc > 1 && !strcmp(argv[1], "export"))
+        return export_main(argc - 1, &argv[1]);
+
     printf("main\n");
 
     signal(SIGINT, terminate);
@@ -53,11 +111,12 @@ int main(int argc, char **argv) {
 #endif
 
 
-    glc_server_run(server, 0);
+    if((err = glc_server_run(server, 0)))
+        fprintf(stderr, "glc_server_run failed: %s (%d)\n", strerror(err), err);
 
-    fprintf(stderr, "glc_server_msg_get failed: %s (%d)\n", strerror(err), err);
-    terminate(err);
+    glc_server_destroy(server);
+    server = NULL;
 
-    return 0;
+    return err;
 }
 
@@ -0,0 +1,304 @@
+/**
+ * \file src/reader/reader.c
+ * \brief stream file reader
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup reader
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "reader.h"
+#include "lzjb.h"
+
+struct glc_reader_s {
+    unsigned char *data;
+    size_t size;
+    int flags;
+
+    const glc_stream_info_t *info;
+    const char *name, *date;
+
+    /** offset of the first message and of the next one */
+    size_t start, pos;
+    /** pages before this offset were requested already */
+    size_t ahead;
+    /** the close message was read */
+    int closed;
+};
+
+static void glc_reader_readahead(glc_reader *reader);
+static int glc_reader_view(glc_reader_msg *msg, glc_message_type_t type, size_t size);
+
+int glc_reader_open(glc_reader **reader, const char *path, int flags) {
+    glc_reader *r;
+    struct stat st;
+    size_t pos;
+    int fd, err;
+
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return errno;
+
+    if(fstat(fd, &st) == -1) {
+        err = errno;
+        close(fd);
+        return err;
+    }
+
+    if((size_t) st.st_size < sizeof(glc_stream_info_t)) {
+        close(fd);
+        return EINVAL;
+    }
+
+    if(!(r = calloc(1, sizeof(*r)))) {
+        close(fd);
+        return ENOMEM;
+    }
+
+    r->size = st.st_size;
+    r->flags = flags;
+    if(!(flags & GLC_READER_RANDOM))
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    r->data = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    err = errno;
+    /* the mapping keeps the file */
+    close(fd);
+    if(r->data == MAP_FAILED) {
+        free(r);
+        return err;
+    }
+
+    madvise(r->data, r->size, flags & GLC_READER_RANDOM ? MADV_RANDOM : MADV_SEQUENTIAL);
+
+    r->info = (const glc_stream_info_t *) r->data;
+    if(r->info->signature != GLC_SIGNATURE) {
+        err = EINVAL;
+        goto error;
+    }
+    if(r->info->version != GLC_STREAM_VERSION) {
+        err = ENOTSUP;
+        goto error;
+    }
+
+    /* name and date must be terminated inside the file */
+    pos = sizeof(glc_stream_info_t);
+    if(r->info->name_size > r->size - pos || r->info->date_size > r->size - pos - r->info->name_size) {
+        err = EINVAL;
+        goto error;
+    }
+    r->name = r->info->name_size ? (const char *) &r->data[pos] : "";
+    r->date = r->info->date_size ? (const char *) &r->data[pos + r->info->name_size] : "";
+    pos += r->info->name_size + r->info->date_size;
+    if((r->info->name_size && r->data[pos - r->info->date_size - 1]) ||
+       (r->info->date_size && r->data[pos - 1])) {
+        err = EINVAL;
+        goto error;
+    }
+
+    r->start = r->pos = pos;
+    *reader = r;
+    return 0;
+
+error:
+    munmap(r->data, r->size);
+    free(r);
+    return err;
+}
+
+void glc_reader_close(glc_reader *reader) {
+    munmap(reader->data, reader->size);
+    free(reader);
+}
+
+const glc_stream_info_t *glc_reader_info(glc_reader *reader, const char **name, const char **date) {
+    if(name)
+        *name = reader->name;
+    if(date)
+        *date = reader->date;
+    return reader->info;
+}
+
+int glc_reader_next(glc_reader *reader, glc_reader_msg *msg) {
+    size_t left = reader->size - reader->pos;
+    glc_lzjb_header_t lzjb;
+    glc_size_t size;
+
+    if(reader->closed || !left)
+        return ENODATA;
+
+    if(left < sizeof(size) + sizeof(glc_message_header_t))
+        return EINVAL;
+    memcpy(&size, &reader->data[reader->pos], sizeof(size));
+    left -= sizeof(size) + sizeof(glc_message_header_t);
+    if(size > left)
+        return EINVAL;
+
+    msg->offset = reader->pos;
+    memcpy(&msg->stored, &reader->data[reader->pos + sizeof(size)], sizeof(msg->stored));
+    msg->header = msg->stored;
+    msg->raw = &reader->data[reader->pos + sizeof(size) + sizeof(glc_message_header_t)];
+    msg->raw_size = size;
+    msg->data = msg->raw;
+    msg->size = msg->raw_size;
+
+    /* only the header of the original is read now, the payload when it is asked for */
+    if(msg->stored.type == GLC_MESSAGE_LZJB || msg->stored.type == GLC_MESSAGE_LZO ||
+       msg->stored.type == GLC_MESSAGE_QUICKLZ) {
+        if(size < sizeof(lzjb))
+            return EINVAL;
+        memcpy(&lzjb, msg->raw, sizeof(lzjb));
+        msg->header = lzjb.header;
+        msg->data = NULL;
+        msg->size = lzjb.size;
+    }
+
+    reader->pos += sizeof(size) + sizeof(glc_message_header_t) + size;
+    if(msg->stored.type == GLC_MESSAGE_CLOSE)
+        reader->closed = 1;
+
+    if(!(reader->flags & GLC_READER_RANDOM))
+        glc_reader_readahead(reader);
+    return 0;
+}
+
+int glc_reader_seek(glc_reader *reader, u_int64_t offset) {
+    if(offset < reader->start || offset > reader->size)
+        return EINVAL;
+
+    reader->pos = offset;
+    reader->ahead = offset & ~((size_t) sysconf(_SC_PAGESIZE) - 1);
+    reader->closed = 0;
+    return 0;
+}
+
+int glc_reader_msg_data(glc_reader_msg *msg) {
+    int err;
+
+    if(msg->data)
+        return 0;
+
+    /* lzo and quicklz messages of glc streams can not be decompressed here */
+    if(msg->stored.type != GLC_MESSAGE_LZJB)
+        return ENOTSUP;
+
+    if(msg->size > msg->buf_size || !msg->buf) {
+        void *buf = realloc(msg->buf, msg->size ? msg->size : 1);
+        if(!buf)
+            return ENOMEM;
+        msg->buf = buf;
+        msg->buf_size = msg->size;
+    }
+
+    if((err = glc_lzjb_message_decompress_to(msg->raw, msg->raw_size, msg->buf, msg->size)))
+        return err;
+
+    msg->data = msg->buf;
+    return 0;
+}
+
+void glc_reader_msg_free(glc_reader_msg *msg) {
+    free(msg->buf);
+    msg->buf = NULL;
+    msg->buf_size = 0;
+    if(msg->data != msg->raw)
+        msg->data = NULL;
+}
+
+int glc_reader_video_frame(glc_reader_msg *msg, const glc_video_frame_header_t **header,
+                           const unsigned char **pixels, size_t *size) {
+    int err;
+
+    if((err = glc_reader_view(msg, GLC_MESSAGE_VIDEO_FRAME, sizeof(**header))))
+        return err;
+
+    *header = msg->data;
+    *pixels = (const unsigned char *) msg->data + sizeof(**header);
+    *size = msg->size - sizeof(**header);
+    return 0;
+}
+
+int glc_reader_audio_data(glc_reader_msg *msg, const glc_audio_data_header_t **header,
+                          const unsigned char **samples) {
+    const glc_audio_data_header_t *h;
+    int err;
+
+    if((err = glc_reader_view(msg, GLC_MESSAGE_AUDIO_DATA, sizeof(*h))))
+        return err;
+
+    h = msg->data;
+    if(h->size > msg->size - sizeof(*h))
+        return EINVAL;
+
+    *header = h;
+    *samples = (const unsigned char *) msg->data + sizeof(*h);
+    return 0;
+}
+
+int glc_reader_video_format(glc_reader_msg *msg, const glc_video_format_message_t **format) {
+    int err;
+
+    if((err = glc_reader_view(msg, GLC_MESSAGE_VIDEO_FORMAT, sizeof(**format))))
+        return err;
+    *format = msg->data;
+    return 0;
+}
+
+int glc_reader_audio_format(glc_reader_msg *msg, const glc_audio_format_message_t **format) {
+    int err;
+
+    if((err = glc_reader_view(msg, GLC_MESSAGE_AUDIO_FORMAT, sizeof(**format))))
+        return err;
+    *format = msg->data;
+    return 0;
+}
+
+int glc_reader_color(glc_reader_msg *msg, const glc_color_message_t **color) {
+    int err;
+
+    if((err = glc_reader_view(msg, GLC_MESSAGE_COLOR, sizeof(**color))))
+        return err;
+    *color = msg->data;
+    return 0;
+}
+
+/* keep a window of pages in front of the next message requested */
+static void glc_reader_readahead(glc_reader *reader) {
+    size_t len;
+
+    /* a big message skipped the window */
+    if(reader->ahead < reader->pos)
+        reader->ahead = reader->pos & ~((size_t) sysconf(_SC_PAGESIZE) - 1);
+
+    if(reader->ahead >= reader->size || reader->ahead - reader->pos > GLC_READER_READAHEAD / 2)
+        return;
+
+    len = reader->size - reader->ahead < GLC_READER_READAHEAD ? reader->size - reader->ahead
+                                                              : GLC_READER_READAHEAD;
+    madvise(&reader->data[reader->ahead], len, MADV_WILLNEED);
+    reader->ahead += len;
+}
+
+static int glc_reader_view(glc_reader_msg *msg, glc_message_type_t type, size_t size) {
+    int err;
+
+    if(msg->header.type != type)
+        return EINVAL;
+    if((err = glc_reader_msg_data(msg)))
+        return err;
+    if(msg->size < size)
+        return EINVAL;
+    return 0;
+}
+
+/**  \} */
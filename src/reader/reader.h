@@ -0,0 +1,189 @@
+/**
+ * \file src/reader/reader.h
+ * \brief stream file reader
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup reader stream reader
+ *  The reader maps a stream file and walks its messages without copying
+ *  them: a glc_reader_msg points into the mapping, and so do the typed
+ *  views of its payload. Compressed messages are only decompressed when
+ *  their payload is asked for, into a buffer the message keeps, so tools
+ *  which only look at headers or at some streams never pay for the rest.
+ *
+ *  The mapping is read with MADV_SEQUENTIAL and the pages in front of
+ *  the next message are requested with MADV_WILLNEED a window at a time,
+ *  so the disk is kept busy while messages are handled. Readers which
+ *  jump around, e.g. with glc_reader_seek() and the stream index, pass
+ *  GLC_READER_RANDOM instead.
+ *
+ *  A reader is not thread-safe, but messages are independent of it and
+ *  of each other: they may be handed to other threads and decompressed
+ *  there as long as the reader is open.
+ *  \{
+ */
+
+#ifndef GLC2_READER_READER_H
+#define GLC2_READER_READER_H
+
+#include <stddef.h>
+
+#include "format.h"
+
+/** bytes of the file requested ahead of the next message */
+#define GLC_READER_READAHEAD (16 * 1024 * 1024)
+
+/** the file is not read in order, no readahead */
+#define GLC_READER_RANDOM 0x1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_reader_s glc_reader;
+
+/**
+ * \brief message of a stream file
+ *
+ * Filled by glc_reader_next(). The fields point into the mapping and stay
+ * valid until the reader is closed. A message which is reused for the
+ * next one keeps its decompression buffer, free it with
+ * glc_reader_msg_free() once done.
+ */
+typedef struct glc_reader_msg_s {
+    /** file offset of the size in front of the message */
+    u_int64_t offset;
+    /** header as stored, e.g. GLC_MESSAGE_LZJB */
+    glc_message_header_t stored;
+    /** header of the message, of the original if it is compressed */
+    glc_message_header_t header;
+    /** payload as stored */
+    const void *raw;
+    /** size of the stored payload */
+    size_t raw_size;
+
+    /** payload, NULL until it is asked for if the message is compressed */
+    const void *data;
+    /** payload size */
+    size_t size;
+    /** decompression buffer */
+    void *buf;
+    size_t buf_size;
+} glc_reader_msg;
+
+/**
+ * \brief open a stream file
+ * \param reader returned reader
+ * \param path stream file
+ * \param flags 0 or GLC_READER_RANDOM
+ * \return 0 on success, EINVAL if it is no stream file, ENOTSUP if it is
+ *         of another stream version, otherwise an error code
+ */
+__PUBLIC int glc_reader_open(glc_reader **reader, const char *path, int flags);
+
+/**
+ * \brief close a reader and unmap the file
+ * \param reader the reader
+ */
+__PUBLIC void glc_reader_close(glc_reader *reader);
+
+/**
+ * \brief get the stream info
+ * \param reader the reader
+ * \param name returned captured program's name, may be NULL
+ * \param date returned capture date, may be NULL
+ * \return stream info
+ */
+__PUBLIC const glc_stream_info_t *glc_reader_info(glc_reader *reader, const char **name, const char **date);
+
+/**
+ * \brief get the next message
+ * \param reader the reader
+ * \param msg message, initialized to zero before its first use
+ * \return 0 on success, ENODATA after the close message or at the end of
+ *         the file, EINVAL if the file is damaged or cut off
+ */
+__PUBLIC int glc_reader_next(glc_reader *reader, glc_reader_msg *msg);
+
+/**
+ * \brief continue reading at another message
+ * \param reader the reader
+ * \param offset file offset of the size in front of a message, e.g. of a
+ *        glc_index_entry_t or glc_reader_msg
+ * \return 0 on success or EINVAL if offset is not in the file
+ */
+__PUBLIC int glc_reader_seek(glc_reader *reader, u_int64_t offset);
+
+/**
+ * \brief get the payload of a message, decompressing it if needed
+ * \param msg the message
+ * \return 0 on success, ENOTSUP for compression this tree can not read,
+ *         EINVAL if the payload is damaged, otherwise an error code
+ */
+__PUBLIC int glc_reader_msg_data(glc_reader_msg *msg);
+
+/**
+ * \brief free the decompression buffer of a message
+ * \param msg the message
+ */
+__PUBLIC void glc_reader_msg_free(glc_reader_msg *msg);
+
+/**
+ * \brief view of a GLC_MESSAGE_VIDEO_FRAME message
+ * \param msg the message
+ * \param header returned frame header
+ * \param pixels returned pixels
+ * \param size returned size of the pixels
+ * \return 0 on success, EINVAL if it is no video frame, otherwise an
+ *         error of glc_reader_msg_data()
+ */
+__PUBLIC int glc_reader_video_frame(glc_reader_msg *msg, const glc_video_frame_header_t **header,
+                                    const unsigned char **pixels, size_t *size);
+
+/**
+ * \brief view of a GLC_MESSAGE_AUDIO_DATA message
+ * \param msg the message
+ * \param header returned audio data header
+ * \param samples returned samples, header->size bytes
+ * \return 0 on success, EINVAL if it is no audio data, otherwise an
+ *         error of glc_reader_msg_data()
+ */
+__PUBLIC int glc_reader_audio_data(glc_reader_msg *msg, const glc_audio_data_header_t **header,
+                                   const unsigned char **samples);
+
+/**
+ * \brief view of a GLC_MESSAGE_VIDEO_FORMAT message
+ * \param msg the message
+ * \param format returned format
+ * \return 0 on success, EINVAL if it is no video format message,
+ *         otherwise an error of glc_reader_msg_data()
+ */
+__PUBLIC int glc_reader_video_format(glc_reader_msg *msg, const glc_video_format_message_t **format);
+
+/**
+ * \brief view of a GLC_MESSAGE_AUDIO_FORMAT message
+ * \param msg the message
+ * \param format returned format
+ * \return 0 on success, EINVAL if it is no audio format message,
+ *         otherwise an error of glc_reader_msg_data()
+ */
+__PUBLIC int glc_reader_audio_format(glc_reader_msg *msg, const glc_audio_format_message_t **format);
+
+/**
+ * \brief view of a GLC_MESSAGE_COLOR message
+ * \param msg the message
+ * \param color returned color correction
+ * \return 0 on success, EINVAL if it is no color message, otherwise an
+ *         error of glc_reader_msg_data()
+ */
+__PUBLIC int glc_reader_color(glc_reader_msg *msg, const glc_color_message_t **color);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
@@ -0,0 +1,260 @@
+/**
+ * \file src/server/color.c
+ * \brief colour correction stage
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_color
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "color.h"
+#include "delta.h"
+#include "lut.h"
+
+#define GLC_COLOR_BAND 64
+
+struct glc_color_stream_s {
+    glc_delta_stream_t head;
+    glc_video_format_t format;
+    unsigned int bpp;
+    unsigned int width, height;
+    size_t stride;
+    /** bytes of pixel data in a frame, 0 if the format is not packed */
+    size_t size;
+    /** tables of the last colour message, NULL if there is nothing to correct */
+    glc_lut_t *lut;
+    /** the message the tables were built from */
+    glc_color_message_t color;
+    /** colour messages are passed on, the reader corrects the frames */
+    int passed;
+};
+
+/** one frame, its bands are corrected in place with glc_pool_for() */
+struct glc_color_job_s {
+    const struct glc_color_stream_s *stream;
+    unsigned char *pixels;
+};
+
+struct glc_color_s {
+    glc_pool *pool;
+    glc_color_output output;
+    void *udata;
+    glc_delta_stream_t *streams;
+    /** corrected frame with its header */
+    glc_delta_scratch_t out;
+};
+
+static int glc_color_format(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_color_message(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_color_frame(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_color_delta(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_color_pass(glc_color *color, struct glc_color_stream_s *stream);
+static void glc_color_band(void *arg, int band, int slot);
+
+int glc_color_create(glc_color **color, glc_pool *pool, glc_color_output output, void *udata) {
+    glc_color *c = calloc(1, sizeof(*c));
+    if(!c)
+        return ENOMEM;
+
+    c->pool = pool;
+    c->output = output;
+    c->udata = udata;
+
+    *color = c;
+    return 0;
+}
+
+int glc_color_destroy(glc_color *color) {
+    struct glc_color_stream_s *stream;
+
+    while((stream = (struct glc_color_stream_s *) color->streams)) {
+        color->streams = stream->head.next;
+        free(stream->lut);
+        free(stream);
+    }
+
+    free(color->out.data);
+    free(color);
+    return 0;
+}
+
+int glc_color_submit(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    if(hdr->type == GLC_MESSAGE_VIDEO_FORMAT)
+        return glc_color_format(color, hdr, iov, count);
+    if(hdr->type == GLC_MESSAGE_COLOR)
+        return glc_color_message(color, hdr, iov, count);
+    if(hdr->type == GLC_MESSAGE_VIDEO_FRAME)
+        return glc_color_frame(color, hdr, iov, count);
+    if(hdr->type == GLC_MESSAGE_VIDEO_DELTA)
+        return glc_color_delta(color, hdr, iov, count);
+    return color->output(hdr, iov, count, color->udata);
+}
+
+static int glc_color_format(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_color_stream_s *stream;
+    glc_video_format_message_t format;
+
+    if(glc_delta_read(iov, count, &format, sizeof(format)))
+        return color->output(hdr, iov, count, color->udata);
+
+    if(!(stream = (struct glc_color_stream_s *) glc_delta_stream(&color->streams, format.id, sizeof(*stream), 1)))
+        return ENOMEM;
+
+    stream->size = 0;
+    if(!glc_delta_geometry(&format, &stream->bpp, &stream->stride)) {
+        stream->format = format.format;
+        stream->width = format.width;
+        stream->height = format.height;
+        stream->size = stream->stride * stream->height;
+    }
+
+    return color->output(hdr, iov, count, color->udata);
+}
+
+static int glc_color_message(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_color_stream_s *stream;
+    glc_color_message_t msg;
+    glc_lut_t lut;
+
+    if(glc_delta_read(iov, count, &msg, sizeof(msg)))
+        return color->output(hdr, iov, count, color->udata);
+
+    if(!(stream = (struct glc_color_stream_s *) glc_delta_stream(&color->streams, msg.id, sizeof(*stream), 1)))
+        return ENOMEM;
+
+    /*
+     * only packed frames go through the tables, values we can not bake in
+     * are left to the reader. once the reader corrects a stream it gets the
+     * following messages too, or corrections would add up.
+     */
+    if(stream->passed || !stream->size || glc_lut_build(&lut, &msg)) {
+        free(stream->lut);
+        stream->lut = NULL;
+        stream->passed = 1;
+        return color->output(hdr, iov, count, color->udata);
+    }
+
+    if(lut.identity) {
+        free(stream->lut);
+        stream->lut = NULL;
+        return 0;
+    }
+
+    if(!stream->lut && !(stream->lut = malloc(sizeof(*stream->lut))))
+        return ENOMEM;
+    memcpy(stream->lut, &lut, sizeof(lut));
+    stream->color = msg;
+    return 0;
+}
+
+/* a frame can not go through the tables, the reader corrects from here on */
+static int glc_color_pass(glc_color *color, struct glc_color_stream_s *stream) {
+    glc_message_header_t hdr;
+    struct iovec iov;
+
+    free(stream->lut);
+    stream->lut = NULL;
+    stream->passed = 1;
+
+    hdr.type = GLC_MESSAGE_COLOR;
+    iov.iov_base = &stream->color;
+    iov.iov_len = sizeof(stream->color);
+    return color->output(&hdr, &iov, 1, color->udata);
+}
+
+static int glc_color_frame(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_color_stream_s *stream;
+    glc_video_frame_header_t frame;
+    struct glc_color_job_s job;
+    struct iovec out_iov;
+    size_t size;
+    int err;
+
+    if(glc_delta_read(iov, count, &frame, sizeof(frame)))
+        return color->output(hdr, iov, count, color->udata);
+
+    stream = (struct glc_color_stream_s *) glc_delta_stream(&color->streams, frame.id, sizeof(*stream), 0);
+    if(!stream || !stream->lut)
+        return color->output(hdr, iov, count, color->udata);
+
+    /* the tables are applied in place */
+    if((err = glc_delta_copy(&color->out, iov, count, &size)))
+        return err;
+
+    if(!stream->size || size - sizeof(frame) != stream->size) {
+        if((err = glc_color_pass(color, stream)))
+            return err;
+        return color->output(hdr, iov, count, color->udata);
+    }
+
+    job.stream = stream;
+    job.pixels = &color->out.data[sizeof(frame)];
+    if((err = glc_pool_for(color->pool, (stream->height + GLC_COLOR_BAND - 1) / GLC_COLOR_BAND,
+                           glc_color_band, &job)))
+        return err;
+
+    out_iov.iov_base = color->out.data;
+    out_iov.iov_len = size;
+    return color->output(hdr, &out_iov, 1, color->udata);
+}
+
+/* the tiles of a delta are packed pixels of the stream, they are corrected like a frame */
+static int glc_color_delta(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_color_stream_s *stream;
+    glc_video_delta_header_t delta;
+    struct iovec out_iov;
+    size_t size, offset;
+    int err;
+
+    if(glc_delta_read(iov, count, &delta, sizeof(delta)))
+        return color->output(hdr, iov, count, color->udata);
+
+    stream = (struct glc_color_stream_s *) glc_delta_stream(&color->streams, delta.id, sizeof(*stream), 0);
+    if(!stream || !stream->lut)
+        return color->output(hdr, iov, count, color->udata);
+
+    if((err = glc_delta_copy(&color->out, iov, count, &size)))
+        return err;
+
+    offset = sizeof(delta) + (size_t) delta.count * sizeof(u_int32_t);
+    if(!stream->size || delta.count > (size - sizeof(delta)) / sizeof(u_int32_t) ||
+       (size - offset) % stream->bpp) {
+        if((err = glc_color_pass(color, stream)))
+            return err;
+        return color->output(hdr, iov, count, color->udata);
+    }
+
+    if((err = glc_lut_apply(stream->lut, stream->format, &color->out.data[offset], &color->out.data[offset],
+                            (size - offset) / stream->bpp)))
+        return err;
+
+    out_iov.iov_base = color->out.data;
+    out_iov.iov_len = size;
+    return color->output(hdr, &out_iov, 1, color->udata);
+}
+
+static void glc_color_band(void *arg, int band, int slot) {
+    const struct glc_color_job_s *job = arg;
+    const struct glc_color_stream_s *stream = job->stream;
+    unsigned int y = band * GLC_COLOR_BAND, end = y + GLC_COLOR_BAND;
+    unsigned char *row;
+    (void) slot;
+
+    if(end > stream->height)
+        end = stream->height;
+
+    /* the padding of aligned rows stays as it is */
+    for(; y < end; y++) {
+        row = &job->pixels[y * stream->stride];
+        glc_lut_apply(stream->lut, stream->format, row, row, stream->width);
+    }
+}
+
+/**  \} */
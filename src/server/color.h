@@ -0,0 +1,90 @@
+/**
+ * \file src/server/color.h
+ * \brief colour correction stage
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_color colour correction
+ *  The colour correction stage bakes GLC_MESSAGE_COLOR messages into the
+ *  frames, so readers see the picture as the display showed it without
+ *  knowing about gamma ramps. For every colour message it builds lookup
+ *  tables with glc_lut_build() and corrects all following BGRA, BGR and
+ *  RGB frames of the stream with them, and the tiles of its delta frames;
+ *  the colour message itself is not passed on. Frames are split into
+ *  bands of rows which are corrected on the worker pool with
+ *  glc_pool_for().
+ *
+ *  Streams without a colour message and colour messages which change
+ *  nothing are passed on unchanged, as are all other messages, in order.
+ *  Colour messages of streams in other formats are passed on for the
+ *  reader. If a frame can not be corrected after all, e.g. after the
+ *  stream changed to another format, the colour message in effect is
+ *  passed on in front of it and the reader corrects the stream from
+ *  there on. The stage goes in front of the conversion stage, which
+ *  drops the RGB values. It is not thread-safe,
+ *  it is fed by one thread at a time and calls the output from
+ *  glc_color_submit().
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_COLOR_H
+#define GLC2_SERVER_COLOR_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "format.h"
+#include "pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_color_s glc_color;
+
+/**
+ * \brief receives the messages of a stage in submission order
+ * \param hdr message header
+ * \param iov payload segments, only valid during the call
+ * \param count number of segments
+ * \param udata data passed to glc_color_create()
+ * \return 0 on success, an error is returned by the submit
+ */
+typedef int (*glc_color_output)(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata);
+
+/**
+ * \brief create a colour correction stage
+ * \param color returned stage
+ * \param pool pool which corrects the bands
+ * \param output receives the messages
+ * \param udata data passed to output
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_color_create(glc_color **color, glc_pool *pool, glc_color_output output, void *udata);
+
+/**
+ * \brief destroy a stage
+ * \param color the stage
+ * \return 0 on success
+ */
+__PUBLIC int glc_color_destroy(glc_color *color);
+
+/**
+ * \brief submit a message
+ * \param color the stage
+ * \param hdr message header
+ * \param iov payload segments
+ * \param count number of segments
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_color_submit(glc_color *color, glc_message_header_t *hdr, const struct iovec *iov, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
@@ -0,0 +1,398 @@
+/**
+ * \file src/server/compress.c
+ * \brief parallel compression stage
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_compress
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "compress.h"
+#include "lzjb.h"
+
+#define GLC_COMPRESS_BLOCK_SIZE (256 * 1024)
+#define GLC_COMPRESS_MIN_SIZE 4096
+#define GLC_COMPRESS_MAX_PENDING 8
+
+struct glc_compress_msg_s;
+
+struct glc_compress_block_s {
+    struct glc_compress_msg_s *msg;
+    const unsigned char *src;
+    /** block header followed by room for size bytes */
+    unsigned char *out;
+    size_t size;
+};
+
+struct glc_compress_msg_s {
+    glc_compress *compress;
+    glc_message_header_t header;
+    glc_lzjb_header_t lzjb;
+    unsigned char *data;
+    size_t size;
+    /** compressed blocks, NULL if the message is passed on unchanged */
+    unsigned char *out;
+    int nblocks;
+    struct glc_compress_block_s *blocks;
+    /** blocks not compressed yet */
+    int left;
+    struct glc_compress_msg_s *next;
+};
+
+struct glc_compress_s {
+    glc_pool *pool;
+    glc_compress_options options;
+    glc_compress_output output;
+    void *udata;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    /** messages in submission order */
+    struct glc_compress_msg_s *head, *tail;
+    /** first message with blocks nobody took yet, and its next block */
+    struct glc_compress_msg_s *todo;
+    int todo_block;
+    int pending;
+    /** pool jobs which may still look at the stage, and the owner */
+    int refs;
+    /** a thread is passing messages to the output */
+    int emitting;
+    int err;
+};
+
+static void glc_compress_job(void *arg);
+static struct glc_compress_block_s *glc_compress_take(glc_compress *compress);
+static void glc_compress_help(glc_compress *compress);
+static void glc_compress_block(struct glc_compress_block_s *block);
+static void glc_compress_unref(glc_compress *compress);
+static void glc_compress_drain(glc_compress *compress);
+static int glc_compress_emit(glc_compress *compress, struct glc_compress_msg_s *msg);
+static void glc_compress_msg_free(struct glc_compress_msg_s *msg);
+
+int glc_compress_create(glc_compress **compress, glc_pool *pool, glc_compress_options *options,
+                        glc_compress_output output, void *udata) {
+    glc_compress_options def = {GLC_COMPRESS_BLOCK_SIZE, GLC_COMPRESS_MIN_SIZE, GLC_COMPRESS_MAX_PENDING};
+    glc_compress *c = calloc(1, sizeof(*c));
+    if(!c)
+        return ENOMEM;
+
+    c->options = options ? *options : def;
+    if(!c->options.block_size)
+        c->options.block_size = GLC_COMPRESS_BLOCK_SIZE;
+    if(c->options.max_pending < 1)
+        c->options.max_pending = 1;
+
+    c->pool = pool;
+    c->output = output;
+    c->udata = udata;
+    c->refs = 1;
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_cond_init(&c->cond, NULL);
+
+    *compress = c;
+    return 0;
+}
+
+int glc_compress_destroy(glc_compress *compress) {
+    int err = glc_compress_flush(compress);
+
+    /* jobs which did not run yet find nothing left and free the stage */
+    glc_compress_unref(compress);
+    return err;
+}
+
+int glc_compress_submit(glc_compress *compress, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_compress_msg_s *msg = NULL;
+    struct glc_compress_block_s *block;
+    size_t size = 0, pos = 0, len;
+    int nblocks, err, i;
+
+    for(i = 0; i < count; i++)
+        size += iov[i].iov_len;
+
+    pthread_mutex_lock(&compress->mutex);
+    while(compress->pending >= compress->options.max_pending)
+        glc_compress_help(compress);
+
+    if((err = compress->err)) {
+        pthread_mutex_unlock(&compress->mutex);
+        return err;
+    }
+
+    /* nothing in front of it, pass it on without copying */
+    if(!compress->head && !compress->emitting &&
+       (size < compress->options.min_size || hdr->type == GLC_MESSAGE_LZO ||
+        hdr->type == GLC_MESSAGE_QUICKLZ || hdr->type == GLC_MESSAGE_LZJB)) {
+        compress->emitting = 1;
+        pthread_mutex_unlock(&compress->mutex);
+
+        err = compress->output(hdr, iov, count, compress->udata);
+
+        pthread_mutex_lock(&compress->mutex);
+        compress->emitting = 0;
+        pthread_cond_broadcast(&compress->cond);
+        pthread_mutex_unlock(&compress->mutex);
+
+        /* others may have become ready meanwhile */
+        glc_compress_drain(compress);
+        return err;
+    }
+
+    compress->pending++;
+    pthread_mutex_unlock(&compress->mutex);
+
+    if(!(msg = calloc(1, sizeof(*msg)))) {
+        err = ENOMEM;
+        goto error;
+    }
+
+    msg->compress = compress;
+    msg->header = *hdr;
+    msg->size = size;
+    if(!(msg->data = malloc(size ? size : 1))) {
+        err = ENOMEM;
+        goto error;
+    }
+
+    for(i = 0; i < count; i++) {
+        memcpy(&msg->data[pos], iov[i].iov_base, iov[i].iov_len);
+        pos += iov[i].iov_len;
+    }
+
+    if(size >= compress->options.min_size && hdr->type != GLC_MESSAGE_LZO &&
+       hdr->type != GLC_MESSAGE_QUICKLZ && hdr->type != GLC_MESSAGE_LZJB) {
+        msg->nblocks = (size + compress->options.block_size - 1) / compress->options.block_size;
+        msg->blocks = calloc(msg->nblocks, sizeof(struct glc_compress_block_s));
+        msg->out = malloc(size + msg->nblocks * sizeof(glc_compressed_block_t));
+        if(!msg->blocks || !msg->out) {
+            err = ENOMEM;
+            goto error;
+        }
+
+        for(i = 0, pos = 0; i < msg->nblocks; i++, pos += len) {
+            len = size - pos < compress->options.block_size ? size - pos : compress->options.block_size;
+            msg->blocks[i].msg = msg;
+            msg->blocks[i].src = &msg->data[pos];
+            msg->blocks[i].out = &msg->out[pos + i * sizeof(glc_compressed_block_t)];
+            msg->blocks[i].size = len;
+        }
+        msg->left = msg->nblocks;
+    }
+
+    /* msg may be emitted and freed as soon as it is on the list */
+    nblocks = msg->nblocks;
+
+    pthread_mutex_lock(&compress->mutex);
+    if(compress->tail)
+        compress->tail->next = msg;
+    else
+        compress->head = msg;
+    compress->tail = msg;
+    if(nblocks && !compress->todo) {
+        compress->todo = msg;
+        compress->todo_block = 0;
+    }
+    pthread_mutex_unlock(&compress->mutex);
+
+    if(!nblocks)
+        glc_compress_drain(compress);
+
+    /*
+     * Jobs take whichever block is next, not a given one. A thread waiting
+     * for the stage takes blocks the same way, so it never waits for a job
+     * which is still queued behind itself.
+     */
+    for(i = 0; i < nblocks; i++) {
+        __atomic_add_fetch(&compress->refs, 1, __ATOMIC_ACQ_REL);
+        if(glc_pool_submit(compress->pool, glc_compress_job, compress)) {
+            __atomic_sub_fetch(&compress->refs, 1, __ATOMIC_ACQ_REL);
+            pthread_mutex_lock(&compress->mutex);
+            block = glc_compress_take(compress);
+            pthread_mutex_unlock(&compress->mutex);
+            if(block)
+                glc_compress_block(block);
+        }
+    }
+
+    return 0;
+
+error:
+    if(msg)
+        glc_compress_msg_free(msg);
+
+    pthread_mutex_lock(&compress->mutex);
+    compress->pending--;
+    pthread_cond_broadcast(&compress->cond);
+    pthread_mutex_unlock(&compress->mutex);
+    return err;
+}
+
+int glc_compress_flush(glc_compress *compress) {
+    int err;
+
+    pthread_mutex_lock(&compress->mutex);
+    while(compress->head || compress->emitting)
+        glc_compress_help(compress);
+    err = compress->err;
+    pthread_mutex_unlock(&compress->mutex);
+
+    return err;
+}
+
+static void glc_compress_job(void *arg) {
+    glc_compress *compress = arg;
+    struct glc_compress_block_s *block;
+
+    pthread_mutex_lock(&compress->mutex);
+    block = glc_compress_take(compress);
+    pthread_mutex_unlock(&compress->mutex);
+
+    if(block)
+        glc_compress_block(block);
+    glc_compress_unref(compress);
+}
+
+/* take the next block nobody took yet, called with the mutex held */
+static struct glc_compress_block_s *glc_compress_take(glc_compress *compress) {
+    struct glc_compress_msg_s *msg = compress->todo;
+    struct glc_compress_block_s *block;
+
+    if(!msg)
+        return NULL;
+
+    block = &msg->blocks[compress->todo_block++];
+    if(compress->todo_block == msg->nblocks) {
+        do
+            msg = msg->next;
+        while(msg && !msg->nblocks);
+        compress->todo = msg;
+        compress->todo_block = 0;
+    }
+
+    return block;
+}
+
+/* called with the mutex held instead of waiting, compresses a block or waits for other threads */
+static void glc_compress_help(glc_compress *compress) {
+    struct glc_compress_block_s *block;
+
+    if(!(block = glc_compress_take(compress))) {
+        /* the blocks left are being compressed, they never wait themselves */
+        pthread_cond_wait(&compress->cond, &compress->mutex);
+        return;
+    }
+
+    pthread_mutex_unlock(&compress->mutex);
+    glc_compress_block(block);
+    pthread_mutex_lock(&compress->mutex);
+}
+
+static void glc_compress_block(struct glc_compress_block_s *block) {
+    glc_compress *compress = block->msg->compress;
+    glc_compressed_block_t hdr;
+
+    hdr.size = block->size;
+    hdr.compressed_size = glc_lzjb_compress(block->src, &block->out[sizeof(hdr)], block->size, block->size);
+    if(hdr.compressed_size == hdr.size)
+        memcpy(&block->out[sizeof(hdr)], block->src, block->size);
+    memcpy(block->out, &hdr, sizeof(hdr));
+
+    pthread_mutex_lock(&compress->mutex);
+    block->msg->left--;
+    pthread_mutex_unlock(&compress->mutex);
+
+    glc_compress_drain(compress);
+}
+
+static void glc_compress_unref(glc_compress *compress) {
+    if(__atomic_sub_fetch(&compress->refs, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    pthread_cond_destroy(&compress->cond);
+    pthread_mutex_destroy(&compress->mutex);
+    free(compress);
+}
+
+/* pass finished messages at the head on, by one thread at a time */
+static void glc_compress_drain(glc_compress *compress) {
+    struct glc_compress_msg_s *msg;
+    int err;
+
+    pthread_mutex_lock(&compress->mutex);
+    if(compress->emitting) {
+        /* the emitting thread checks the head again before it stops */
+        pthread_mutex_unlock(&compress->mutex);
+        return;
+    }
+
+    compress->emitting = 1;
+    while((msg = compress->head) && !msg->left) {
+        compress->head = msg->next;
+        if(!compress->head)
+            compress->tail = NULL;
+        pthread_mutex_unlock(&compress->mutex);
+
+        err = glc_compress_emit(compress, msg);
+        glc_compress_msg_free(msg);
+
+        pthread_mutex_lock(&compress->mutex);
+        if(err && !compress->err)
+            compress->err = err;
+        compress->pending--;
+        pthread_cond_broadcast(&compress->cond);
+    }
+    compress->emitting = 0;
+    pthread_cond_broadcast(&compress->cond);
+    pthread_mutex_unlock(&compress->mutex);
+}
+
+static int glc_compress_emit(glc_compress *compress, struct glc_compress_msg_s *msg) {
+    glc_message_header_t hdr;
+    struct iovec iov[2];
+    glc_compressed_block_t *last;
+    size_t out_size;
+    int i;
+
+    if(msg->nblocks) {
+        /* blocks are stored with gaps, close them */
+        out_size = 0;
+        for(i = 0; i < msg->nblocks; i++) {
+            last = (glc_compressed_block_t *) msg->blocks[i].out;
+            memmove(&msg->out[out_size], msg->blocks[i].out, sizeof(*last) + last->compressed_size);
+            out_size += sizeof(*last) + last->compressed_size;
+        }
+
+        if(out_size + sizeof(msg->lzjb) < msg->size) {
+            msg->lzjb.size = msg->size;
+            msg->lzjb.header = msg->header;
+            hdr.type = GLC_MESSAGE_LZJB;
+
+            iov[0].iov_base = &msg->lzjb;
+            iov[0].iov_len = sizeof(msg->lzjb);
+            iov[1].iov_base = msg->out;
+            iov[1].iov_len = out_size;
+            return compress->output(&hdr, iov, 2, compress->udata);
+        }
+    }
+
+    iov[0].iov_base = msg->data;
+    iov[0].iov_len = msg->size;
+    return compress->output(&msg->header, iov, 1, compress->udata);
+}
+
+static void glc_compress_msg_free(struct glc_compress_msg_s *msg) {
+    free(msg->blocks);
+    free(msg->out);
+    free(msg->data);
+    free(msg);
+}
+
+/**  \} */
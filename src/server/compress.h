@@ -0,0 +1,108 @@
+/**
+ * \file src/server/compress.h
+ * \brief parallel compression stage
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_compress compression stage
+ *  Messages submitted to the stage are split into blocks which are
+ *  compressed with lzjb on the worker pool, several blocks and several
+ *  messages at once. Finished messages are passed to the output callback
+ *  as GLC_MESSAGE_LZJB messages strictly in submission order. Small
+ *  messages, already compressed messages and messages which do not
+ *  shrink are passed on unchanged, still in order.
+ *
+ *  Submission is not thread-safe, a stage is fed by one thread at a time.
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_COMPRESS_H
+#define GLC2_SERVER_COMPRESS_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "format.h"
+#include "pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_compress_s glc_compress;
+
+/**
+ * \brief receives the messages of a stage in submission order
+ *
+ * Calls never overlap, but may come from any worker thread.
+ * \param hdr message header
+ * \param iov payload segments, only valid during the call
+ * \param count number of segments
+ * \param udata data passed to glc_compress_create()
+ * \return 0 on success, an error is returned by the next submit or flush
+ */
+typedef int (*glc_compress_output)(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata);
+
+typedef struct glc_compress_options_s {
+    /** uncompressed block size */
+    size_t block_size;
+    /** messages smaller than this are not compressed */
+    size_t min_size;
+    /** messages in the stage at most, bounds memory use */
+    int max_pending;
+} glc_compress_options;
+
+/**
+ * \brief create a compression stage
+ * \param compress returned stage
+ * \param pool pool which compresses the blocks
+ * \param options options or NULL for defaults (256 KiB blocks, 4 KiB
+ *        minimum size, 8 pending messages)
+ * \param output receives the messages
+ * \param udata data passed to output
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_compress_create(glc_compress **compress, glc_pool *pool, glc_compress_options *options,
+                                 glc_compress_output output, void *udata);
+
+/**
+ * \brief flush and destroy a stage
+ * \param compress the stage
+ * \return 0 on success otherwise the first error which occured
+ */
+__PUBLIC int glc_compress_destroy(glc_compress *compress);
+
+/**
+ * \brief submit a message
+ *
+ * The payload is copied, so it can be released right away (e.g. a
+ * glc_server_view). If max_pending messages are in the stage, the caller
+ * compresses queued blocks itself until one is passed on, so this may be
+ * called from inside a job of the same pool.
+ * \param compress the stage
+ * \param hdr message header
+ * \param iov payload segments
+ * \param count number of segments
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_compress_submit(glc_compress *compress, glc_message_header_t *hdr, const struct iovec *iov, int count);
+
+/**
+ * \brief wait until all submitted messages are passed to the output
+ *
+ * Like glc_compress_submit() the caller compresses queued blocks while it
+ * waits, so this may be called from inside a job of the same pool.
+ * \param compress the stage
+ * \return 0 on success otherwise the first error which occured
+ */
+__PUBLIC int glc_compress_flush(glc_compress *compress);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
@@ -0,0 +1,355 @@
+/**
+ * \file src/server/convert.c
+ * \brief colour conversion stage
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_convert
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "convert.h"
+#include "delta.h"
+
+#define GLC_CONVERT_BAND 64
+
+typedef int32_t glc_convert_vec __attribute__ ((vector_size (32)));
+typedef u_int32_t glc_convert_uvec __attribute__ ((vector_size (32)));
+typedef unsigned char glc_convert_bytes __attribute__ ((vector_size (8)));
+
+struct glc_convert_stream_s {
+    glc_delta_stream_t head;
+    glc_video_format_t format;
+    unsigned int bpp;
+    unsigned int width, height;
+    /** bytes per source row */
+    size_t stride;
+    /** bytes of pixel data in a source frame and in a converted one */
+    size_t size, dst_size;
+};
+
+/** one frame, its bands are converted with glc_pool_for() */
+struct glc_convert_job_s {
+    glc_convert *convert;
+    const struct glc_convert_stream_s *stream;
+    const unsigned char *src;
+    unsigned char *dst;
+};
+
+struct glc_convert_s {
+    glc_pool *pool;
+    unsigned int band;
+    glc_convert_output output;
+    void *udata;
+    glc_delta_stream_t *streams;
+    glc_delta_scratch_t scratch;
+    /** converted frame with its header */
+    unsigned char *out;
+    size_t out_size;
+    /** two expanded rows of 3 byte pixels for each thread of a loop */
+    unsigned char *tmp;
+    size_t tmp_size;
+};
+
+static int glc_convert_format(glc_convert *convert, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_convert_frame(glc_convert *convert, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_convert_delta(glc_convert *convert, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_convert_run(glc_convert *convert, const struct glc_convert_stream_s *stream,
+                           const unsigned char *src, unsigned char *dst);
+static void glc_convert_band(void *arg, int band, int slot);
+static void glc_convert_expand(const struct glc_convert_stream_s *stream, const unsigned char *src,
+                               unsigned char *dst);
+static void glc_convert_rows(const unsigned char *r0, const unsigned char *r1, unsigned int width,
+                             unsigned char *y0, unsigned char *y1, unsigned char *cb, unsigned char *cr);
+
+int glc_convert_create(glc_convert **convert, glc_pool *pool, glc_convert_options *options,
+                       glc_convert_output output, void *udata) {
+    glc_convert *c = calloc(1, sizeof(*c));
+    if(!c)
+        return ENOMEM;
+
+    c->pool = pool;
+    c->band = options && options->band ? (options->band + 1) & ~1U : GLC_CONVERT_BAND;
+    c->output = output;
+    c->udata = udata;
+
+    *convert = c;
+    return 0;
+}
+
+int glc_convert_destroy(glc_convert *convert) {
+    glc_delta_stream_t *stream;
+
+    while((stream = convert->streams)) {
+        convert->streams = stream->next;
+        free(stream);
+    }
+
+    free(convert->scratch.data);
+    free(convert->out);
+    free(convert->tmp);
+    free(convert);
+    return 0;
+}
+
+int glc_convert_submit(glc_convert *convert, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    if(hdr->type == GLC_MESSAGE_VIDEO_FORMAT)
+        return glc_convert_format(convert, hdr, iov, count);
+    if(hdr->type == GLC_MESSAGE_VIDEO_FRAME)
+        return glc_convert_frame(convert, hdr, iov, count);
+    if(hdr->type == GLC_MESSAGE_VIDEO_DELTA)
+        return glc_convert_delta(convert, hdr, iov, count);
+    return convert->output(hdr, iov, count, convert->udata);
+}
+
+static int glc_convert_format(glc_convert *convert, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_convert_stream_s *stream;
+    glc_video_format_message_t format;
+    struct iovec format_iov;
+
+    if(glc_delta_read(iov, count, &format, sizeof(format)))
+        return convert->output(hdr, iov, count, convert->udata);
+
+    if(!(stream = (struct glc_convert_stream_s *) glc_delta_stream(&convert->streams, format.id,
+                                                                   sizeof(*stream), 1)))
+        return ENOMEM;
+
+    stream->size = 0;
+    if(glc_delta_geometry(&format, &stream->bpp, &stream->stride))
+        return convert->output(hdr, iov, count, convert->udata);
+
+    stream->format = format.format;
+    stream->width = format.width;
+    stream->height = format.height;
+    stream->size = stream->stride * stream->height;
+    stream->dst_size = (size_t) format.width * format.height +
+                       2 * (size_t) ((format.width + 1) / 2) * ((format.height + 1) / 2);
+
+    format.format = GLC_VIDEO_YCBCR_420JPEG;
+    format.flags &= ~GLC_VIDEO_DWORD_ALIGNED;
+    format_iov.iov_base = &format;
+    format_iov.iov_len = sizeof(format);
+    return convert->output(hdr, &format_iov, 1, convert->udata);
+}
+
+static int glc_convert_frame(glc_convert *convert, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_convert_stream_s *stream;
+    glc_video_frame_header_t frame;
+    const unsigned char *data;
+    struct iovec out_iov;
+    size_t size;
+    int err;
+
+    if(glc_delta_read(iov, count, &frame, sizeof(frame)))
+        return convert->output(hdr, iov, count, convert->udata);
+
+    stream = (struct glc_convert_stream_s *) glc_delta_stream(&convert->streams, frame.id, sizeof(*stream), 0);
+    if(!stream || !stream->size)
+        return convert->output(hdr, iov, count, convert->udata);
+
+    if((err = glc_delta_join(&convert->scratch, iov, count, &data, &size)))
+        return err;
+    if(size - sizeof(frame) != stream->size)
+        return convert->output(hdr, iov, count, convert->udata);
+
+    if(sizeof(frame) + stream->dst_size > convert->out_size) {
+        unsigned char *out = realloc(convert->out, sizeof(frame) + stream->dst_size);
+        if(!out)
+            return ENOMEM;
+        convert->out = out;
+        convert->out_size = sizeof(frame) + stream->dst_size;
+    }
+
+    if((err = glc_convert_run(convert, stream, &data[sizeof(frame)], &convert->out[sizeof(frame)])))
+        return err;
+
+    memcpy(convert->out, &frame, sizeof(frame));
+    out_iov.iov_base = convert->out;
+    out_iov.iov_len = sizeof(frame) + stream->dst_size;
+    return convert->output(hdr, &out_iov, 1, convert->udata);
+}
+
+/* the tiles of a delta are packed pixels, a reader could not apply them to the converted frames */
+static int glc_convert_delta(glc_convert *convert, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_convert_stream_s *stream;
+    glc_video_delta_header_t delta;
+
+    if(glc_delta_read(iov, count, &delta, sizeof(delta)))
+        return convert->output(hdr, iov, count, convert->udata);
+
+    stream = (struct glc_convert_stream_s *) glc_delta_stream(&convert->streams, delta.id, sizeof(*stream), 0);
+    if(stream && stream->size)
+        return ENOTSUP;
+    return convert->output(hdr, iov, count, convert->udata);
+}
+
+static int glc_convert_run(glc_convert *convert, const struct glc_convert_stream_s *stream,
+                           const unsigned char *src, unsigned char *dst) {
+    struct glc_convert_job_s job;
+    size_t tmp_size;
+
+    if(stream->bpp == 3) {
+        tmp_size = (size_t) stream->width * 8 * (glc_pool_threads(convert->pool) + 1);
+        if(tmp_size > convert->tmp_size) {
+            unsigned char *tmp = realloc(convert->tmp, tmp_size);
+            if(!tmp)
+                return ENOMEM;
+            convert->tmp = tmp;
+            convert->tmp_size = tmp_size;
+        }
+    }
+
+    job.convert = convert;
+    job.stream = stream;
+    job.src = src;
+    job.dst = dst;
+    return glc_pool_for(convert->pool, (stream->height + convert->band - 1) / convert->band,
+                        glc_convert_band, &job);
+}
+
+static void glc_convert_band(void *arg, int band, int slot) {
+    const struct glc_convert_job_s *job = arg;
+    const struct glc_convert_stream_s *stream = job->stream;
+    unsigned int width = stream->width, height = stream->height;
+    unsigned int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    unsigned int y = band * job->convert->band, end = y + job->convert->band;
+    unsigned char *cb_plane = &job->dst[(size_t) width * height], *cr_plane = &cb_plane[(size_t) cw * ch];
+    const unsigned char *r0, *r1;
+    unsigned char *y1, *tmp = NULL;
+
+    if(end > height)
+        end = height;
+    if(stream->bpp == 3)
+        tmp = &job->convert->tmp[(size_t) slot * width * 8];
+
+    for(; y < end; y += 2) {
+        /* last row first */
+        r0 = &job->src[(height - 1 - y) * stream->stride];
+        r1 = y + 1 < height ? &job->src[(height - 2 - y) * stream->stride] : r0;
+        y1 = y + 1 < height ? &job->dst[(size_t) (y + 1) * width] : NULL;
+
+        if(stream->bpp == 3) {
+            glc_convert_expand(stream, r0, tmp);
+            glc_convert_expand(stream, r1, &tmp[(size_t) width * 4]);
+            r0 = tmp;
+            r1 = &tmp[(size_t) width * 4];
+        }
+
+        glc_convert_rows(r0, r1, width, &job->dst[(size_t) y * width], y1,
+                         &cb_plane[(size_t) (y / 2) * cw], &cr_plane[(size_t) (y / 2) * cw]);
+    }
+}
+
+/* 3 byte pixels to BGRA, so there is only one kernel */
+static void glc_convert_expand(const struct glc_convert_stream_s *stream, const unsigned char *src,
+                               unsigned char *dst) {
+    unsigned int x;
+
+    if(stream->format == GLC_VIDEO_RGB) {
+        for(x = 0; x < stream->width; x++, src += 3, dst += 4) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst[3] = 0;
+        }
+    } else {
+        for(x = 0; x < stream->width; x++, src += 3, dst += 4) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = 0;
+        }
+    }
+}
+
+/**
+ * Converts two rows of BGRA pixels to two rows of Y and one row of Cb and
+ * Cr, 16 pixels at a time in 32 bit lanes. JPEG coefficients in 16 bit
+ * fixed point; chroma is taken from the sum of each 2x2 block.
+ */
+__attribute__ ((target_clones ("avx2", "default")))
+static void glc_convert_rows(const unsigned char *r0, const unsigned char *r1, unsigned int width,
+                             unsigned char *y0, unsigned char *y1, unsigned char *cb, unsigned char *cr) {
+    const glc_convert_vec even = {0, 2, 4, 6, 8, 10, 12, 14}, odd = {1, 3, 5, 7, 9, 11, 13, 15};
+    glc_convert_uvec p[4];
+    glc_convert_vec r[4], g[4], b[4], rs[2], gs[2], bs[2], r4, g4, b4, v;
+    glc_convert_bytes out;
+    unsigned int x, x1, i, sr, sg, sb;
+    const unsigned char *q[4];
+    int c;
+
+    for(x = 0; x + 16 <= width; x += 16) {
+        memcpy(&p[0], &r0[x * 4], sizeof(p[0]));
+        memcpy(&p[1], &r0[x * 4 + 32], sizeof(p[1]));
+        memcpy(&p[2], &r1[x * 4], sizeof(p[2]));
+        memcpy(&p[3], &r1[x * 4 + 32], sizeof(p[3]));
+
+        for(i = 0; i < 4; i++) {
+            b[i] = (glc_convert_vec) (p[i] & 0xff);
+            g[i] = (glc_convert_vec) ((p[i] >> 8) & 0xff);
+            r[i] = (glc_convert_vec) ((p[i] >> 16) & 0xff);
+        }
+
+        for(i = 0; i < 4; i++) {
+            if(i >= 2 && !y1)
+                break;
+            v = (19595 * r[i] + 38470 * g[i] + 7471 * b[i] + 32768) >> 16;
+            out = __builtin_convertvector(v, glc_convert_bytes);
+            memcpy(&(i < 2 ? y0 : y1)[x + (i & 1) * 8], &out, sizeof(out));
+        }
+
+        for(i = 0; i < 2; i++) {
+            rs[i] = r[i] + r[i + 2];
+            gs[i] = g[i] + g[i + 2];
+            bs[i] = b[i] + b[i + 2];
+        }
+        r4 = __builtin_shuffle(rs[0], rs[1], even) + __builtin_shuffle(rs[0], rs[1], odd);
+        g4 = __builtin_shuffle(gs[0], gs[1], even) + __builtin_shuffle(gs[0], gs[1], odd);
+        b4 = __builtin_shuffle(bs[0], bs[1], even) + __builtin_shuffle(bs[0], bs[1], odd);
+
+        v = (-11059 * r4 - 21709 * g4 + 32768 * b4 + (128 << 18) + (1 << 17)) >> 18;
+        v -= (v > 255) & (v - 255);
+        out = __builtin_convertvector(v, glc_convert_bytes);
+        memcpy(&cb[x / 2], &out, sizeof(out));
+
+        v = (32768 * r4 - 27439 * g4 - 5329 * b4 + (128 << 18) + (1 << 17)) >> 18;
+        v -= (v > 255) & (v - 255);
+        out = __builtin_convertvector(v, glc_convert_bytes);
+        memcpy(&cr[x / 2], &out, sizeof(out));
+    }
+
+    for(; x < width; x += 2) {
+        /* an odd last column counts twice */
+        x1 = x + 1 < width ? x + 1 : x;
+        q[0] = &r0[x * 4];
+        q[1] = &r0[x1 * 4];
+        q[2] = &r1[x * 4];
+        q[3] = &r1[x1 * 4];
+
+        y0[x] = (19595 * q[0][2] + 38470 * q[0][1] + 7471 * q[0][0] + 32768) >> 16;
+        if(x1 != x)
+            y0[x1] = (19595 * q[1][2] + 38470 * q[1][1] + 7471 * q[1][0] + 32768) >> 16;
+        if(y1) {
+            y1[x] = (19595 * q[2][2] + 38470 * q[2][1] + 7471 * q[2][0] + 32768) >> 16;
+            if(x1 != x)
+                y1[x1] = (19595 * q[3][2] + 38470 * q[3][1] + 7471 * q[3][0] + 32768) >> 16;
+        }
+
+        sr = q[0][2] + q[1][2] + q[2][2] + q[3][2];
+        sg = q[0][1] + q[1][1] + q[2][1] + q[3][1];
+        sb = q[0][0] + q[1][0] + q[2][0] + q[3][0];
+
+        c = (-11059 * (int) sr - 21709 * (int) sg + 32768 * (int) sb + (128 << 18) + (1 << 17)) >> 18;
+        cb[x / 2] = c > 255 ? 255 : c;
+        c = (32768 * (int) sr - 27439 * (int) sg - 5329 * (int) sb + (128 << 18) + (1 << 17)) >> 18;
+        cr[x / 2] = c > 255 ? 255 : c;
+    }
+}
+
+/**  \} */
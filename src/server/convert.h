@@ -0,0 +1,99 @@
+/**
+ * \file src/server/convert.h
+ * \brief colour conversion stage
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_convert colour conversion
+ *  The conversion stage turns BGRA, BGR and RGB video streams into planar
+ *  GLC_VIDEO_YCBCR_420JPEG: a full resolution Y plane followed by Cb and
+ *  Cr planes of half width and height (rounded up), full range JPEG
+ *  coefficients, top row first. This halves the bytes per frame before
+ *  compression and is what encoders take.
+ *
+ *  Frames are split into bands of rows which are converted on the worker
+ *  pool. The submitting thread converts bands too, so a stage fed from a
+ *  job of the same pool does not depend on free workers. The kernels
+ *  are built with GCC vector extensions for AVX2 and the SSE2 baseline
+ *  and picked at load time; pixels left over at the right edge are
+ *  converted with scalar code.
+ *
+ *  Video format messages of packed streams are passed on with the new
+ *  format, frames of other streams and all other messages unchanged, in
+ *  order. The stage goes in front of the compression and the
+ *  deduplication stage: delta frames of converted streams can not be
+ *  converted and are refused with ENOTSUP. It is not thread-safe, it is
+ *  fed by one thread at a time and calls the output from
+ *  glc_convert_submit().
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_CONVERT_H
+#define GLC2_SERVER_CONVERT_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "format.h"
+#include "pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_convert_s glc_convert;
+
+/**
+ * \brief receives the messages of a stage in submission order
+ * \param hdr message header
+ * \param iov payload segments, only valid during the call
+ * \param count number of segments
+ * \param udata data passed to glc_convert_create()
+ * \return 0 on success, an error is returned by the submit
+ */
+typedef int (*glc_convert_output)(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata);
+
+typedef struct glc_convert_options_s {
+    /** rows converted by one job, rounded up to an even number */
+    unsigned int band;
+} glc_convert_options;
+
+/**
+ * \brief create a conversion stage
+ * \param convert returned stage
+ * \param pool pool which converts the bands
+ * \param options options or NULL for defaults (64 row bands)
+ * \param output receives the messages
+ * \param udata data passed to output
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_convert_create(glc_convert **convert, glc_pool *pool, glc_convert_options *options,
+                                glc_convert_output output, void *udata);
+
+/**
+ * \brief destroy a stage
+ * \param convert the stage
+ * \return 0 on success
+ */
+__PUBLIC int glc_convert_destroy(glc_convert *convert);
+
+/**
+ * \brief submit a message
+ * \param convert the stage
+ * \param hdr message header
+ * \param iov payload segments
+ * \param count number of segments
+ * \return 0 on success, ENOTSUP for a delta frame of a converted stream,
+ *         otherwise an error code
+ */
+__PUBLIC int glc_convert_submit(glc_convert *convert, glc_message_header_t *hdr, const struct iovec *iov, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
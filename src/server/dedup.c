@@ -0,0 +1,446 @@
+/**
+ * \file src/server/dedup.c
+ * \brief identical frame detection
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_dedup
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "dedup.h"
+#include "delta.h"
+
+#define GLC_DEDUP_TILE 64
+#define GLC_DEDUP_KEYFRAME_INTERVAL 120
+/** planar frames are hashed in chunks of this many bytes */
+#define GLC_DEDUP_CHUNK (64 * 1024)
+/** spreads block positions over both halves of the key */
+#define GLC_DEDUP_PRIME 0x9e3779b97f4a7c15ULL
+
+typedef u_int64_t glc_dedup_vec __attribute__ ((vector_size (32)));
+
+struct glc_dedup_hash_s {
+    glc_dedup_vec acc;
+    u_int64_t len;
+};
+
+struct glc_dedup_stream_s {
+    glc_delta_stream_t head;
+    /** bytes per pixel, 0 if tiles are chunks of the frame */
+    unsigned int bpp;
+    unsigned int width, height;
+    /** bytes per row */
+    size_t stride;
+    /** bytes of pixel data in a frame */
+    size_t size;
+    int tiles_x, ntiles;
+    /** tile hashes of the previous frame and of the current one */
+    u_int64_t *hashes, *next;
+    /** pixels of the previous frame in delta mode, hashes are unused then */
+    unsigned char *prev;
+    /** frames since the last full frame */
+    unsigned int since_key;
+    int have_prev;
+};
+
+struct glc_dedup_s {
+    unsigned int tile;
+    int flags;
+    unsigned int keyframe_interval;
+    glc_dedup_output output;
+    void *udata;
+    glc_delta_stream_t *streams;
+    /** tile states of one row of tiles */
+    struct glc_dedup_hash_s *row;
+    int row_alloc;
+    glc_delta_scratch_t scratch;
+    /** changed tiles of a delta frame and their pixels */
+    u_int32_t *indices;
+    int indices_alloc;
+    unsigned char *tiles;
+    size_t tiles_size;
+    size_t repeats;
+};
+
+static const glc_dedup_vec glc_dedup_key = {0x9e3779b185ebca87ULL, 0xc2b2ae3d27d4eb4fULL,
+                                            0x165667b19e3779f9ULL, 0x27d4eb2f165667c5ULL};
+
+static int glc_dedup_format(glc_dedup *dedup, const glc_video_format_message_t *format);
+static int glc_dedup_frame(glc_dedup *dedup, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_dedup_delta(glc_dedup *dedup, struct glc_dedup_stream_s *stream, glc_message_header_t *hdr,
+                           const struct iovec *iov, int count, glc_video_frame_header_t *frame,
+                           const unsigned char *pixels);
+static int glc_dedup_repeat(glc_dedup *dedup, glc_video_frame_header_t *frame);
+static int glc_dedup_equal(const unsigned char *a, const unsigned char *b, size_t size);
+static void glc_dedup_hash_frame(glc_dedup *dedup, struct glc_dedup_stream_s *stream, const unsigned char *pixels);
+static void glc_dedup_hash_update(struct glc_dedup_hash_s *hash, const unsigned char *data, size_t size);
+static u_int64_t glc_dedup_hash_final(struct glc_dedup_hash_s *hash);
+
+int glc_dedup_create(glc_dedup **dedup, glc_dedup_options *options, glc_dedup_output output, void *udata) {
+    glc_dedup *d = calloc(1, sizeof(*d));
+    if(!d)
+        return ENOMEM;
+
+    d->tile = options && options->tile ? options->tile : GLC_DEDUP_TILE;
+    d->flags = options ? options->flags : 0;
+    d->keyframe_interval = options && options->keyframe_interval ? options->keyframe_interval
+                                                                 : GLC_DEDUP_KEYFRAME_INTERVAL;
+    d->output = output;
+    d->udata = udata;
+
+    *dedup = d;
+    return 0;
+}
+
+int glc_dedup_destroy(glc_dedup *dedup) {
+    struct glc_dedup_stream_s *stream;
+
+    while((stream = (struct glc_dedup_stream_s *) dedup->streams)) {
+        dedup->streams = stream->head.next;
+        free(stream->hashes);
+        free(stream->next);
+        free(stream->prev);
+        free(stream);
+    }
+
+    free(dedup->indices);
+    free(dedup->tiles);
+    free(dedup->row);
+    free(dedup->scratch.data);
+    free(dedup);
+    return 0;
+}
+
+int glc_dedup_submit(glc_dedup *dedup, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    glc_video_format_message_t format;
+    int err;
+
+    if(hdr->type == GLC_MESSAGE_VIDEO_FRAME)
+        return glc_dedup_frame(dedup, hdr, iov, count);
+
+    if(hdr->type == GLC_MESSAGE_VIDEO_FORMAT && !glc_delta_read(iov, count, &format, sizeof(format)) &&
+       (err = glc_dedup_format(dedup, &format)))
+        return err;
+
+    return dedup->output(hdr, iov, count, dedup->udata);
+}
+
+size_t glc_dedup_repeats(glc_dedup *dedup) {
+    return dedup->repeats;
+}
+
+static int glc_dedup_format(glc_dedup *dedup, const glc_video_format_message_t *format) {
+    struct glc_dedup_stream_s *stream;
+    struct glc_dedup_hash_s *row;
+    unsigned char *tiles;
+    u_int32_t *indices;
+    int tiles_y;
+
+    if(!(stream = (struct glc_dedup_stream_s *) glc_delta_stream(&dedup->streams, format->id, sizeof(*stream), 1)))
+        return ENOMEM;
+
+    free(stream->hashes);
+    free(stream->next);
+    free(stream->prev);
+    stream->hashes = stream->next = NULL;
+    stream->prev = NULL;
+    stream->ntiles = 0;
+    stream->have_prev = 0;
+
+    stream->width = format->width;
+    stream->height = format->height;
+    if(format->format == GLC_VIDEO_YCBCR_420JPEG) {
+        stream->bpp = 0;
+        stream->size = (size_t) format->width * format->height +
+                       2 * (size_t) ((format->width + 1) / 2) * ((format->height + 1) / 2);
+    } else if(glc_delta_geometry(format, &stream->bpp, &stream->stride)) {
+        /* unknown layout, frames are passed on */
+        return 0;
+    }
+
+    if(stream->bpp) {
+        stream->size = stream->stride * stream->height;
+
+        stream->tiles_x = (stream->width + dedup->tile - 1) / dedup->tile;
+        tiles_y = (stream->height + dedup->tile - 1) / dedup->tile;
+        stream->ntiles = stream->tiles_x * tiles_y;
+    } else {
+        stream->tiles_x = 1;
+        stream->ntiles = (stream->size + GLC_DEDUP_CHUNK - 1) / GLC_DEDUP_CHUNK;
+    }
+
+    if(!stream->ntiles)
+        return 0;
+
+    if((dedup->flags & GLC_DEDUP_DELTA) && stream->bpp) {
+        if(!(stream->prev = malloc(stream->size)))
+            goto nomem;
+
+        if(stream->ntiles > dedup->indices_alloc) {
+            if(!(indices = realloc(dedup->indices, stream->ntiles * sizeof(u_int32_t))))
+                goto nomem;
+            dedup->indices = indices;
+            dedup->indices_alloc = stream->ntiles;
+        }
+
+        /* a delta bigger than half a frame is sent as a full frame */
+        if(stream->size / 2 + stream->stride > dedup->tiles_size) {
+            if(!(tiles = realloc(dedup->tiles, stream->size / 2 + stream->stride)))
+                goto nomem;
+            dedup->tiles = tiles;
+            dedup->tiles_size = stream->size / 2 + stream->stride;
+        }
+
+        return 0;
+    }
+
+    stream->hashes = malloc(stream->ntiles * sizeof(u_int64_t));
+    stream->next = malloc(stream->ntiles * sizeof(u_int64_t));
+    if(!stream->hashes || !stream->next)
+        goto nomem;
+
+    if(stream->tiles_x > dedup->row_alloc) {
+        if(!(row = realloc(dedup->row, stream->tiles_x * sizeof(*row))))
+            goto nomem;
+        dedup->row = row;
+        dedup->row_alloc = stream->tiles_x;
+    }
+
+    return 0;
+
+nomem:
+    free(stream->hashes);
+    free(stream->next);
+    free(stream->prev);
+    stream->hashes = stream->next = NULL;
+    stream->prev = NULL;
+    stream->ntiles = 0;
+    return ENOMEM;
+}
+
+static int glc_dedup_frame(glc_dedup *dedup, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_dedup_stream_s *stream;
+    glc_video_frame_header_t frame;
+    const unsigned char *data;
+    size_t size;
+    u_int64_t *swap;
+    int err;
+
+    if(glc_delta_read(iov, count, &frame, sizeof(frame)))
+        return dedup->output(hdr, iov, count, dedup->udata);
+
+    stream = (struct glc_dedup_stream_s *) glc_delta_stream(&dedup->streams, frame.id, sizeof(*stream), 0);
+    if(!stream || !stream->ntiles)
+        return dedup->output(hdr, iov, count, dedup->udata);
+
+    if((err = glc_delta_join(&dedup->scratch, iov, count, &data, &size)))
+        return err;
+    if(size - sizeof(frame) != stream->size) {
+        stream->have_prev = 0;
+        return dedup->output(hdr, iov, count, dedup->udata);
+    }
+
+    if(stream->prev)
+        return glc_dedup_delta(dedup, stream, hdr, iov, count, &frame, &data[sizeof(frame)]);
+
+    glc_dedup_hash_frame(dedup, stream, &data[sizeof(frame)]);
+
+    if(stream->have_prev && !memcmp(stream->hashes, stream->next, stream->ntiles * sizeof(u_int64_t)))
+        return glc_dedup_repeat(dedup, &frame);
+
+    swap = stream->hashes;
+    stream->hashes = stream->next;
+    stream->next = swap;
+    stream->have_prev = 1;
+    return dedup->output(hdr, iov, count, dedup->udata);
+}
+
+/* compares tile by tile with the previous frame and sends the changed ones */
+static int glc_dedup_delta(glc_dedup *dedup, struct glc_dedup_stream_s *stream, glc_message_header_t *hdr,
+                           const struct iovec *iov, int count, glc_video_frame_header_t *frame,
+                           const unsigned char *pixels) {
+    glc_video_delta_header_t delta;
+    glc_message_header_t delta_hdr;
+    struct iovec delta_iov[3];
+    unsigned int x, y, ty, w, th, row;
+    size_t pos = 0, off, tile_bytes;
+    int tx, t = 0, n = 0;
+
+    if(!stream->have_prev || ++stream->since_key >= dedup->keyframe_interval)
+        goto key;
+
+    for(ty = 0; ty < stream->height; ty += dedup->tile) {
+        th = stream->height - ty < dedup->tile ? stream->height - ty : dedup->tile;
+
+        for(tx = 0, x = 0; tx < stream->tiles_x; tx++, x += dedup->tile, t++) {
+            w = stream->width - x < dedup->tile ? stream->width - x : dedup->tile;
+            tile_bytes = (size_t) w * stream->bpp;
+            off = ty * stream->stride + (size_t) x * stream->bpp;
+
+            for(row = 0; row < th; row++) {
+                if(!glc_dedup_equal(&pixels[off + row * stream->stride], &stream->prev[off + row * stream->stride],
+                                    tile_bytes))
+                    break;
+            }
+            if(row == th)
+                continue;
+
+            if(pos + tile_bytes * th > stream->size / 2)
+                goto key;
+
+            dedup->indices[n++] = t;
+            for(row = 0, y = ty; row < th; row++, y++) {
+                memcpy(&dedup->tiles[pos], &pixels[y * stream->stride + (size_t) x * stream->bpp], tile_bytes);
+                memcpy(&stream->prev[y * stream->stride + (size_t) x * stream->bpp], &dedup->tiles[pos], tile_bytes);
+                pos += tile_bytes;
+            }
+        }
+    }
+
+    if(!n)
+        return glc_dedup_repeat(dedup, frame);
+
+    delta.id = frame->id;
+    delta.time = frame->time;
+    delta.tile = dedup->tile;
+    delta.count = n;
+    delta_hdr.type = GLC_MESSAGE_VIDEO_DELTA;
+    delta_iov[0].iov_base = &delta;
+    delta_iov[0].iov_len = sizeof(delta);
+    delta_iov[1].iov_base = dedup->indices;
+    delta_iov[1].iov_len = n * sizeof(u_int32_t);
+    delta_iov[2].iov_base = dedup->tiles;
+    delta_iov[2].iov_len = pos;
+    return dedup->output(&delta_hdr, delta_iov, 3, dedup->udata);
+
+key:
+    /* too much changed or the stream needs a point to start decoding from */
+    memcpy(stream->prev, pixels, stream->size);
+    stream->since_key = 0;
+    stream->have_prev = 1;
+    return dedup->output(hdr, iov, count, dedup->udata);
+}
+
+static int glc_dedup_repeat(glc_dedup *dedup, glc_video_frame_header_t *frame) {
+    glc_video_repeat_message_t repeat;
+    glc_message_header_t hdr;
+    struct iovec iov;
+
+    dedup->repeats++;
+    repeat.id = frame->id;
+    repeat.time = frame->time;
+    hdr.type = GLC_MESSAGE_VIDEO_REPEAT;
+    iov.iov_base = &repeat;
+    iov.iov_len = sizeof(repeat);
+    return dedup->output(&hdr, &iov, 1, dedup->udata);
+}
+
+/* hashes row by row, so the frame is read once and in order */
+static void glc_dedup_hash_frame(glc_dedup *dedup, struct glc_dedup_stream_s *stream, const unsigned char *pixels) {
+    struct glc_dedup_hash_s *row = dedup->row;
+    unsigned int y, ty, x, w, th;
+    size_t tile_bytes = (size_t) dedup->tile * stream->bpp, pos;
+    int tx, t = 0;
+
+    if(!stream->bpp) {
+        for(pos = 0; pos < stream->size; pos += GLC_DEDUP_CHUNK) {
+            memset(row, 0, sizeof(*row));
+            glc_dedup_hash_update(row, &pixels[pos],
+                                  stream->size - pos < GLC_DEDUP_CHUNK ? stream->size - pos : GLC_DEDUP_CHUNK);
+            stream->next[t++] = glc_dedup_hash_final(row);
+        }
+        return;
+    }
+
+    for(ty = 0; ty < stream->height; ty += dedup->tile) {
+        memset(row, 0, stream->tiles_x * sizeof(*row));
+        th = stream->height - ty < dedup->tile ? stream->height - ty : dedup->tile;
+
+        for(y = ty; y < ty + th; y++) {
+            for(tx = 0, x = 0; tx < stream->tiles_x; tx++, x += dedup->tile) {
+                w = stream->width - x < dedup->tile ? stream->width - x : dedup->tile;
+                glc_dedup_hash_update(&row[tx], &pixels[y * stream->stride + tx * tile_bytes], w * stream->bpp);
+            }
+        }
+
+        for(tx = 0; tx < stream->tiles_x; tx++)
+            stream->next[t++] = glc_dedup_hash_final(&row[tx]);
+    }
+}
+
+/**
+ * Four lanes of 32x32->64 bit multiplies over 32 byte blocks, like
+ * xxh3. The compiler vectorizes it; the AVX2 clone is picked at load
+ * time if the cpu has it, SSE2 otherwise.
+ *
+ * The sum alone would not depend on where a block is, so a tile with
+ * two blocks swapped, e.g. a cursor moved by a row, would hash the same.
+ * Like the sliding secret of xxh3 the key differs per block: it is
+ * offset by the block's position in the hashed bytes.
+ */
+__attribute__ ((target_clones ("avx2", "default")))
+static void glc_dedup_hash_update(struct glc_dedup_hash_s *hash, const unsigned char *data, size_t size) {
+    glc_dedup_vec acc = hash->acc, x, k, key;
+    const glc_dedup_vec swap = {1, 0, 3, 2};
+    unsigned char tail[32];
+    size_t i;
+
+    for(i = 0; i + 32 <= size; i += 32) {
+        memcpy(&x, &data[i], sizeof(x));
+        key = glc_dedup_key + (hash->len + i) * GLC_DEDUP_PRIME;
+        k = x ^ key;
+        acc += __builtin_shuffle(x, swap) + (k & 0xffffffff) * (k >> 32);
+    }
+
+    if(i < size) {
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, &data[i], size - i);
+        memcpy(&x, tail, sizeof(x));
+        key = glc_dedup_key + (hash->len + i) * GLC_DEDUP_PRIME;
+        k = x ^ key;
+        acc += __builtin_shuffle(x, swap) + (k & 0xffffffff) * (k >> 32);
+    }
+
+    hash->acc = acc;
+    hash->len += size;
+}
+
+__attribute__ ((target_clones ("avx2", "default")))
+static int glc_dedup_equal(const unsigned char *a, const unsigned char *b, size_t size) {
+    glc_dedup_vec x, y, diff = {0, 0, 0, 0};
+    size_t i;
+
+    for(i = 0; i + 32 <= size; i += 32) {
+        memcpy(&x, &a[i], sizeof(x));
+        memcpy(&y, &b[i], sizeof(y));
+        diff |= x ^ y;
+    }
+
+    return !(diff[0] | diff[1] | diff[2] | diff[3]) && !memcmp(&a[i], &b[i], size - i);
+}
+
+static u_int64_t glc_dedup_hash_final(struct glc_dedup_hash_s *hash) {
+    u_int64_t h = hash->len * 0x9e3779b185ebca87ULL;
+    int i;
+
+    for(i = 0; i < 4; i++) {
+        h ^= hash->acc[i] + i;
+        /* murmur3 finalizer */
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+    }
+
+    return h;
+}
+
+/**  \} */
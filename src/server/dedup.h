@@ -0,0 +1,112 @@
+/**
+ * \file src/server/dedup.h
+ * \brief identical frame detection
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_dedup frame deduplication
+ *  Menus, loading screens and paused games send the same picture over
+ *  and over. The deduplication stage splits every video frame into tiles
+ *  and hashes each tile with a vectorized 64 bit hash (AVX2 if the cpu
+ *  has it). A frame whose tile hashes all equal those of the previous
+ *  frame of its stream is replaced by a GLC_MESSAGE_VIDEO_REPEAT message,
+ *  which carries only the stream and the time.
+ *
+ *  With GLC_DEDUP_DELTA the stage keeps a copy of the previous frame of
+ *  each stream in a packed format instead. It compares every tile with
+ *  that copy and sends only the changed tiles as a
+ *  GLC_MESSAGE_VIDEO_DELTA message, see glc_delta_apply(). Frames where
+ *  more than half of the data changed are sent in full, as is every
+ *  keyframe_interval-th frame, so readers can start decoding there.
+ *
+ *  The stage learns frame geometry from GLC_MESSAGE_VIDEO_FORMAT
+ *  messages; frames of a stream without a format and frames which do not
+ *  match their format are passed on unchanged. All other messages are
+ *  passed on unchanged, in order.
+ *
+ *  The stage has to see uncompressed frames, so it goes in front of the
+ *  compression stage. It is not thread-safe, it is fed by one thread at a
+ *  time and calls the output from glc_dedup_submit().
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_DEDUP_H
+#define GLC2_SERVER_DEDUP_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_dedup_s glc_dedup;
+
+/**
+ * \brief receives the messages of a stage in submission order
+ * \param hdr message header
+ * \param iov payload segments, only valid during the call
+ * \param count number of segments
+ * \param udata data passed to glc_dedup_create()
+ * \return 0 on success, an error is returned by the submit
+ */
+typedef int (*glc_dedup_output)(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata);
+
+/** send changed tiles of frames in packed formats as delta frames */
+#define GLC_DEDUP_DELTA 0x1
+
+typedef struct glc_dedup_options_s {
+    /** edge length of a tile in pixels */
+    unsigned int tile;
+    /** GLC_DEDUP_* flags */
+    int flags;
+    /** a full frame at least every this many frames in delta mode */
+    unsigned int keyframe_interval;
+} glc_dedup_options;
+
+/**
+ * \brief create a deduplication stage
+ * \param dedup returned stage
+ * \param options options or NULL for defaults (64 pixel tiles, no
+ *        deltas, a full frame every 120 frames)
+ * \param output receives the messages
+ * \param udata data passed to output
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_dedup_create(glc_dedup **dedup, glc_dedup_options *options, glc_dedup_output output, void *udata);
+
+/**
+ * \brief destroy a stage
+ * \param dedup the stage
+ * \return 0 on success
+ */
+__PUBLIC int glc_dedup_destroy(glc_dedup *dedup);
+
+/**
+ * \brief submit a message
+ * \param dedup the stage
+ * \param hdr message header
+ * \param iov payload segments
+ * \param count number of segments
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_dedup_submit(glc_dedup *dedup, glc_message_header_t *hdr, const struct iovec *iov, int count);
+
+/**
+ * \brief number of frames replaced by repeat messages
+ * \param dedup the stage
+ * \return replaced frames since creation
+ */
+__PUBLIC size_t glc_dedup_repeats(glc_dedup *dedup);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
@@ -0,0 +1,184 @@
+/**
+ * \file src/server/indexer.c
+ * \brief stream file index writer
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_indexer
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "indexer.h"
+
+#define GLC_INDEXER_INTERVAL ((glc_utime_t) 1000000)
+
+struct glc_indexer_s {
+    glc_index_entry_t *entries;
+    size_t count, size;
+    /** newest time reported */
+    glc_utime_t time;
+
+    /** sidecar, fd is -1 without one */
+    char *sidecar;
+    int fd;
+    glc_utime_t interval;
+    /** entries in the sidecar and the time they were appended */
+    size_t synced;
+    glc_utime_t synced_time;
+};
+
+static int glc_indexer_write(int fd, const void *data, size_t size);
+static int glc_indexer_sync(glc_indexer *indexer);
+
+int glc_indexer_create(glc_indexer **indexer, const char *sidecar, glc_utime_t interval) {
+    glc_index_footer_t header;
+    glc_indexer *ix;
+    int err;
+
+    if(!(ix = calloc(1, sizeof(*ix))))
+        return ENOMEM;
+
+    ix->fd = -1;
+    ix->interval = interval ? interval : GLC_INDEXER_INTERVAL;
+
+    if(sidecar) {
+        if(!(ix->sidecar = strdup(sidecar))) {
+            err = ENOMEM;
+            goto error;
+        }
+
+        if((ix->fd = open(sidecar, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+            err = errno;
+            goto error;
+        }
+
+        memset(&header, 0, sizeof(header));
+        header.version = GLC_INDEX_VERSION;
+        header.signature = GLC_INDEX_SIGNATURE;
+        if((err = glc_indexer_write(ix->fd, &header, sizeof(header)))) {
+            close(ix->fd);
+            unlink(sidecar);
+            goto error;
+        }
+    }
+
+    *indexer = ix;
+    return 0;
+
+error:
+    free(ix->sidecar);
+    free(ix);
+    return err;
+}
+
+void glc_indexer_destroy(glc_indexer *indexer) {
+    if(indexer->fd != -1) {
+        close(indexer->fd);
+        unlink(indexer->sidecar);
+    }
+
+    free(indexer->sidecar);
+    free(indexer->entries);
+    free(indexer);
+}
+
+int glc_indexer_add(glc_indexer *indexer, u_int64_t offset, glc_message_type_t type,
+                    glc_stream_id_t id, glc_utime_t time) {
+    glc_index_entry_t *entry;
+
+    /* times must not decrease for binary searches, late messages get the newest time */
+    if(time > indexer->time)
+        indexer->time = time;
+
+    switch(type) {
+    case GLC_MESSAGE_VIDEO_FORMAT:
+    case GLC_MESSAGE_AUDIO_FORMAT:
+    case GLC_MESSAGE_COLOR:
+    case GLC_MESSAGE_VIDEO_FRAME:
+    case GLC_MESSAGE_AUDIO_DATA:
+        break;
+    default:
+        return 0;
+    }
+
+    if(indexer->count == indexer->size) {
+        size_t size = indexer->size ? indexer->size * 2 : 1024;
+        glc_index_entry_t *entries = realloc(indexer->entries, size * sizeof(*entries));
+        if(!entries)
+            return ENOMEM;
+        indexer->entries = entries;
+        indexer->size = size;
+    }
+
+    entry = &indexer->entries[indexer->count++];
+    entry->time = indexer->time;
+    entry->offset = offset;
+    entry->id = id;
+    entry->type = type;
+
+    if(indexer->fd != -1 && indexer->time - indexer->synced_time >= indexer->interval)
+        return glc_indexer_sync(indexer);
+    return 0;
+}
+
+int glc_indexer_finish(glc_indexer *indexer, glc_writer *writer) {
+    glc_index_footer_t footer;
+    int err;
+
+    footer.offset = glc_writer_size(writer);
+    footer.count = indexer->count;
+    footer.version = GLC_INDEX_VERSION;
+    footer.signature = GLC_INDEX_SIGNATURE;
+
+    if((err = glc_writer_write(writer, indexer->entries, indexer->count * sizeof(glc_index_entry_t))) ||
+       (err = glc_writer_write(writer, &footer, sizeof(footer))))
+        return err;
+
+    /* the file is complete once the writer is destroyed, the sidecar may go now already */
+    if(indexer->fd != -1) {
+        close(indexer->fd);
+        unlink(indexer->sidecar);
+        indexer->fd = -1;
+    }
+
+    return 0;
+}
+
+static int glc_indexer_write(int fd, const void *data, size_t size) {
+    const unsigned char *p = data;
+    ssize_t ret;
+
+    while(size) {
+        if((ret = write(fd, p, size)) == -1) {
+            if(errno == EINTR)
+                continue;
+            return errno;
+        }
+        p += ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+static int glc_indexer_sync(glc_indexer *indexer) {
+    int err;
+
+    if((err = glc_indexer_write(indexer->fd, &indexer->entries[indexer->synced],
+                                (indexer->count - indexer->synced) * sizeof(glc_index_entry_t))))
+        return err;
+
+    indexer->synced = indexer->count;
+    indexer->synced_time = indexer->time;
+    return 0;
+}
+
+/**  \} */
@@ -0,0 +1,82 @@
+/**
+ * \file src/server/indexer.h
+ * \brief stream file index writer
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_indexer index writer
+ *  An indexer collects glc_index_entry_t entries while a stream file is
+ *  written and appends them as the trailing index once the close
+ *  message is written, see glc_index_footer_t. The writer of the file
+ *  reports the offset of every message with glc_indexer_add() before it
+ *  writes it; the indexer keeps only the messages worth seeking to.
+ *
+ *  Files which are written over a long time get a sidecar file. The
+ *  pending entries are appended to it whenever interval microseconds
+ *  of stream time passed, so a file whose writer crashed can still be
+ *  seeked in. The sidecar is removed by glc_indexer_finish() and
+ *  glc_indexer_destroy().
+ *
+ *  An indexer is not thread-safe, it belongs to the writer of one file.
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_INDEXER_H
+#define GLC2_SERVER_INDEXER_H
+
+#include "format.h"
+#include "writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_indexer_s glc_indexer;
+
+/**
+ * \brief create an indexer
+ * \param indexer returned indexer
+ * \param sidecar path of the sidecar file (the stream file's path plus
+ *        ".idx") or NULL for none
+ * \param interval microseconds of stream time between sidecar appends,
+ *        0 for one second
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_indexer_create(glc_indexer **indexer, const char *sidecar, glc_utime_t interval);
+
+/**
+ * \brief destroy an indexer and remove its sidecar
+ * \param indexer the indexer
+ */
+__PUBLIC void glc_indexer_destroy(glc_indexer *indexer);
+
+/**
+ * \brief report a message of the stream file
+ * \param indexer the indexer
+ * \param offset file offset of the size in front of the message
+ * \param type message type, of the original message if it is compressed
+ * \param id stream identifier
+ * \param time message time, 0 for messages without a time
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_indexer_add(glc_indexer *indexer, u_int64_t offset, glc_message_type_t type,
+                             glc_stream_id_t id, glc_utime_t time);
+
+/**
+ * \brief write the trailing index and remove the sidecar
+ * \note call after writing the close message
+ * \param indexer the indexer
+ * \param writer writer of the stream file
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_indexer_finish(glc_indexer *indexer, glc_writer *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
@@ -0,0 +1,406 @@
+/**
+ * \file src/server/loop.c
+ * \brief event loop
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_loop
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+#include "loop.h"
+
+#define GLC_LOOP_MAX_EVENTS 32
+
+struct glc_loop_fd_s {
+    int fd;
+    int removed;
+    glc_loop_fd_callback callback;
+    void *udata;
+    struct glc_loop_fd_s *next;
+};
+
+struct glc_loop_ring_s {
+    ps_buffer_t *buffer;
+    int removed;
+    glc_loop_ring_callback callback;
+    void *udata;
+    struct glc_loop_ring_s *next;
+};
+
+struct glc_loop_s {
+    int epfd;
+    /** eventfd signalled by the ring waiter and glc_loop_stop() */
+    int wakefd;
+    volatile sig_atomic_t running;
+
+    struct glc_loop_fd_s *fds;
+    struct glc_loop_ring_s *rings;
+    int nrings;
+    /** removed entries, freed after the current iteration */
+    struct glc_loop_fd_s *dead_fds;
+    struct glc_loop_ring_s *dead_rings;
+
+    pthread_t waiter;
+    /** protects rings, gen, waiter_gen, armed and stop */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    /** changed to interrupt ps_buffer_wait_any() in the waiter */
+    uint32_t kick;
+    /** bumped whenever the set of rings changes */
+    unsigned int gen;
+    /** generation of the ring set the waiter currently uses */
+    unsigned int waiter_gen;
+    /** loop has drained all rings and wants to be woken again */
+    int armed;
+    int stop;
+};
+
+static void *glc_loop_waiter(void *arg);
+static void glc_loop_kick(glc_loop *loop);
+static void glc_loop_reap(glc_loop *loop);
+static int glc_loop_dispatch_rings(glc_loop *loop, int *more);
+
+int glc_loop_create(glc_loop **loop) {
+    int err = 0;
+    glc_loop *l = calloc(1, sizeof(*l));
+    if(!l)
+        return ENOMEM;
+
+    l->epfd = -1;
+    l->wakefd = -1;
+    l->armed = 1;
+
+    if((l->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        err = errno;
+        goto error;
+    }
+
+    if((l->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        err = errno;
+        goto error;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if(epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->wakefd, &ev)) {
+        err = errno;
+        goto error;
+    }
+
+    pthread_mutex_init(&l->mutex, NULL);
+    pthread_cond_init(&l->cond, NULL);
+
+    if((err = pthread_create(&l->waiter, NULL, glc_loop_waiter, l))) {
+        pthread_cond_destroy(&l->cond);
+        pthread_mutex_destroy(&l->mutex);
+        goto error;
+    }
+
+    *loop = l;
+    return 0;
+
+error:
+    if(l->wakefd != -1)
+        close(l->wakefd);
+    if(l->epfd != -1)
+        close(l->epfd);
+    free(l);
+    return err;
+}
+
+void glc_loop_destroy(glc_loop *loop) {
+    struct glc_loop_fd_s *f;
+    struct glc_loop_ring_s *r;
+
+    pthread_mutex_lock(&loop->mutex);
+    loop->stop = 1;
+    glc_loop_kick(loop);
+    pthread_cond_broadcast(&loop->cond);
+    pthread_mutex_unlock(&loop->mutex);
+    pthread_join(loop->waiter, NULL);
+
+    glc_loop_reap(loop);
+    while((f = loop->fds)) {
+        loop->fds = f->next;
+        free(f);
+    }
+    while((r = loop->rings)) {
+        loop->rings = r->next;
+        free(r);
+    }
+
+    pthread_cond_destroy(&loop->cond);
+    pthread_mutex_destroy(&loop->mutex);
+    close(loop->wakefd);
+    close(loop->epfd);
+    free(loop);
+}
+
+int glc_loop_add_fd(glc_loop *loop, int fd, uint32_t events, glc_loop_fd_callback callback, void *udata) {
+    struct glc_loop_fd_s *f = malloc(sizeof(*f));
+    if(!f)
+        return ENOMEM;
+
+    f->fd = fd;
+    f->removed = 0;
+    f->callback = callback;
+    f->udata = udata;
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = f;
+    if(epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+        free(f);
+        return errno;
+    }
+
+    f->next = loop->fds;
+    loop->fds = f;
+    return 0;
+}
+
+int glc_loop_del_fd(glc_loop *loop, int fd) {
+    struct glc_loop_fd_s **f = &loop->fds, *del;
+    while(*f) {
+        if((*f)->fd == fd) {
+            del = *f;
+            *f = del->next;
+
+            epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+            del->removed = 1;
+            del->next = loop->dead_fds;
+            loop->dead_fds = del;
+            return 0;
+        }
+        f = &(*f)->next;
+    }
+    return EINVAL;
+}
+
+int glc_loop_add_ring(glc_loop *loop, ps_buffer_t *buffer, glc_loop_ring_callback callback, void *udata) {
+    struct glc_loop_ring_s *r = malloc(sizeof(*r));
+    if(!r)
+        return ENOMEM;
+
+    r->buffer = buffer;
+    r->removed = 0;
+    r->callback = callback;
+    r->udata = udata;
+
+    pthread_mutex_lock(&loop->mutex);
+    if(loop->nrings >= PS_WAIT_ANY_MAX) {
+        pthread_mutex_unlock(&loop->mutex);
+        free(r);
+        return ENOSPC;
+    }
+
+    r->next = loop->rings;
+    loop->rings = r;
+    loop->nrings++;
+    loop->gen++;
+    glc_loop_kick(loop);
+    pthread_cond_broadcast(&loop->cond);
+    pthread_mutex_unlock(&loop->mutex);
+
+    return 0;
+}
+
+int glc_loop_del_ring(glc_loop *loop, ps_buffer_t *buffer) {
+    struct glc_loop_ring_s **r, *del = NULL;
+
+    pthread_mutex_lock(&loop->mutex);
+    for(r = &loop->rings; *r; r = &(*r)->next) {
+        if((*r)->buffer == buffer) {
+            del = *r;
+            *r = del->next;
+            break;
+        }
+    }
+
+    if(!del) {
+        pthread_mutex_unlock(&loop->mutex);
+        return EINVAL;
+    }
+
+    loop->nrings--;
+    loop->gen++;
+    glc_loop_kick(loop);
+    pthread_cond_broadcast(&loop->cond);
+
+    /* wait until the waiter dropped its reference to the buffer */
+    while(loop->waiter_gen != loop->gen && !loop->stop)
+        pthread_cond_wait(&loop->cond, &loop->mutex);
+    pthread_mutex_unlock(&loop->mutex);
+
+    del->removed = 1;
+    del->next = loop->dead_rings;
+    loop->dead_rings = del;
+    return 0;
+}
+
+int glc_loop_run(glc_loop *loop) {
+    struct epoll_event events[GLC_LOOP_MAX_EVENTS];
+    struct glc_loop_fd_s *f;
+    uint64_t val;
+    int n, i, err = 0, more = 0;
+
+    loop->running = 1;
+    while(loop->running) {
+        n = epoll_wait(loop->epfd, events, GLC_LOOP_MAX_EVENTS, more ? 0 : -1);
+        if(n == -1) {
+            if(errno == EINTR)
+                continue;
+            err = errno;
+            break;
+        }
+
+        for(i = 0; i < n; i++) {
+            f = events[i].data.ptr;
+            if(!f) {
+                if(read(loop->wakefd, &val, sizeof(val)) == sizeof(val))
+                    more = 1;
+                continue;
+            }
+
+            if(f->removed)
+                continue;
+
+            if((err = f->callback(loop, f->fd, events[i].events, f->udata)))
+                goto end;
+        }
+
+        if(more && loop->running) {
+            if((err = glc_loop_dispatch_rings(loop, &more)))
+                goto end;
+
+            if(!more) {
+                pthread_mutex_lock(&loop->mutex);
+                loop->armed = 1;
+                pthread_cond_broadcast(&loop->cond);
+                pthread_mutex_unlock(&loop->mutex);
+            }
+        }
+
+        glc_loop_reap(loop);
+    }
+
+end:
+    glc_loop_reap(loop);
+    loop->running = 0;
+    return err;
+}
+
+void glc_loop_stop(glc_loop *loop) {
+    uint64_t val = 1;
+    loop->running = 0;
+    if(write(loop->wakefd, &val, sizeof(val)) != sizeof(val)) {
+        /* counter is saturated, loop wakes up anyway */
+    }
+}
+
+static int glc_loop_dispatch_rings(glc_loop *loop, int *more) {
+    struct glc_loop_ring_s *r, *next;
+    int err, pending;
+
+    *more = 0;
+    for(r = loop->rings; r; r = next) {
+        next = r->next;
+        if(r->removed)
+            continue;
+
+        if(ps_buffer_pending(r->buffer, &pending) || pending <= 0)
+            continue;
+
+        err = r->callback(loop, r->buffer, r->udata);
+        if(err == EAGAIN)
+            *more = 1;
+        else if(err)
+            return err;
+    }
+
+    return 0;
+}
+
+static void glc_loop_kick(glc_loop *loop) {
+    __atomic_add_fetch(&loop->kick, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &loop->kick, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL, NULL, 0);
+}
+
+static void glc_loop_reap(glc_loop *loop) {
+    struct glc_loop_fd_s *f;
+    struct glc_loop_ring_s *r;
+
+    while((f = loop->dead_fds)) {
+        loop->dead_fds = f->next;
+        free(f);
+    }
+    while((r = loop->dead_rings)) {
+        loop->dead_rings = r->next;
+        free(r);
+    }
+}
+
+static void *glc_loop_waiter(void *arg) {
+    glc_loop *loop = arg;
+    ps_buffer_t *buffers[PS_WAIT_ANY_MAX];
+    struct glc_loop_ring_s *r;
+    unsigned int gen;
+    uint32_t kick;
+    uint64_t val = 1;
+    int count, i, pending, ready;
+
+    pthread_mutex_lock(&loop->mutex);
+    while(!loop->stop) {
+        count = 0;
+        for(r = loop->rings; r && count < PS_WAIT_ANY_MAX; r = r->next)
+            buffers[count++] = r->buffer;
+
+        gen = loop->gen;
+        kick = __atomic_load_n(&loop->kick, __ATOMIC_SEQ_CST);
+        loop->waiter_gen = gen;
+        pthread_cond_broadcast(&loop->cond);
+        pthread_mutex_unlock(&loop->mutex);
+
+        ps_buffer_wait_any(buffers, count, &loop->kick, kick, -1);
+
+        /* buffers stay valid until we pick up a new generation */
+        ready = 0;
+        for(i = 0; i < count && !ready; i++) {
+            if(!ps_buffer_pending(buffers[i], &pending) && pending > 0)
+                ready = 1;
+        }
+
+        pthread_mutex_lock(&loop->mutex);
+        if(ready && gen == loop->gen && !loop->stop) {
+            loop->armed = 0;
+            if(write(loop->wakefd, &val, sizeof(val)) != sizeof(val)) {
+                /* counter is saturated, loop wakes up anyway */
+            }
+
+            while(!loop->armed && !loop->stop && gen == loop->gen)
+                pthread_cond_wait(&loop->cond, &loop->mutex);
+        }
+    }
+
+    loop->waiter_gen = loop->gen;
+    pthread_cond_broadcast(&loop->cond);
+    pthread_mutex_unlock(&loop->mutex);
+
+    return NULL;
+}
+
+/**  \} */
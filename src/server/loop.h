@@ -0,0 +1,129 @@
+/**
+ * \file src/server/loop.h
+ * \brief event loop
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_loop event loop
+ *  The event loop waits on file descriptors with epoll and on any number
+ *  of packetstream buffers at once. Buffers have no file descriptor, so a
+ *  single helper thread sleeps in ps_buffer_wait_any() on all of them and
+ *  signals an eventfd in the epoll set when one has packets. All callbacks
+ *  run on the thread which calls glc_loop_run().
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_LOOP_H
+#define GLC2_SERVER_LOOP_H
+
+#include <stdint.h>
+
+#include "packetstream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_loop_s glc_loop;
+
+/**
+ * \brief called when a file descriptor is ready
+ * \param loop the loop
+ * \param fd the file descriptor
+ * \param events epoll events which occured
+ * \param udata data passed to glc_loop_add_fd()
+ * \return 0 on success, an error code stops the loop
+ */
+typedef int (*glc_loop_fd_callback)(glc_loop *loop, int fd, uint32_t events, void *udata);
+
+/**
+ * \brief called when a buffer has packets to read
+ *
+ * The callback should read packets with PS_PACKET_TRY. It returns EAGAIN
+ * if it stopped before the buffer was empty (e.g. to be fair to other
+ * buffers) and will be called again in the next iteration.
+ * \param loop the loop
+ * \param buffer the buffer
+ * \param udata data passed to glc_loop_add_ring()
+ * \return 0 or EAGAIN on success, any other error code stops the loop
+ */
+typedef int (*glc_loop_ring_callback)(glc_loop *loop, ps_buffer_t *buffer, void *udata);
+
+/**
+ * \brief create an event loop and start its ring waiter thread
+ * \param loop returned loop
+ * \return 0 on success otherwise an error code
+ */
+int glc_loop_create(glc_loop **loop);
+
+/**
+ * \brief destroy an event loop
+ * \param loop the loop, must not be running
+ */
+void glc_loop_destroy(glc_loop *loop);
+
+/**
+ * \brief watch a file descriptor
+ * \param loop the loop
+ * \param fd the file descriptor
+ * \param events epoll events to wait for
+ * \param callback called when fd is ready
+ * \param udata data passed to the callback
+ * \return 0 on success otherwise an error code
+ */
+int glc_loop_add_fd(glc_loop *loop, int fd, uint32_t events, glc_loop_fd_callback callback, void *udata);
+
+/**
+ * \brief stop watching a file descriptor
+ * \note safe to call from inside a callback
+ * \param loop the loop
+ * \param fd the file descriptor
+ * \return 0 on success or EINVAL if fd is not watched
+ */
+int glc_loop_del_fd(glc_loop *loop, int fd);
+
+/**
+ * \brief watch a buffer for packets to read
+ * \param loop the loop
+ * \param buffer the buffer
+ * \param callback called when buffer has packets
+ * \param udata data passed to the callback
+ * \return 0 on success, ENOSPC if PS_WAIT_ANY_MAX buffers are watched
+ */
+int glc_loop_add_ring(glc_loop *loop, ps_buffer_t *buffer, glc_loop_ring_callback callback, void *udata);
+
+/**
+ * \brief stop watching a buffer
+ *
+ * When this returns the ring waiter thread no longer references the
+ * buffer, so it can be destroyed.
+ * \note safe to call from inside a callback
+ * \param loop the loop
+ * \param buffer the buffer
+ * \return 0 on success or EINVAL if buffer is not watched
+ */
+int glc_loop_del_ring(glc_loop *loop, ps_buffer_t *buffer);
+
+/**
+ * \brief run the loop until glc_loop_stop() is called or a callback fails
+ * \param loop the loop
+ * \return 0 if stopped otherwise the error code of the failed callback
+ */
+int glc_loop_run(glc_loop *loop);
+
+/**
+ * \brief make glc_loop_run() return
+ * \note this is async-signal-safe
+ * \param loop the loop
+ */
+void glc_loop_stop(glc_loop *loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
@@ -0,0 +1,291 @@
+/**
+ * \file src/server/mux.c
+ * \brief timestamp ordering muxer
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_mux
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mux.h"
+
+#define GLC_MUX_WINDOW 200000
+#define GLC_MUX_MAX_SIZE (64 * 1024 * 1024)
+
+struct glc_mux_msg_s {
+    /** ordering key, the timestamp or the time of the message it follows */
+    glc_utime_t time;
+    /** submission order among equal times */
+    unsigned long long seq;
+    glc_message_header_t header;
+    unsigned char *data;
+    size_t size;
+};
+
+struct glc_mux_stream_s {
+    glc_stream_id_t id;
+    /** time of the stream's newest timed message */
+    glc_utime_t time;
+    struct glc_mux_stream_s *next;
+};
+
+struct glc_mux_s {
+    glc_mux_options options;
+    glc_mux_output output;
+    void *udata;
+
+    /** min-heap of held messages ordered by time and seq */
+    struct glc_mux_msg_s **heap;
+    int count, alloc;
+    size_t size;
+
+    unsigned long long seq;
+    /** newest time submitted */
+    glc_utime_t newest;
+    /** time of the last message passed on */
+    glc_utime_t released;
+    struct glc_mux_stream_s *streams;
+    size_t late;
+    int err;
+};
+
+static int glc_mux_time(glc_mux *mux, glc_message_header_t *hdr, const unsigned char *data, size_t size,
+                        glc_utime_t *time);
+static int glc_mux_push(glc_mux *mux, struct glc_mux_msg_s *msg);
+static struct glc_mux_msg_s *glc_mux_pop(glc_mux *mux);
+static int glc_mux_before(struct glc_mux_msg_s *a, struct glc_mux_msg_s *b);
+static int glc_mux_release(glc_mux *mux, int all);
+
+int glc_mux_create(glc_mux **mux, glc_mux_options *options, glc_mux_output output, void *udata) {
+    glc_mux_options def = {GLC_MUX_WINDOW, GLC_MUX_MAX_SIZE};
+    glc_mux *m = calloc(1, sizeof(*m));
+    if(!m)
+        return ENOMEM;
+
+    m->options = options ? *options : def;
+    m->output = output;
+    m->udata = udata;
+
+    *mux = m;
+    return 0;
+}
+
+int glc_mux_destroy(glc_mux *mux) {
+    struct glc_mux_stream_s *stream;
+    int err = glc_mux_flush(mux);
+
+    /* only left if the output failed */
+    while(mux->count) {
+        struct glc_mux_msg_s *msg = glc_mux_pop(mux);
+        free(msg->data);
+        free(msg);
+    }
+
+    while((stream = mux->streams)) {
+        mux->streams = stream->next;
+        free(stream);
+    }
+
+    free(mux->heap);
+    free(mux);
+    return err;
+}
+
+int glc_mux_submit(glc_mux *mux, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_mux_msg_s *msg;
+    size_t pos = 0;
+    int err, i;
+
+    if(mux->err)
+        return mux->err;
+
+    if(!(msg = calloc(1, sizeof(*msg))))
+        return ENOMEM;
+
+    for(i = 0; i < count; i++)
+        msg->size += iov[i].iov_len;
+
+    if(!(msg->data = malloc(msg->size ? msg->size : 1))) {
+        free(msg);
+        return ENOMEM;
+    }
+
+    for(i = 0; i < count; i++) {
+        memcpy(&msg->data[pos], iov[i].iov_base, iov[i].iov_len);
+        pos += iov[i].iov_len;
+    }
+
+    msg->header = *hdr;
+    msg->seq = mux->seq++;
+    if((err = glc_mux_time(mux, hdr, msg->data, msg->size, &msg->time)))
+        goto error;
+
+    /* can not go before what is out already, but still before anything
+       held, which includes the rest of its stream */
+    if(msg->time < mux->released) {
+        if(hdr->type == GLC_MESSAGE_VIDEO_FRAME || hdr->type == GLC_MESSAGE_VIDEO_REPEAT ||
+           hdr->type == GLC_MESSAGE_VIDEO_DELTA || hdr->type == GLC_MESSAGE_AUDIO_DATA)
+            mux->late++;
+        msg->time = mux->released;
+    }
+
+    if(msg->time > mux->newest)
+        mux->newest = msg->time;
+
+    if((err = glc_mux_push(mux, msg)))
+        goto error;
+
+    return glc_mux_release(mux, 0);
+
+error:
+    free(msg->data);
+    free(msg);
+    return err;
+}
+
+int glc_mux_flush(glc_mux *mux) {
+    return glc_mux_release(mux, 1);
+}
+
+size_t glc_mux_late(glc_mux *mux) {
+    return mux->late;
+}
+
+static int glc_mux_time(glc_mux *mux, glc_message_header_t *hdr, const unsigned char *data, size_t size,
+                        glc_utime_t *time) {
+    struct glc_mux_stream_s *stream;
+    glc_video_frame_header_t video;
+    glc_audio_data_header_t audio;
+    glc_stream_id_t id;
+    int timed = 0;
+
+    switch(hdr->type) {
+    case GLC_MESSAGE_VIDEO_FRAME:
+    case GLC_MESSAGE_VIDEO_REPEAT:
+    case GLC_MESSAGE_VIDEO_DELTA:
+        if(size < sizeof(video))
+            return EPROTO;
+        memcpy(&video, data, sizeof(video));
+        id = video.id;
+        *time = video.time;
+        timed = 1;
+        break;
+    case GLC_MESSAGE_AUDIO_DATA:
+        if(size < sizeof(audio))
+            return EPROTO;
+        memcpy(&audio, data, sizeof(audio));
+        id = audio.id;
+        *time = audio.time;
+        timed = 1;
+        break;
+    case GLC_MESSAGE_VIDEO_FORMAT:
+    case GLC_MESSAGE_AUDIO_FORMAT:
+    case GLC_MESSAGE_COLOR:
+        if(size < sizeof(id))
+            return EPROTO;
+        memcpy(&id, data, sizeof(id));
+        break;
+    default:
+        *time = mux->newest;
+        return 0;
+    }
+
+    for(stream = mux->streams; stream; stream = stream->next) {
+        if(stream->id == id)
+            break;
+    }
+
+    if(!timed) {
+        /* a new stream's format goes before everything held */
+        *time = stream ? stream->time : 0;
+        return 0;
+    }
+
+    if(!stream) {
+        if(!(stream = calloc(1, sizeof(*stream))))
+            return ENOMEM;
+        stream->id = id;
+        stream->next = mux->streams;
+        mux->streams = stream;
+    }
+
+    if(*time > stream->time)
+        stream->time = *time;
+    return 0;
+}
+
+static int glc_mux_release(glc_mux *mux, int all) {
+    struct glc_mux_msg_s *msg;
+    struct iovec iov;
+    int err;
+
+    while(mux->count && !mux->err &&
+          (all || mux->size > mux->options.max_size ||
+           mux->heap[0]->time + mux->options.window <= mux->newest)) {
+        msg = glc_mux_pop(mux);
+        mux->released = msg->time;
+
+        iov.iov_base = msg->data;
+        iov.iov_len = msg->size;
+        if((err = mux->output(&msg->header, &iov, 1, mux->udata)))
+            mux->err = err;
+
+        free(msg->data);
+        free(msg);
+    }
+
+    return mux->err;
+}
+
+static int glc_mux_before(struct glc_mux_msg_s *a, struct glc_mux_msg_s *b) {
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static int glc_mux_push(glc_mux *mux, struct glc_mux_msg_s *msg) {
+    struct glc_mux_msg_s **heap;
+    int i, parent;
+
+    if(mux->count == mux->alloc) {
+        if(!(heap = realloc(mux->heap, (mux->alloc ? mux->alloc * 2 : 64) * sizeof(*heap))))
+            return ENOMEM;
+        mux->heap = heap;
+        mux->alloc = mux->alloc ? mux->alloc * 2 : 64;
+    }
+
+    for(i = mux->count++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if(!glc_mux_before(msg, mux->heap[parent]))
+            break;
+        mux->heap[i] = mux->heap[parent];
+    }
+    mux->heap[i] = msg;
+    mux->size += msg->size;
+    return 0;
+}
+
+static struct glc_mux_msg_s *glc_mux_pop(glc_mux *mux) {
+    struct glc_mux_msg_s *top = mux->heap[0], *last = mux->heap[--mux->count];
+    int i = 0, child;
+
+    while((child = 2 * i + 1) < mux->count) {
+        if(child + 1 < mux->count && glc_mux_before(mux->heap[child + 1], mux->heap[child]))
+            child++;
+        if(!glc_mux_before(mux->heap[child], last))
+            break;
+        mux->heap[i] = mux->heap[child];
+        i = child;
+    }
+    mux->heap[i] = last;
+
+    mux->size -= top->size;
+    return top;
+}
+
+/**  \} */
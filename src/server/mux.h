@@ -0,0 +1,109 @@
+/**
+ * \file src/server/mux.h
+ * \brief timestamp ordering muxer
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_mux muxer
+ *  Audio and video of one client are produced by different threads and
+ *  reach the server slightly out of order. The muxer holds messages back
+ *  for a reorder window and passes them to the output in timestamp
+ *  order, so a written stream can be played without sorting it first.
+ *
+ *  Video frames, repeats, deltas and audio data are ordered by the time
+ *  in their headers. Format and color messages keep their place behind the last
+ *  timed message of their stream, other messages behind the newest
+ *  message seen. A message which arrives after newer ones were passed on already
+ *  is passed on next and counted as late; the window should be larger
+ *  than the producers' worst lag.
+ *
+ *  The muxer has to see uncompressed messages, so it goes in front of the
+ *  compression stage. It is not thread-safe, it is fed by one thread at a
+ *  time and calls the output from glc_mux_submit() and glc_mux_flush().
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_MUX_H
+#define GLC2_SERVER_MUX_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_mux_s glc_mux;
+
+/**
+ * \brief receives the messages of a muxer in timestamp order
+ * \param hdr message header
+ * \param iov payload segments, only valid during the call
+ * \param count number of segments
+ * \param udata data passed to glc_mux_create()
+ * \return 0 on success, an error is returned by the submit or flush
+ */
+typedef int (*glc_mux_output)(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata);
+
+typedef struct glc_mux_options_s {
+    /** messages are held until one this many microseconds newer arrived */
+    glc_utime_t window;
+    /** payload bytes held at most, the oldest are passed on early beyond it */
+    size_t max_size;
+} glc_mux_options;
+
+/**
+ * \brief create a muxer
+ * \param mux returned muxer
+ * \param options options or NULL for defaults (200 ms window, 64 MiB)
+ * \param output receives the messages
+ * \param udata data passed to output
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_mux_create(glc_mux **mux, glc_mux_options *options, glc_mux_output output, void *udata);
+
+/**
+ * \brief flush and destroy a muxer
+ * \param mux the muxer
+ * \return 0 on success otherwise the first error of the output
+ */
+__PUBLIC int glc_mux_destroy(glc_mux *mux);
+
+/**
+ * \brief submit a message
+ *
+ * The payload is copied, so it can be released right away (e.g. a
+ * glc_server_view). Messages which left the window are passed on.
+ * \param mux the muxer
+ * \param hdr message header
+ * \param iov payload segments
+ * \param count number of segments
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_mux_submit(glc_mux *mux, glc_message_header_t *hdr, const struct iovec *iov, int count);
+
+/**
+ * \brief pass all held messages on, e.g. at the end of a stream
+ * \param mux the muxer
+ * \return 0 on success otherwise the first error of the output
+ */
+__PUBLIC int glc_mux_flush(glc_mux *mux);
+
+/**
+ * \brief number of messages which arrived too late to be ordered
+ * \param mux the muxer
+ * \return late messages since creation
+ */
+__PUBLIC size_t glc_mux_late(glc_mux *mux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
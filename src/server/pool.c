@@ -0,0 +1,544 @@
+/**
+ * \file src/server/pool.c
+ * \brief worker thread pool
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_pool
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+/** initial deque capacity, must be a power of two */
+#define GLC_POOL_DEQUE_SIZE 64
+/** jobs a serial queue runs before it lets other queues run */
+#define GLC_POOL_QUEUE_BATCH 16
+
+struct glc_pool_job_s {
+    glc_pool_func func;
+    void *arg;
+};
+
+struct glc_pool_deque_s {
+    pthread_mutex_t mutex;
+    struct glc_pool_job_s *jobs;
+    /** capacity, power of two */
+    size_t size;
+    /** thieves take from here */
+    size_t top;
+    /** the owner pushes and pops here */
+    size_t bottom;
+};
+
+struct glc_pool_worker_s {
+    glc_pool *pool;
+    int index;
+    pthread_t thread;
+    struct glc_pool_deque_s deque;
+};
+
+struct glc_pool_s {
+    int threads;
+    struct glc_pool_worker_s *workers;
+    /** next deque for jobs submitted from outside the pool */
+    unsigned int next;
+    /** jobs sitting in deques */
+    size_t queued;
+    /** jobs submitted but not finished yet */
+    size_t active;
+    /** workers waiting for jobs */
+    int sleeping;
+    int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t work;
+    pthread_cond_t done;
+};
+
+struct glc_pool_queue_job_s {
+    glc_pool_func func;
+    void *arg;
+    struct glc_pool_queue_job_s *next;
+};
+
+struct glc_pool_queue_s {
+    glc_pool *pool;
+    pthread_mutex_t mutex;
+    pthread_cond_t idle;
+    struct glc_pool_queue_job_s *head, *tail;
+    /** unused job structures */
+    struct glc_pool_queue_job_s *free;
+    /** a run of this queue is submitted to the pool or running */
+    int scheduled;
+};
+
+/** one glc_pool_for() call, its indices are taken by the caller and by workers */
+struct glc_pool_for_s {
+    glc_pool_for_func func;
+    void *arg;
+    int count;
+    /** next index to take */
+    int next;
+    /** indices finished, protected by mutex */
+    int done;
+    /** next free slot */
+    int slot;
+    /** workers which may still look at the loop, and the caller */
+    int refs;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static __thread struct glc_pool_worker_s *glc_pool_self = NULL;
+
+static int glc_pool_push(glc_pool *pool, glc_pool_func func, void *arg, int top);
+static void *glc_pool_worker(void *arg);
+static void glc_pool_queue_run(void *arg);
+static void glc_pool_for_job(void *arg);
+static void glc_pool_for_work(struct glc_pool_for_s *loop);
+static void glc_pool_for_unref(struct glc_pool_for_s *loop);
+
+static int glc_pool_deque_init(struct glc_pool_deque_s *deque) {
+    deque->jobs = malloc(sizeof(struct glc_pool_job_s) * GLC_POOL_DEQUE_SIZE);
+    if(!deque->jobs)
+        return ENOMEM;
+
+    deque->size = GLC_POOL_DEQUE_SIZE;
+    deque->top = deque->bottom = 0;
+    pthread_mutex_init(&deque->mutex, NULL);
+    return 0;
+}
+
+static void glc_pool_deque_destroy(struct glc_pool_deque_s *deque) {
+    pthread_mutex_destroy(&deque->mutex);
+    free(deque->jobs);
+}
+
+/* the owner pops from the bottom, so a job pushed to the top runs after all others there */
+static int glc_pool_deque_push(struct glc_pool_deque_s *deque, glc_pool_func func, void *arg, int top) {
+    struct glc_pool_job_s *jobs;
+    size_t i;
+
+    pthread_mutex_lock(&deque->mutex);
+    if(deque->bottom - deque->top == deque->size) {
+        jobs = malloc(sizeof(struct glc_pool_job_s) * deque->size * 2);
+        if(!jobs) {
+            pthread_mutex_unlock(&deque->mutex);
+            return ENOMEM;
+        }
+
+        for(i = deque->top; i != deque->bottom; i++)
+            jobs[i & (deque->size * 2 - 1)] = deque->jobs[i & (deque->size - 1)];
+
+        free(deque->jobs);
+        deque->jobs = jobs;
+        deque->size *= 2;
+    }
+
+    if(top) {
+        deque->top--;
+        deque->jobs[deque->top & (deque->size - 1)].func = func;
+        deque->jobs[deque->top & (deque->size - 1)].arg = arg;
+    } else {
+        deque->jobs[deque->bottom & (deque->size - 1)].func = func;
+        deque->jobs[deque->bottom & (deque->size - 1)].arg = arg;
+        deque->bottom++;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+
+    return 0;
+}
+
+static int glc_pool_deque_pop(struct glc_pool_deque_s *deque, struct glc_pool_job_s *job) {
+    int ret = 0;
+
+    pthread_mutex_lock(&deque->mutex);
+    if(deque->bottom != deque->top) {
+        deque->bottom--;
+        *job = deque->jobs[deque->bottom & (deque->size - 1)];
+        ret = 1;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+
+    return ret;
+}
+
+static int glc_pool_deque_steal(struct glc_pool_deque_s *deque, struct glc_pool_job_s *job) {
+    int ret = 0;
+
+    /* a busy victim is skipped instead of waited for */
+    if(pthread_mutex_trylock(&deque->mutex))
+        return 0;
+
+    if(deque->bottom != deque->top) {
+        *job = deque->jobs[deque->top & (deque->size - 1)];
+        deque->top++;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+
+    return ret;
+}
+
+int glc_pool_create(glc_pool **pool, int threads) {
+    int err = 0, i, started = 0;
+    glc_pool *p;
+
+    if(threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int) cpus : 1;
+    }
+
+    if(!(p = calloc(1, sizeof(*p))))
+        return ENOMEM;
+
+    if(!(p->workers = calloc(threads, sizeof(struct glc_pool_worker_s)))) {
+        free(p);
+        return ENOMEM;
+    }
+
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    for(i = 0; i < threads; i++) {
+        p->workers[i].pool = p;
+        p->workers[i].index = i;
+        if((err = glc_pool_deque_init(&p->workers[i].deque)))
+            goto error;
+    }
+
+    /* workers steal from p->threads deques, so it must be set before they start */
+    p->threads = threads;
+    for(started = 0; started < threads; started++) {
+        if((err = pthread_create(&p->workers[started].thread, NULL, glc_pool_worker, &p->workers[started])))
+            goto error;
+    }
+
+    *pool = p;
+    return 0;
+
+error:
+    pthread_mutex_lock(&p->mutex);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->mutex);
+    while(started-- > 0)
+        pthread_join(p->workers[started].thread, NULL);
+
+    while(i-- > 0)
+        glc_pool_deque_destroy(&p->workers[i].deque);
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->work);
+    pthread_mutex_destroy(&p->mutex);
+    free(p->workers);
+    free(p);
+    return err;
+}
+
+void glc_pool_destroy(glc_pool *pool) {
+    int i;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(i = 0; i < pool->threads; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    for(i = 0; i < pool->threads; i++)
+        glc_pool_deque_destroy(&pool->workers[i].deque);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+}
+
+int glc_pool_threads(glc_pool *pool) {
+    return pool->threads;
+}
+
+int glc_pool_submit(glc_pool *pool, glc_pool_func func, void *arg) {
+    return glc_pool_push(pool, func, arg, 0);
+}
+
+static int glc_pool_push(glc_pool *pool, glc_pool_func func, void *arg, int top) {
+    struct glc_pool_deque_s *deque;
+    int err;
+
+    if(glc_pool_self && glc_pool_self->pool == pool)
+        deque = &glc_pool_self->deque;
+    else
+        deque = &pool->workers[__atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED) % pool->threads].deque;
+
+    __atomic_add_fetch(&pool->active, 1, __ATOMIC_SEQ_CST);
+    if((err = glc_pool_deque_push(deque, func, arg, top))) {
+        __atomic_sub_fetch(&pool->active, 1, __ATOMIC_SEQ_CST);
+        return err;
+    }
+
+    /* pairs with the sleeping/queued check in glc_pool_worker() */
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&pool->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return 0;
+}
+
+void glc_pool_wait(glc_pool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    while(__atomic_load_n(&pool->active, __ATOMIC_SEQ_CST))
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+int glc_pool_for(glc_pool *pool, int count, glc_pool_for_func func, void *arg) {
+    struct glc_pool_for_s *loop;
+    int helpers, i;
+
+    if(count <= 0)
+        return 0;
+
+    if(!(loop = calloc(1, sizeof(*loop))))
+        return ENOMEM;
+
+    loop->func = func;
+    loop->arg = arg;
+    loop->count = count;
+    pthread_mutex_init(&loop->mutex, NULL);
+    pthread_cond_init(&loop->cond, NULL);
+
+    helpers = pool->threads < count - 1 ? pool->threads : count - 1;
+    loop->refs = 1 + helpers;
+    for(i = 0; i < helpers; i++) {
+        if(glc_pool_submit(pool, glc_pool_for_job, loop))
+            __atomic_sub_fetch(&loop->refs, 1, __ATOMIC_ACQ_REL);
+    }
+
+    /* helpers which did not start yet find nothing left, so this never waits on a queued job */
+    glc_pool_for_work(loop);
+
+    pthread_mutex_lock(&loop->mutex);
+    while(loop->done < loop->count)
+        pthread_cond_wait(&loop->cond, &loop->mutex);
+    pthread_mutex_unlock(&loop->mutex);
+
+    glc_pool_for_unref(loop);
+    return 0;
+}
+
+static void glc_pool_for_job(void *arg) {
+    struct glc_pool_for_s *loop = arg;
+    glc_pool_for_work(loop);
+    glc_pool_for_unref(loop);
+}
+
+static void glc_pool_for_work(struct glc_pool_for_s *loop) {
+    /* runs once per helper and once in the caller, so slots stay below threads + 1 */
+    int slot = __atomic_fetch_add(&loop->slot, 1, __ATOMIC_ACQ_REL);
+    int index;
+
+    while((index = __atomic_fetch_add(&loop->next, 1, __ATOMIC_ACQ_REL)) < loop->count) {
+        loop->func(loop->arg, index, slot);
+
+        pthread_mutex_lock(&loop->mutex);
+        if(++loop->done == loop->count)
+            pthread_cond_broadcast(&loop->cond);
+        pthread_mutex_unlock(&loop->mutex);
+    }
+}
+
+static void glc_pool_for_unref(struct glc_pool_for_s *loop) {
+    if(__atomic_sub_fetch(&loop->refs, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    pthread_cond_destroy(&loop->cond);
+    pthread_mutex_destroy(&loop->mutex);
+    free(loop);
+}
+
+static int glc_pool_take(struct glc_pool_worker_s *self, struct glc_pool_job_s *job) {
+    glc_pool *pool = self->pool;
+    int i;
+
+    if(glc_pool_deque_pop(&self->deque, job))
+        return 1;
+
+    for(i = 1; i < pool->threads; i++) {
+        if(glc_pool_deque_steal(&pool->workers[(self->index + i) % pool->threads].deque, job))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void *glc_pool_worker(void *arg) {
+    struct glc_pool_worker_s *self = arg;
+    glc_pool *pool = self->pool;
+    struct glc_pool_job_s job;
+
+    glc_pool_self = self;
+
+    while(1) {
+        if(glc_pool_take(self, &job)) {
+            __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+            job.func(job.arg);
+
+            if(!__atomic_sub_fetch(&pool->active, 1, __ATOMIC_SEQ_CST)) {
+                pthread_mutex_lock(&pool->mutex);
+                pthread_cond_broadcast(&pool->done);
+                pthread_mutex_unlock(&pool->mutex);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        if(pool->stop && !__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+
+        __atomic_add_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+        while(!__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) && !pool->stop)
+            pthread_cond_wait(&pool->work, &pool->mutex);
+        __atomic_sub_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    glc_pool_self = NULL;
+    return NULL;
+}
+
+int glc_pool_queue_create(glc_pool *pool, glc_pool_queue **queue) {
+    glc_pool_queue *q = calloc(1, sizeof(*q));
+    if(!q)
+        return ENOMEM;
+
+    q->pool = pool;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->idle, NULL);
+
+    *queue = q;
+    return 0;
+}
+
+void glc_pool_queue_destroy(glc_pool_queue *queue) {
+    struct glc_pool_queue_job_s *job;
+
+    glc_pool_queue_wait(queue);
+
+    while((job = queue->free)) {
+        queue->free = job->next;
+        free(job);
+    }
+
+    pthread_cond_destroy(&queue->idle);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+}
+
+int glc_pool_queue_submit(glc_pool_queue *queue, glc_pool_func func, void *arg) {
+    struct glc_pool_queue_job_s *job;
+    int err, schedule = 0;
+
+    pthread_mutex_lock(&queue->mutex);
+    if((job = queue->free))
+        queue->free = job->next;
+    else if(!(job = malloc(sizeof(*job)))) {
+        pthread_mutex_unlock(&queue->mutex);
+        return ENOMEM;
+    }
+
+    job->func = func;
+    job->arg = arg;
+    job->next = NULL;
+    if(queue->tail)
+        queue->tail->next = job;
+    else
+        queue->head = job;
+    queue->tail = job;
+
+    if(!queue->scheduled)
+        schedule = queue->scheduled = 1;
+    pthread_mutex_unlock(&queue->mutex);
+
+    if(schedule && (err = glc_pool_submit(queue->pool, glc_pool_queue_run, queue))) {
+        pthread_mutex_lock(&queue->mutex);
+        queue->head = job->next;
+        if(!queue->head)
+            queue->tail = NULL;
+        job->next = queue->free;
+        queue->free = job;
+        queue->scheduled = 0;
+        pthread_cond_broadcast(&queue->idle);
+        pthread_mutex_unlock(&queue->mutex);
+        return err;
+    }
+
+    return 0;
+}
+
+void glc_pool_queue_wait(glc_pool_queue *queue) {
+    pthread_mutex_lock(&queue->mutex);
+    while(queue->scheduled)
+        pthread_cond_wait(&queue->idle, &queue->mutex);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static void glc_pool_queue_run(void *arg) {
+    glc_pool_queue *queue = arg;
+    struct glc_pool_queue_job_s *job;
+    glc_pool_func func;
+    void *job_arg;
+    int i;
+
+    for(i = 0; ; i++) {
+        pthread_mutex_lock(&queue->mutex);
+        if(!(job = queue->head)) {
+            queue->scheduled = 0;
+            pthread_cond_broadcast(&queue->idle);
+            pthread_mutex_unlock(&queue->mutex);
+            return;
+        }
+
+        /*
+         * Give other queues a chance, we stay scheduled. The run goes to
+         * the top of the deque: this worker pops everything else first,
+         * while thieves take it first.
+         */
+        if(i == GLC_POOL_QUEUE_BATCH) {
+            pthread_mutex_unlock(&queue->mutex);
+            if(!glc_pool_push(queue->pool, glc_pool_queue_run, queue, 1))
+                return;
+            i = 0;
+            continue;
+        }
+
+        queue->head = job->next;
+        if(!queue->head)
+            queue->tail = NULL;
+        func = job->func;
+        job_arg = job->arg;
+        job->next = queue->free;
+        queue->free = job;
+        pthread_mutex_unlock(&queue->mutex);
+
+        func(job_arg);
+    }
+}
+
+/**  \} */
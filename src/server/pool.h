@@ -0,0 +1,141 @@
+/**
+ * \file src/server/pool.h
+ * \brief worker thread pool
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_pool worker pool
+ *  Fixed number of worker threads, each with its own deque of jobs. A worker
+ *  takes jobs from the bottom of its own deque and, when that is empty,
+ *  steals from the top of the other workers' deques. Jobs submitted from
+ *  outside the pool are spread over the deques round-robin.
+ *
+ *  Jobs submitted to the pool run in any order. Jobs which must run one
+ *  after another (e.g. all processing of one stream) are submitted to a
+ *  glc_pool_queue instead: a queue runs its jobs in submission order and
+ *  never more than one at a time, while different queues run in parallel.
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_POOL_H
+#define GLC2_SERVER_POOL_H
+
+#include "format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_pool_s glc_pool;
+typedef struct glc_pool_queue_s glc_pool_queue;
+
+/**
+ * \brief job function
+ * \param arg argument passed on submission
+ */
+typedef void (*glc_pool_func)(void *arg);
+
+/**
+ * \brief parallel loop body
+ * \param arg argument passed to glc_pool_for()
+ * \param index loop index
+ * \param slot index of the thread running the body, unique among the
+ *        threads of one loop and less than glc_pool_threads() + 1
+ */
+typedef void (*glc_pool_for_func)(void *arg, int index, int slot);
+
+/**
+ * \brief create a pool and start its workers
+ * \param pool returned pool
+ * \param threads number of workers, 0 for one per online cpu
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_pool_create(glc_pool **pool, int threads);
+
+/**
+ * \brief run all submitted jobs, stop the workers and destroy the pool
+ * \note all queues must be destroyed before
+ * \param pool the pool
+ */
+__PUBLIC void glc_pool_destroy(glc_pool *pool);
+
+/**
+ * \brief get the number of workers
+ * \param pool the pool
+ * \return number of worker threads
+ */
+__PUBLIC int glc_pool_threads(glc_pool *pool);
+
+/**
+ * \brief submit a job
+ * \note thread-safe, may be called from inside a job
+ * \param pool the pool
+ * \param func job function
+ * \param arg argument passed to func
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_pool_submit(glc_pool *pool, glc_pool_func func, void *arg);
+
+/**
+ * \brief wait until all submitted jobs are done
+ * \note must not be called from inside a job
+ * \param pool the pool
+ */
+__PUBLIC void glc_pool_wait(glc_pool *pool);
+
+/**
+ * \brief run func for every index in [0, count) and wait for it
+ *
+ * The indices are taken by pool workers and by the calling thread, which
+ * only waits for indices already taken. So this makes progress even when
+ * all workers are busy and may be called from inside a job.
+ * \note thread-safe, may be called from inside a job
+ * \param pool the pool
+ * \param count number of indices
+ * \param func loop body
+ * \param arg argument passed to func
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_pool_for(glc_pool *pool, int count, glc_pool_for_func func, void *arg);
+
+/**
+ * \brief create a serial queue
+ * \param pool the pool which runs the queue's jobs
+ * \param queue returned queue
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_pool_queue_create(glc_pool *pool, glc_pool_queue **queue);
+
+/**
+ * \brief wait until all jobs of the queue are done and destroy it
+ * \note must not be called from inside a job of the same queue
+ * \param queue the queue
+ */
+__PUBLIC void glc_pool_queue_destroy(glc_pool_queue *queue);
+
+/**
+ * \brief submit a job to a serial queue
+ * \note thread-safe, may be called from inside a job
+ * \param queue the queue
+ * \param func job function
+ * \param arg argument passed to func
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_pool_queue_submit(glc_pool_queue *queue, glc_pool_func func, void *arg);
+
+/**
+ * \brief wait until all jobs submitted to the queue are done
+ * \note must not be called from inside a job of the same queue
+ * \param queue the queue
+ */
+__PUBLIC void glc_pool_queue_wait(glc_pool_queue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
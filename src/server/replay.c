@@ -0,0 +1,828 @@
+/**
+ * \file src/server/replay.c
+ * \brief instant replay buffer
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_replay
+ *  \{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "replay.h"
+#include "compress.h"
+#include "writer.h"
+#include "indexer.h"
+#include "lzjb.h"
+
+#define GLC_REPLAY_DURATION ((glc_utime_t) 60 * 1000000)
+#define GLC_REPLAY_MAX_SIZE ((size_t) 512 * 1024 * 1024)
+#define GLC_REPLAY_PATH "replay"
+
+#define GLC_REPLAY_ALIGN(S) (((S) + 7) & ~((size_t) 7))
+
+/** what the ring needs to know of a message inside the compression stage */
+struct glc_replay_meta_s {
+    glc_utime_t time;
+    glc_stream_id_t id;
+    glc_message_type_t type;
+    struct glc_replay_meta_s *next;
+};
+
+/**
+ * \brief message in the ring
+ *
+ * Followed by the message as it is written to a stream file: its size,
+ * its header and its payload.
+ */
+struct glc_replay_entry_s {
+    glc_utime_t time;
+    /** bytes the entry takes in the ring */
+    size_t len;
+    /** bytes of the stored message */
+    size_t size;
+    glc_stream_id_t id;
+    /** type of the message before compression */
+    glc_message_type_t type;
+};
+
+/**
+ * \brief message in effect at the start of the ring
+ *
+ * Format and color messages, and per video stream the last full frame
+ * with the deltas which were applied to it since.
+ */
+struct glc_replay_state_s {
+    glc_message_type_t type;
+    glc_stream_id_t id;
+    /** the message in stream file layout */
+    unsigned char *data;
+    size_t size;
+    struct glc_replay_state_s *next;
+};
+
+/** entry of a clip being saved which was evicted before it was written */
+struct glc_replay_kept_s {
+    struct glc_replay_kept_s *next;
+    /* followed by a copy of the entry */
+};
+
+/**
+ * \brief clip being saved
+ *
+ * The clip is the ring as it was when the save started. Its entries are
+ * written from the ring one at a time, so the ring keeps taking messages
+ * meanwhile. Entries the ring evicts before they are written are copied
+ * to kept first.
+ */
+struct glc_replay_save_s {
+    glc_replay *replay;
+    char *path;
+    glc_stream_info_t info;
+    char *name;
+    /** copies of the states at the start of the clip */
+    struct glc_replay_state_s *states;
+
+    /** next entry of the clip in the ring and entries of the clip left there */
+    size_t off;
+    int left;
+    /** evicted entries, older than the one at off */
+    struct glc_replay_kept_s *kept_head, *kept_tail;
+    /** the clip lost an entry */
+    int err;
+};
+
+struct glc_replay_s {
+    glc_pool *pool;
+    glc_compress *compress;
+    glc_utime_t duration;
+    char *path;
+    unsigned int clips;
+
+    glc_stream_info_t info;
+    char *name;
+
+    /** newest time submitted, for untimed messages */
+    glc_utime_t time;
+
+    /** thread writing a clip of a GLC_MESSAGE_REPLAY message */
+    pthread_t thread;
+    int thread_running;
+    /** error of the last clip written by the thread */
+    int thread_err;
+
+    /** protects everything below against the compression stage's output */
+    pthread_mutex_t mutex;
+    struct glc_replay_meta_s *meta_head, *meta_tail;
+
+    unsigned char *data;
+    size_t size;
+    /** offset of the oldest entry and where the next one goes */
+    size_t head, tail;
+    /** end of the entries behind head if tail wrapped around, else 0 */
+    size_t wrap;
+    int count;
+    /** bytes of the entries in the ring */
+    size_t used;
+    /** newest time in the ring */
+    glc_utime_t newest;
+    struct glc_replay_state_s *states;
+    /** bytes of the states, they count against the ring's size */
+    size_t states_size;
+    /** clip being saved or NULL */
+    struct glc_replay_save_s *save;
+};
+
+static int glc_replay_output(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata);
+static int glc_replay_meta(glc_replay *replay, glc_message_header_t *hdr, const struct iovec *iov, int count,
+                           struct glc_replay_meta_s *meta);
+static int glc_replay_reserve(glc_replay *replay, size_t len);
+static int glc_replay_evict(glc_replay *replay);
+static int glc_replay_state_set(glc_replay *replay, struct glc_replay_entry_s *entry);
+static struct glc_replay_state_s *glc_replay_state_find(glc_replay *replay, glc_message_type_t type,
+                                                         glc_stream_id_t id);
+static void glc_replay_state_drop(glc_replay *replay, glc_message_type_t type, glc_stream_id_t id);
+static void glc_replay_states_free(struct glc_replay_state_s *states);
+static int glc_replay_join(glc_replay *replay);
+static int glc_replay_save_start(glc_replay *replay, const char *path, struct glc_replay_save_s **save);
+static void glc_replay_save_keep(struct glc_replay_save_s *save, struct glc_replay_entry_s *entry);
+static int glc_replay_save_write(struct glc_replay_save_s *save);
+static void *glc_replay_save_thread(void *arg);
+static int glc_replay_write_states(struct glc_replay_save_s *save, glc_writer *writer, glc_indexer *indexer,
+                                   glc_message_type_t type);
+static int glc_replay_write(struct glc_replay_save_s *save, glc_writer *writer, glc_indexer *indexer);
+
+int glc_replay_create(glc_replay **replay, glc_pool *pool, glc_replay_options *options) {
+    glc_replay_options def = {GLC_REPLAY_DURATION, GLC_REPLAY_MAX_SIZE, GLC_REPLAY_PATH};
+    glc_replay *r;
+    int err;
+
+    if(!options)
+        options = &def;
+
+    if(!(r = calloc(1, sizeof(*r))))
+        return ENOMEM;
+
+    r->pool = pool;
+    r->duration = options->duration;
+    r->size = options->max_size & ~((size_t) 7);
+    r->info.signature = GLC_SIGNATURE;
+    r->info.version = GLC_STREAM_VERSION;
+    pthread_mutex_init(&r->mutex, NULL);
+
+    if(!(r->name = strdup("")) || (options->path && !(r->path = strdup(options->path))) ||
+       !(r->data = malloc(r->size ? r->size : 1))) {
+        err = ENOMEM;
+        goto error;
+    }
+
+    if((err = glc_compress_create(&r->compress, pool, NULL, glc_replay_output, r)))
+        goto error;
+
+    *replay = r;
+    return 0;
+
+error:
+    free(r->data);
+    free(r->path);
+    free(r->name);
+    pthread_mutex_destroy(&r->mutex);
+    free(r);
+    return err;
+}
+
+int glc_replay_destroy(glc_replay *replay) {
+    struct glc_replay_meta_s *meta;
+    int err = glc_replay_join(replay), err2;
+
+    if((err2 = glc_compress_destroy(replay->compress)) && !err)
+        err = err2;
+
+    glc_replay_states_free(replay->states);
+
+    /* only left if the stage failed */
+    while((meta = replay->meta_head)) {
+        replay->meta_head = meta->next;
+        free(meta);
+    }
+
+    pthread_mutex_destroy(&replay->mutex);
+    free(replay->data);
+    free(replay->path);
+    free(replay->name);
+    free(replay);
+    return err;
+}
+
+int glc_replay_set_info(glc_replay *replay, const glc_stream_info_t *info, const char *name) {
+    char *copy = strdup(name ? name : "");
+    if(!copy)
+        return ENOMEM;
+
+    free(replay->name);
+    replay->name = copy;
+    replay->info = *info;
+    return 0;
+}
+
+int glc_replay_submit(glc_replay *replay, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_replay_meta_s *meta, *prev;
+    struct glc_replay_save_s *save;
+    char path[4096];
+    int err;
+
+    if(hdr->type == GLC_MESSAGE_REPLAY) {
+        if(!replay->path)
+            return 0;
+
+        /* one clip at a time, the last one's error is reported now */
+        if((err = glc_replay_join(replay)))
+            return err;
+
+        /* do not overwrite clips of earlier runs */
+        do {
+            snprintf(path, sizeof(path), "%s-%u.glc", replay->path, ++replay->clips);
+        } while(!access(path, F_OK));
+
+        if((err = glc_replay_save_start(replay, path, &save)))
+            return err;
+
+        /* writing takes a while, the caller goes on feeding the ring */
+        if(pthread_create(&replay->thread, NULL, glc_replay_save_thread, save))
+            return glc_replay_save_write(save);
+        replay->thread_running = 1;
+        return 0;
+    }
+
+    if(!(meta = calloc(1, sizeof(*meta))))
+        return ENOMEM;
+
+    if((err = glc_replay_meta(replay, hdr, iov, count, meta))) {
+        free(meta);
+        return err;
+    }
+
+    pthread_mutex_lock(&replay->mutex);
+    if(replay->meta_tail)
+        replay->meta_tail->next = meta;
+    else
+        replay->meta_head = meta;
+    replay->meta_tail = meta;
+    pthread_mutex_unlock(&replay->mutex);
+
+    if((err = glc_compress_submit(replay->compress, hdr, iov, count))) {
+        /* the stage did not take it, so it is still the last one */
+        pthread_mutex_lock(&replay->mutex);
+        if(replay->meta_head == meta) {
+            replay->meta_head = replay->meta_tail = NULL;
+        } else {
+            for(prev = replay->meta_head; prev->next != meta; prev = prev->next)
+                ;
+            prev->next = NULL;
+            replay->meta_tail = prev;
+        }
+        pthread_mutex_unlock(&replay->mutex);
+        free(meta);
+    }
+
+    return err;
+}
+
+int glc_replay_save(glc_replay *replay, const char *path) {
+    struct glc_replay_save_s *save;
+    int err;
+
+    if((err = glc_replay_join(replay)) || (err = glc_replay_save_start(replay, path, &save)))
+        return err;
+
+    return glc_replay_save_write(save);
+}
+
+/* wait for the clip thread */
+static int glc_replay_join(glc_replay *replay) {
+    int err;
+
+    if(!replay->thread_running)
+        return 0;
+
+    pthread_join(replay->thread, NULL);
+    replay->thread_running = 0;
+    err = replay->thread_err;
+    replay->thread_err = 0;
+    return err;
+}
+
+/* take a snapshot of the ring, on the feeding thread */
+static int glc_replay_save_start(glc_replay *replay, const char *path, struct glc_replay_save_s **save) {
+    struct glc_replay_state_s *state, *copy, **last;
+    struct glc_replay_save_s *s;
+    int err;
+
+    /* everything submitted has to be in the ring */
+    if((err = glc_compress_flush(replay->compress)))
+        return err;
+
+    if(!(s = calloc(1, sizeof(*s))))
+        return ENOMEM;
+
+    s->replay = replay;
+    s->info = replay->info;
+    if(!(s->path = strdup(path)) || !(s->name = strdup(replay->name))) {
+        err = ENOMEM;
+        goto error;
+    }
+
+    pthread_mutex_lock(&replay->mutex);
+    last = &s->states;
+    for(state = replay->states; state; state = state->next) {
+        if(!(copy = calloc(1, sizeof(*copy))) || !(copy->data = malloc(state->size))) {
+            pthread_mutex_unlock(&replay->mutex);
+            free(copy);
+            err = ENOMEM;
+            goto error;
+        }
+        copy->type = state->type;
+        copy->id = state->id;
+        copy->size = state->size;
+        memcpy(copy->data, state->data, state->size);
+        *last = copy;
+        last = &copy->next;
+    }
+
+    s->off = replay->head;
+    s->left = replay->count;
+    replay->save = s;
+    pthread_mutex_unlock(&replay->mutex);
+
+    *save = s;
+    return 0;
+
+error:
+    glc_replay_states_free(s->states);
+    free(s->name);
+    free(s->path);
+    free(s);
+    return err;
+}
+
+/* the entry at off is evicted, called with the mutex held */
+static void glc_replay_save_keep(struct glc_replay_save_s *save, struct glc_replay_entry_s *entry) {
+    struct glc_replay_kept_s *kept;
+
+    if(!save->err) {
+        if((kept = malloc(sizeof(*kept) + entry->len))) {
+            kept->next = NULL;
+            memcpy(&kept[1], entry, entry->len);
+            if(save->kept_tail)
+                save->kept_tail->next = kept;
+            else
+                save->kept_head = kept;
+            save->kept_tail = kept;
+        } else {
+            /* the clip fails, not the ring */
+            save->err = ENOMEM;
+        }
+    }
+
+    save->off += entry->len;
+    if(save->replay->wrap && save->off == save->replay->wrap)
+        save->off = 0;
+    save->left--;
+}
+
+/* write a clip and free it, on any thread */
+static int glc_replay_save_write(struct glc_replay_save_s *save) {
+    glc_replay *replay = save->replay;
+    struct glc_replay_kept_s *kept;
+    glc_writer *writer = NULL;
+    glc_indexer *indexer = NULL;
+    int err, err2 = 0;
+
+    /*
+     * The writer gets a pool of its own for its pwrite() fallback, this
+     * may run inside a job of the replay's pool and must not wait for
+     * jobs queued behind itself.
+     */
+    if(!(err = glc_indexer_create(&indexer, NULL, 0)) &&
+       !(err = glc_writer_create(&writer, save->path, NULL, NULL))) {
+        err = glc_replay_write(save, writer, indexer);
+        err2 = glc_writer_destroy(writer);
+    }
+    if(indexer)
+        glc_indexer_destroy(indexer);
+
+    if(!err)
+        err = err2;
+    if(writer && err)
+        unlink(save->path);
+
+    pthread_mutex_lock(&replay->mutex);
+    replay->save = NULL;
+    pthread_mutex_unlock(&replay->mutex);
+
+    while((kept = save->kept_head)) {
+        save->kept_head = kept->next;
+        free(kept);
+    }
+    glc_replay_states_free(save->states);
+    free(save->name);
+    free(save->path);
+    free(save);
+    return err;
+}
+
+static void *glc_replay_save_thread(void *arg) {
+    struct glc_replay_save_s *save = arg;
+    glc_replay *replay = save->replay;
+
+    replay->thread_err = glc_replay_save_write(save);
+    return NULL;
+}
+
+static int glc_replay_write(struct glc_replay_save_s *save, glc_writer *writer, glc_indexer *indexer) {
+    glc_replay *replay = save->replay;
+    struct glc_replay_entry_s *entry;
+    struct glc_replay_kept_s *kept;
+    glc_message_header_t hdr;
+    glc_stream_info_t info = save->info;
+    glc_size_t size = 0;
+    char date[64];
+    struct tm tm;
+    time_t now;
+    int err;
+
+    now = time(NULL);
+    gmtime_r(&now, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+    info.name_size = strlen(save->name) + 1;
+    info.date_size = strlen(date) + 1;
+
+    if((err = glc_writer_write(writer, &info, sizeof(info))) ||
+       (err = glc_writer_write(writer, save->name, info.name_size)) ||
+       (err = glc_writer_write(writer, date, info.date_size)))
+        return err;
+
+    /* formats first, colors and frames refer to video formats */
+    if((err = glc_replay_write_states(save, writer, indexer, GLC_MESSAGE_VIDEO_FORMAT)) ||
+       (err = glc_replay_write_states(save, writer, indexer, GLC_MESSAGE_AUDIO_FORMAT)) ||
+       (err = glc_replay_write_states(save, writer, indexer, GLC_MESSAGE_COLOR)) ||
+       (err = glc_replay_write_states(save, writer, indexer, GLC_MESSAGE_VIDEO_FRAME)) ||
+       (err = glc_replay_write_states(save, writer, indexer, GLC_MESSAGE_VIDEO_DELTA)))
+        return err;
+
+    /* the mutex is only held for one entry, the ring is fed meanwhile */
+    pthread_mutex_lock(&replay->mutex);
+    while(!err && !(err = save->err)) {
+        if((kept = save->kept_head)) {
+            save->kept_head = kept->next;
+            if(!save->kept_head)
+                save->kept_tail = NULL;
+            pthread_mutex_unlock(&replay->mutex);
+
+            entry = (struct glc_replay_entry_s *) &kept[1];
+            if(!(err = glc_indexer_add(indexer, glc_writer_size(writer), entry->type, entry->id, entry->time)))
+                err = glc_writer_write(writer, &entry[1], entry->size);
+            free(kept);
+
+            pthread_mutex_lock(&replay->mutex);
+            continue;
+        }
+
+        if(!save->left)
+            break;
+
+        entry = (struct glc_replay_entry_s *) &replay->data[save->off];
+        if((err = glc_indexer_add(indexer, glc_writer_size(writer), entry->type, entry->id, entry->time)) ||
+           (err = glc_writer_write(writer, &entry[1], entry->size)))
+            break;
+
+        save->off += entry->len;
+        if(replay->wrap && save->off == replay->wrap)
+            save->off = 0;
+        save->left--;
+
+        /* let the ring in */
+        pthread_mutex_unlock(&replay->mutex);
+        pthread_mutex_lock(&replay->mutex);
+    }
+    pthread_mutex_unlock(&replay->mutex);
+    if(err)
+        return err;
+
+    hdr.type = GLC_MESSAGE_CLOSE;
+    if(!(err = glc_writer_write(writer, &size, sizeof(size))) &&
+       !(err = glc_writer_write(writer, &hdr, sizeof(hdr))))
+        err = glc_indexer_finish(indexer, writer);
+    return err;
+}
+
+static int glc_replay_write_states(struct glc_replay_save_s *save, glc_writer *writer, glc_indexer *indexer,
+                                   glc_message_type_t type) {
+    struct glc_replay_state_s *state;
+    int err;
+
+    for(state = save->states; state; state = state->next) {
+        if(state->type != type)
+            continue;
+        if((err = glc_indexer_add(indexer, glc_writer_size(writer), state->type, state->id, 0)) ||
+           (err = glc_writer_write(writer, state->data, state->size)))
+            return err;
+    }
+
+    return 0;
+}
+
+static int glc_replay_meta(glc_replay *replay, glc_message_header_t *hdr, const struct iovec *iov, int count,
+                           struct glc_replay_meta_s *meta) {
+    glc_video_frame_header_t video;
+    unsigned char *dst = (unsigned char *) &video;
+    size_t want = 0, pos = 0, n;
+    int i;
+
+    meta->type = hdr->type;
+    meta->time = replay->time;
+
+    /* id and time are at the same place in audio data and all video frames */
+    switch(hdr->type) {
+    case GLC_MESSAGE_VIDEO_FRAME:
+    case GLC_MESSAGE_VIDEO_REPEAT:
+    case GLC_MESSAGE_VIDEO_DELTA:
+    case GLC_MESSAGE_AUDIO_DATA:
+        want = sizeof(video);
+        break;
+    case GLC_MESSAGE_VIDEO_FORMAT:
+    case GLC_MESSAGE_AUDIO_FORMAT:
+    case GLC_MESSAGE_COLOR:
+        want = sizeof(glc_stream_id_t);
+        break;
+    default:
+        return 0;
+    }
+
+    for(i = 0; i < count && pos < want; i++) {
+        n = iov[i].iov_len < want - pos ? iov[i].iov_len : want - pos;
+        memcpy(&dst[pos], iov[i].iov_base, n);
+        pos += n;
+    }
+    if(pos < want)
+        return EPROTO;
+
+    meta->id = video.id;
+    if(want == sizeof(video)) {
+        meta->time = video.time;
+        if(video.time > replay->time)
+            replay->time = video.time;
+    }
+
+    return 0;
+}
+
+/* may be called from any worker thread, never twice at the same time */
+static int glc_replay_output(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata) {
+    glc_replay *replay = udata;
+    struct glc_replay_entry_s *entry;
+    struct glc_replay_meta_s *meta;
+    unsigned char *dst;
+    glc_size_t size = 0;
+    size_t len;
+    int err, i;
+
+    for(i = 0; i < count; i++)
+        size += iov[i].iov_len;
+
+    pthread_mutex_lock(&replay->mutex);
+    meta = replay->meta_head;
+    replay->meta_head = meta->next;
+    if(!replay->meta_head)
+        replay->meta_tail = NULL;
+
+    len = GLC_REPLAY_ALIGN(sizeof(*entry) + sizeof(size) + sizeof(*hdr) + size);
+    if((err = glc_replay_reserve(replay, len)))
+        goto finish;
+
+    entry = (struct glc_replay_entry_s *) &replay->data[replay->tail];
+    entry->time = meta->time;
+    entry->len = len;
+    entry->size = sizeof(size) + sizeof(*hdr) + size;
+    entry->id = meta->id;
+    entry->type = meta->type;
+
+    dst = (unsigned char *) &entry[1];
+    memcpy(dst, &size, sizeof(size));
+    memcpy(&dst[sizeof(size)], hdr, sizeof(*hdr));
+    dst += sizeof(size) + sizeof(*hdr);
+    for(i = 0; i < count; i++) {
+        memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+        dst += iov[i].iov_len;
+    }
+
+    replay->tail += len;
+    replay->used += len;
+    replay->count++;
+    if(meta->time > replay->newest)
+        replay->newest = meta->time;
+
+    while(!err && replay->count &&
+          ((struct glc_replay_entry_s *) &replay->data[replay->head])->time + replay->duration < replay->newest)
+        err = glc_replay_evict(replay);
+
+finish:
+    pthread_mutex_unlock(&replay->mutex);
+    free(meta);
+    return err;
+}
+
+/* make room for len bytes at tail, dropping the oldest entries */
+static int glc_replay_reserve(glc_replay *replay, size_t len) {
+    int err;
+
+    if(len > replay->size)
+        return EMSGSIZE;
+
+    while(1) {
+        if(!replay->count)
+            replay->head = replay->tail = replay->wrap = 0;
+
+        /* the states of an empty ring are what is left of it, they can not go */
+        if(!replay->count || replay->used + replay->states_size + len <= replay->size) {
+            if(!replay->wrap) {
+                /* entries are in [head, tail) */
+                if(replay->size - replay->tail >= len)
+                    return 0;
+                if(replay->head >= len) {
+                    replay->wrap = replay->tail;
+                    replay->tail = 0;
+                    return 0;
+                }
+            } else if(replay->head - replay->tail >= len) {
+                /* entries are in [head, wrap) and [0, tail) */
+                return 0;
+            }
+        }
+
+        if((err = glc_replay_evict(replay)))
+            return err;
+    }
+}
+
+static int glc_replay_evict(glc_replay *replay) {
+    struct glc_replay_entry_s *entry = (struct glc_replay_entry_s *) &replay->data[replay->head];
+    glc_stream_id_t id = entry->id;
+    int gop = 0, err;
+
+    /* a clip being saved did not write it yet */
+    if(replay->save && replay->save->left && replay->save->off == replay->head)
+        glc_replay_save_keep(replay->save, entry);
+
+    /* frames of the old format are no use anymore, deltas are applied to the newer frame */
+    if(entry->type == GLC_MESSAGE_VIDEO_FORMAT)
+        glc_replay_state_drop(replay, GLC_MESSAGE_VIDEO_FRAME, entry->id);
+    if(entry->type == GLC_MESSAGE_VIDEO_FORMAT || entry->type == GLC_MESSAGE_VIDEO_FRAME)
+        glc_replay_state_drop(replay, GLC_MESSAGE_VIDEO_DELTA, entry->id);
+
+    /*
+     * repeats and deltas at the start of a clip need the frame they refer to.
+     * deltas add up until the next full frame, once they take more than half
+     * of the ring the stream's states are dropped and so is the rest of its
+     * group of pictures, the clip then starts at the stream's next frame.
+     */
+    if(entry->type == GLC_MESSAGE_VIDEO_DELTA) {
+        if(!glc_replay_state_find(replay, GLC_MESSAGE_VIDEO_FRAME, entry->id)) {
+            /* nothing to apply it to */
+        } else if(replay->states_size + entry->size > replay->size / 2) {
+            glc_replay_state_drop(replay, GLC_MESSAGE_VIDEO_FRAME, entry->id);
+            glc_replay_state_drop(replay, GLC_MESSAGE_VIDEO_DELTA, entry->id);
+            gop = 1;
+        } else if((err = glc_replay_state_set(replay, entry))) {
+            return err;
+        }
+    } else if(entry->type == GLC_MESSAGE_VIDEO_FORMAT || entry->type == GLC_MESSAGE_AUDIO_FORMAT ||
+              entry->type == GLC_MESSAGE_COLOR || entry->type == GLC_MESSAGE_VIDEO_FRAME) {
+        if((err = glc_replay_state_set(replay, entry)))
+            return err;
+    }
+
+    replay->head += entry->len;
+    replay->used -= entry->len;
+    replay->count--;
+    if(replay->wrap && replay->head == replay->wrap) {
+        replay->head = 0;
+        replay->wrap = 0;
+    }
+
+    while(gop && replay->count) {
+        entry = (struct glc_replay_entry_s *) &replay->data[replay->head];
+        if(entry->id == id &&
+           (entry->type == GLC_MESSAGE_VIDEO_FRAME || entry->type == GLC_MESSAGE_VIDEO_FORMAT))
+            break;
+        if((err = glc_replay_evict(replay)))
+            return err;
+    }
+
+    return 0;
+}
+
+/* the evicted message is in effect until the next one of its kind, deltas add up */
+static int glc_replay_state_set(glc_replay *replay, struct glc_replay_entry_s *entry) {
+    struct glc_replay_state_s *state, **last;
+    unsigned char *src = (unsigned char *) &entry[1], *data;
+    glc_message_header_t hdr;
+    glc_size_t size;
+    void *payload;
+    size_t payload_size, data_size = entry->size;
+    int err;
+
+    memcpy(&hdr, &src[sizeof(size)], sizeof(hdr));
+    /* frames are kept as they are stored, they are too big to unpack each time */
+    if(hdr.type == GLC_MESSAGE_LZJB && entry->type != GLC_MESSAGE_VIDEO_FRAME &&
+       entry->type != GLC_MESSAGE_VIDEO_DELTA) {
+        if((err = glc_lzjb_message_decompress(&src[sizeof(size) + sizeof(hdr)],
+                                              entry->size - sizeof(size) - sizeof(hdr),
+                                              &hdr, &payload, &payload_size)))
+            return err;
+
+        size = payload_size;
+        data_size = sizeof(size) + sizeof(hdr) + payload_size;
+        if((data = malloc(data_size))) {
+            memcpy(data, &size, sizeof(size));
+            memcpy(&data[sizeof(size)], &hdr, sizeof(hdr));
+            memcpy(&data[sizeof(size) + sizeof(hdr)], payload, payload_size);
+        }
+        free(payload);
+    } else if((data = malloc(data_size))) {
+        memcpy(data, src, data_size);
+    }
+
+    if(!data)
+        return ENOMEM;
+
+    for(last = &replay->states; (state = *last); last = &state->next) {
+        if(state->type == entry->type && state->id == entry->id && entry->type != GLC_MESSAGE_VIDEO_DELTA)
+            break;
+    }
+
+    if(!state) {
+        if(!(state = calloc(1, sizeof(*state)))) {
+            free(data);
+            return ENOMEM;
+        }
+        state->type = entry->type;
+        state->id = entry->id;
+        *last = state;
+    }
+
+    replay->states_size += data_size - state->size;
+    free(state->data);
+    state->data = data;
+    state->size = data_size;
+    return 0;
+}
+
+static struct glc_replay_state_s *glc_replay_state_find(glc_replay *replay, glc_message_type_t type,
+                                                         glc_stream_id_t id) {
+    struct glc_replay_state_s *state;
+
+    for(state = replay->states; state; state = state->next) {
+        if(state->type == type && state->id == id)
+            break;
+    }
+    return state;
+}
+
+static void glc_replay_states_free(struct glc_replay_state_s *states) {
+    struct glc_replay_state_s *state;
+
+    while((state = states)) {
+        states = state->next;
+        free(state->data);
+        free(state);
+    }
+}
+
+static void glc_replay_state_drop(glc_replay *replay, glc_message_type_t type, glc_stream_id_t id) {
+    struct glc_replay_state_s *state, **last;
+
+    last = &replay->states;
+    while((state = *last)) {
+        if(state->type == type && state->id == id) {
+            *last = state->next;
+            replay->states_size -= state->size;
+            free(state->data);
+            free(state);
+        } else {
+            last = &state->next;
+        }
+    }
+}
+
+/**  \} */
@@ -0,0 +1,121 @@
+/**
+ * \file src/server/replay.h
+ * \brief instant replay buffer
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_replay replay buffer
+ *  The replay buffer keeps the last seconds of a client's messages in
+ *  memory instead of writing them to disk. Messages are compressed with
+ *  a compression stage and stored in a ring of fixed size, already in
+ *  stream file layout. Messages older than the duration are dropped, as
+ *  are the oldest ones when the ring is full.
+ *
+ *  Nothing is written until a clip is saved, either with
+ *  glc_replay_save() or when a GLC_MESSAGE_REPLAY message is submitted.
+ *  A clip is a complete stream file: the stream info, the format and
+ *  color messages and the last full frame of each video stream with the
+ *  deltas since, as they were at the start of the buffer, the buffered
+ *  messages, a closing message and the trailing index, see
+ *  glc_index_entry_t. The deltas count against the buffer's size, if they
+ *  grow past half of it the buffer drops the rest of that group of
+ *  pictures and starts at the stream's next full frame.
+ *
+ *  A replay buffer is not thread-safe, it is fed by one thread at a time
+ *  (e.g. from one client's serial queue). A clip is a snapshot of the
+ *  ring taken on that thread, its messages are written one at a time
+ *  while the ring keeps taking new ones. Messages the ring drops before
+ *  they are written are kept for the clip, so a save never holds up the
+ *  compression stage. A GLC_MESSAGE_REPLAY clip is written by a thread
+ *  of its own, glc_replay_save() writes on the calling thread.
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_REPLAY_H
+#define GLC2_SERVER_REPLAY_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "format.h"
+#include "pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_replay_s glc_replay;
+
+typedef struct glc_replay_options_s {
+    /** microseconds of messages kept */
+    glc_utime_t duration;
+    /** bytes of compressed messages and of the states at the start kept at most */
+    size_t max_size;
+    /** clips are saved to this path plus "-<n>.glc", NULL ignores GLC_MESSAGE_REPLAY */
+    const char *path;
+} glc_replay_options;
+
+/**
+ * \brief create a replay buffer
+ * \param replay returned replay buffer
+ * \param pool pool which compresses the messages
+ * \param options options or NULL for defaults (60 seconds, 512 MiB,
+ *        "replay")
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_replay_create(glc_replay **replay, glc_pool *pool, glc_replay_options *options);
+
+/**
+ * \brief destroy a replay buffer without saving it
+ * \param replay the replay buffer
+ * \return 0 on success otherwise the first error which occured
+ */
+__PUBLIC int glc_replay_destroy(glc_replay *replay);
+
+/**
+ * \brief set the stream info clips start with
+ *
+ * name_size and date_size of info are ignored, the date is the time a
+ * clip is saved.
+ * \param replay the replay buffer
+ * \param info stream info
+ * \param name name of the captured program
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_replay_set_info(glc_replay *replay, const glc_stream_info_t *info, const char *name);
+
+/**
+ * \brief submit a message
+ *
+ * The payload is copied, so it can be released right away (e.g. a
+ * glc_server_view). A GLC_MESSAGE_REPLAY message is not kept, it saves
+ * a clip in the background. An error of that clip is returned when the
+ * next one is saved or the buffer is destroyed.
+ * \param replay the replay buffer
+ * \param hdr message header
+ * \param iov payload segments
+ * \param count number of segments
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_replay_submit(glc_replay *replay, glc_message_header_t *hdr, const struct iovec *iov, int count);
+
+/**
+ * \brief write the buffered messages to a stream file
+ *
+ * The buffer is kept, the next clip overlaps with this one. May be
+ * called from inside a job of the replay's pool.
+ * \param replay the replay buffer
+ * \param path file to write
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_replay_save(glc_replay *replay, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
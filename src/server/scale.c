@@ -0,0 +1,616 @@
+/**
+ * \file src/server/scale.c
+ * \brief video scaling stage
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_scale
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "scale.h"
+#include "delta.h"
+
+#define GLC_SCALE_BAND 32
+/** fraction bits of the filter weights */
+#define GLC_SCALE_BITS 14
+
+typedef int32_t glc_scale_vec __attribute__ ((vector_size (32)));
+typedef int32_t glc_scale_pixel __attribute__ ((vector_size (16)));
+typedef u_int32_t glc_scale_uvec __attribute__ ((vector_size (32)));
+typedef u_int16_t glc_scale_sums __attribute__ ((vector_size (32)));
+typedef u_int16_t glc_scale_half __attribute__ ((vector_size (16)));
+typedef unsigned char glc_scale_bytes __attribute__ ((vector_size (16)));
+typedef unsigned char glc_scale_bytes8 __attribute__ ((vector_size (8)));
+
+/** filter of one axis of a plane */
+struct glc_scale_axis_s {
+    unsigned int src, dst;
+    /** source pixels per destination pixel if box sums can be used, otherwise 0 */
+    unsigned int ratio;
+    /** source pixels which contribute to one destination pixel */
+    unsigned int taps;
+    /** first source pixel of each destination pixel */
+    unsigned int *start;
+    /** taps weights for each destination pixel */
+    int16_t *weights;
+};
+
+struct glc_scale_plane_s {
+    unsigned int bpp;
+    size_t src_offset, src_stride;
+    size_t dst_offset, dst_stride;
+    struct glc_scale_axis_s x, y;
+    /** sum whole blocks of pixels */
+    int box;
+    /** box sums are turned into averages with ((sum + n / 2) * recip) >> 16 */
+    u_int32_t recip;
+};
+
+struct glc_scale_stream_s {
+    glc_delta_stream_t head;
+    /** bytes of pixel data in a source frame, 0 if frames are passed on */
+    size_t size;
+    /** bytes of pixel data in a scaled frame */
+    size_t dst_size;
+    /** bytes of one filtered row */
+    size_t row_size;
+    int planes;
+    struct glc_scale_plane_s plane[3];
+};
+
+/** one frame, its bands are scaled with glc_pool_for() */
+struct glc_scale_job_s {
+    glc_scale *scale;
+    const struct glc_scale_stream_s *stream;
+    const unsigned char *src;
+    unsigned char *dst;
+};
+
+struct glc_scale_s {
+    glc_pool *pool;
+    unsigned int width, height;
+    int filter;
+    unsigned int band;
+    glc_scale_output output;
+    void *udata;
+    glc_delta_stream_t *streams;
+    glc_delta_scratch_t scratch;
+    /** scaled frame with its header */
+    unsigned char *out;
+    size_t out_size;
+    /** one filtered row for each thread of a loop */
+    unsigned char *tmp;
+    size_t tmp_size;
+};
+
+static void glc_scale_stream_clear(struct glc_scale_stream_s *stream);
+static int glc_scale_format(glc_scale *scale, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_scale_plane_init(glc_scale *scale, struct glc_scale_plane_s *plane, unsigned int bpp,
+                                unsigned int width, unsigned int height, unsigned int dst_width,
+                                unsigned int dst_height, int aligned);
+static int glc_scale_axis_init(struct glc_scale_axis_s *axis, unsigned int src, unsigned int dst, int filter);
+static int glc_scale_frame(glc_scale *scale, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_scale_delta(glc_scale *scale, glc_message_header_t *hdr, const struct iovec *iov, int count);
+static int glc_scale_run(glc_scale *scale, const struct glc_scale_stream_s *stream,
+                         const unsigned char *src, unsigned char *dst);
+static void glc_scale_band(void *arg, int band, int slot);
+static void glc_scale_sum_rows(const unsigned char *src, size_t stride, unsigned int rows, size_t n,
+                               u_int16_t *sums);
+static void glc_scale_box_row(const u_int16_t *sums, unsigned int bpp, unsigned int ratio, u_int32_t recip,
+                              unsigned int half, size_t n, unsigned char *dst);
+static void glc_scale_filter_rows(const unsigned char *src, size_t stride, const int16_t *weights,
+                                  unsigned int taps, size_t n, unsigned char *dst);
+static void glc_scale_filter_row(const unsigned char *src, unsigned int bpp, const struct glc_scale_axis_s *axis,
+                                 unsigned char *dst);
+
+int glc_scale_create(glc_scale **scale, glc_pool *pool, glc_scale_options *options,
+                     glc_scale_output output, void *udata) {
+    glc_scale *s;
+
+    if(!options || (!options->width && !options->height))
+        return EINVAL;
+    if(options->filter && options->filter != GLC_SCALE_BOX && options->filter != GLC_SCALE_BILINEAR)
+        return EINVAL;
+
+    if(!(s = calloc(1, sizeof(*s))))
+        return ENOMEM;
+
+    s->pool = pool;
+    s->width = options->width;
+    s->height = options->height;
+    s->filter = options->filter ? options->filter : GLC_SCALE_BOX;
+    s->band = options->band ? options->band : GLC_SCALE_BAND;
+    s->output = output;
+    s->udata = udata;
+
+    *scale = s;
+    return 0;
+}
+
+int glc_scale_destroy(glc_scale *scale) {
+    struct glc_scale_stream_s *stream;
+
+    while((stream = (struct glc_scale_stream_s *) scale->streams)) {
+        scale->streams = stream->head.next;
+        glc_scale_stream_clear(stream);
+        free(stream);
+    }
+
+    free(scale->scratch.data);
+    free(scale->out);
+    free(scale->tmp);
+    free(scale);
+    return 0;
+}
+
+int glc_scale_submit(glc_scale *scale, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    if(hdr->type == GLC_MESSAGE_VIDEO_FORMAT)
+        return glc_scale_format(scale, hdr, iov, count);
+    if(hdr->type == GLC_MESSAGE_VIDEO_FRAME)
+        return glc_scale_frame(scale, hdr, iov, count);
+    if(hdr->type == GLC_MESSAGE_VIDEO_DELTA)
+        return glc_scale_delta(scale, hdr, iov, count);
+    return scale->output(hdr, iov, count, scale->udata);
+}
+
+static void glc_scale_stream_clear(struct glc_scale_stream_s *stream) {
+    int i;
+
+    for(i = 0; i < stream->planes; i++) {
+        free(stream->plane[i].x.start);
+        free(stream->plane[i].x.weights);
+        free(stream->plane[i].y.start);
+        free(stream->plane[i].y.weights);
+    }
+
+    memset(stream->plane, 0, sizeof(stream->plane));
+    stream->planes = 0;
+    stream->size = 0;
+}
+
+static int glc_scale_format(glc_scale *scale, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_scale_stream_s *stream;
+    glc_video_format_message_t format;
+    unsigned int width, height, bpp, cw, ch, dst_cw, dst_ch, i;
+    struct iovec format_iov;
+    size_t stride, offset = 0, dst_offset = 0, row_size;
+    int err;
+
+    if(glc_delta_read(iov, count, &format, sizeof(format)))
+        return scale->output(hdr, iov, count, scale->udata);
+
+    if(!(stream = (struct glc_scale_stream_s *) glc_delta_stream(&scale->streams, format.id, sizeof(*stream), 1)))
+        return ENOMEM;
+    glc_scale_stream_clear(stream);
+
+    if(!format.width || !format.height)
+        return scale->output(hdr, iov, count, scale->udata);
+
+    width = scale->width;
+    height = scale->height;
+    if(!width)
+        width = ((u_int64_t) format.width * height + format.height / 2) / format.height;
+    else if(!height)
+        height = ((u_int64_t) format.height * width + format.width / 2) / format.width;
+    width = width < 1 ? 1 : width > format.width ? format.width : width;
+    height = height < 1 ? 1 : height > format.height ? format.height : height;
+
+    if(width == format.width && height == format.height)
+        return scale->output(hdr, iov, count, scale->udata);
+
+    if(format.format == GLC_VIDEO_YCBCR_420JPEG) {
+        cw = (format.width + 1) / 2;
+        ch = (format.height + 1) / 2;
+        dst_cw = (width + 1) / 2;
+        dst_ch = (height + 1) / 2;
+
+        stream->planes = 3;
+        for(i = 0; i < 3; i++) {
+            if((err = glc_scale_plane_init(scale, &stream->plane[i], 1, i ? cw : format.width,
+                                           i ? ch : format.height, i ? dst_cw : width,
+                                           i ? dst_ch : height, 0)))
+                goto error;
+            stream->plane[i].src_offset = offset;
+            stream->plane[i].dst_offset = dst_offset;
+            offset += stream->plane[i].src_stride * stream->plane[i].y.src;
+            dst_offset += stream->plane[i].dst_stride * stream->plane[i].y.dst;
+        }
+    } else if(!glc_delta_geometry(&format, &bpp, &stride)) {
+        stream->planes = 1;
+        if((err = glc_scale_plane_init(scale, &stream->plane[0], bpp, format.width, format.height,
+                                       width, height, format.flags & GLC_VIDEO_DWORD_ALIGNED)))
+            goto error;
+        offset = stride * format.height;
+        dst_offset = stream->plane[0].dst_stride * height;
+    } else
+        return scale->output(hdr, iov, count, scale->udata);
+
+    stream->row_size = 0;
+    for(i = 0; i < (unsigned int) stream->planes; i++) {
+        /* 16 bit sums or filtered bytes */
+        row_size = (size_t) stream->plane[i].x.src * stream->plane[i].bpp * sizeof(u_int16_t);
+        if(row_size > stream->row_size)
+            stream->row_size = row_size;
+    }
+
+    stream->size = offset;
+    stream->dst_size = dst_offset;
+
+    format.width = width;
+    format.height = height;
+    format_iov.iov_base = &format;
+    format_iov.iov_len = sizeof(format);
+    return scale->output(hdr, &format_iov, 1, scale->udata);
+
+error:
+    glc_scale_stream_clear(stream);
+    return err;
+}
+
+static int glc_scale_plane_init(glc_scale *scale, struct glc_scale_plane_s *plane, unsigned int bpp,
+                                unsigned int width, unsigned int height, unsigned int dst_width,
+                                unsigned int dst_height, int aligned) {
+    unsigned int n;
+    int err;
+
+    plane->bpp = bpp;
+    plane->src_stride = (size_t) width * bpp;
+    plane->dst_stride = (size_t) dst_width * bpp;
+    if(aligned) {
+        plane->src_stride = (plane->src_stride + 7) & ~((size_t) 7);
+        plane->dst_stride = (plane->dst_stride + 7) & ~((size_t) 7);
+    }
+
+    if((err = glc_scale_axis_init(&plane->x, width, dst_width, scale->filter)))
+        return err;
+    if((err = glc_scale_axis_init(&plane->y, height, dst_height, scale->filter)))
+        return err;
+
+    /* 16 bit sums hold 257 pixels */
+    n = plane->x.ratio * plane->y.ratio;
+    plane->box = n && n <= 256;
+    if(plane->box)
+        plane->recip = (65536 + n / 2) / n;
+    return 0;
+}
+
+static int glc_scale_axis_init(struct glc_scale_axis_s *axis, unsigned int src, unsigned int dst, int filter) {
+    double ratio = (double) src / dst, lo, hi, center, frac, *w;
+    unsigned int i, t, first, j;
+    int sum, max;
+
+    axis->src = src;
+    axis->dst = dst;
+    /* bilinear taps of a 2:1 axis fall on pixel pairs, that is a box too */
+    axis->ratio = src % dst == 0 && (filter == GLC_SCALE_BOX || src / dst <= 2) ? src / dst : 0;
+    axis->taps = filter == GLC_SCALE_BOX ? (src + dst - 1) / dst + 1 : 2;
+    if(axis->ratio)
+        axis->taps = axis->ratio;
+    if(axis->taps > src)
+        axis->taps = src;
+
+    axis->start = malloc(sizeof(*axis->start) * dst);
+    axis->weights = malloc(sizeof(*axis->weights) * dst * axis->taps);
+    w = malloc(sizeof(*w) * axis->taps);
+    if(!axis->start || !axis->weights || !w) {
+        free(w);
+        return ENOMEM;
+    }
+
+    for(i = 0; i < dst; i++) {
+        memset(w, 0, sizeof(*w) * axis->taps);
+
+        if(filter == GLC_SCALE_BOX) {
+            lo = i * ratio;
+            hi = lo + ratio;
+            first = (unsigned int) lo;
+            axis->start[i] = first < src - axis->taps ? first : src - axis->taps;
+            for(j = first; j < axis->start[i] + axis->taps && j < hi; j++)
+                w[j - axis->start[i]] = ((j + 1 < hi ? j + 1 : hi) - (j > lo ? j : lo)) / ratio;
+        } else {
+            center = (i + 0.5) * ratio - 0.5;
+            if(center < 0)
+                center = 0;
+            first = (unsigned int) center;
+            frac = center - first;
+            if(first >= src - 1) {
+                first = src - 1;
+                frac = 0;
+            }
+            axis->start[i] = first < src - axis->taps ? first : src - axis->taps;
+            w[first - axis->start[i]] += 1 - frac;
+            if(frac > 0)
+                w[first + 1 - axis->start[i]] += frac;
+        }
+
+        /* rounding must not change the sum, the rest goes to the largest tap */
+        sum = 0;
+        max = 0;
+        for(t = 0; t < axis->taps; t++) {
+            axis->weights[i * axis->taps + t] = w[t] * (1 << GLC_SCALE_BITS) + 0.5;
+            sum += axis->weights[i * axis->taps + t];
+            if(w[t] > w[max])
+                max = t;
+        }
+        axis->weights[i * axis->taps + max] += (1 << GLC_SCALE_BITS) - sum;
+    }
+
+    free(w);
+    return 0;
+}
+
+static int glc_scale_frame(glc_scale *scale, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_scale_stream_s *stream;
+    glc_video_frame_header_t frame;
+    const unsigned char *data;
+    struct iovec out_iov;
+    size_t size;
+    int err;
+
+    if(glc_delta_read(iov, count, &frame, sizeof(frame)))
+        return scale->output(hdr, iov, count, scale->udata);
+
+    stream = (struct glc_scale_stream_s *) glc_delta_stream(&scale->streams, frame.id, sizeof(*stream), 0);
+    if(!stream || !stream->size)
+        return scale->output(hdr, iov, count, scale->udata);
+
+    if((err = glc_delta_join(&scale->scratch, iov, count, &data, &size)))
+        return err;
+    if(size - sizeof(frame) != stream->size)
+        return scale->output(hdr, iov, count, scale->udata);
+
+    if(sizeof(frame) + stream->dst_size > scale->out_size) {
+        unsigned char *out = realloc(scale->out, sizeof(frame) + stream->dst_size);
+        if(!out)
+            return ENOMEM;
+        scale->out = out;
+        scale->out_size = sizeof(frame) + stream->dst_size;
+    }
+
+    if((err = glc_scale_run(scale, stream, &data[sizeof(frame)], &scale->out[sizeof(frame)])))
+        return err;
+
+    memcpy(scale->out, &frame, sizeof(frame));
+    out_iov.iov_base = scale->out;
+    out_iov.iov_len = sizeof(frame) + stream->dst_size;
+    return scale->output(hdr, &out_iov, 1, scale->udata);
+}
+
+/* the tiles of a delta are unscaled, a reader could not apply them to the scaled frames */
+static int glc_scale_delta(glc_scale *scale, glc_message_header_t *hdr, const struct iovec *iov, int count) {
+    struct glc_scale_stream_s *stream;
+    glc_video_delta_header_t delta;
+
+    if(glc_delta_read(iov, count, &delta, sizeof(delta)))
+        return scale->output(hdr, iov, count, scale->udata);
+
+    stream = (struct glc_scale_stream_s *) glc_delta_stream(&scale->streams, delta.id, sizeof(*stream), 0);
+    if(stream && stream->size)
+        return ENOTSUP;
+    return scale->output(hdr, iov, count, scale->udata);
+}
+
+static int glc_scale_run(glc_scale *scale, const struct glc_scale_stream_s *stream,
+                         const unsigned char *src, unsigned char *dst) {
+    struct glc_scale_job_s job;
+    size_t tmp_size = stream->row_size * (glc_pool_threads(scale->pool) + 1);
+    int bands = 0, i;
+
+    if(tmp_size > scale->tmp_size) {
+        /* u_int16_t sums, malloc alignment is enough */
+        unsigned char *tmp = realloc(scale->tmp, tmp_size);
+        if(!tmp)
+            return ENOMEM;
+        scale->tmp = tmp;
+        scale->tmp_size = tmp_size;
+    }
+
+    for(i = 0; i < stream->planes; i++)
+        bands += (stream->plane[i].y.dst + scale->band - 1) / scale->band;
+
+    job.scale = scale;
+    job.stream = stream;
+    job.src = src;
+    job.dst = dst;
+    return glc_pool_for(scale->pool, bands, glc_scale_band, &job);
+}
+
+static void glc_scale_band(void *arg, int band, int slot) {
+    const struct glc_scale_job_s *job = arg;
+    const struct glc_scale_stream_s *stream = job->stream;
+    const struct glc_scale_plane_s *plane = stream->plane;
+    unsigned char *tmp = &job->scale->tmp[(size_t) slot * stream->row_size];
+    unsigned int y, end, bands, rows = job->scale->band;
+    const unsigned char *src;
+    unsigned char *dst;
+    size_t n, dst_n;
+
+    /* bands are numbered through all planes */
+    while(band >= (int) (bands = (plane->y.dst + rows - 1) / rows)) {
+        band -= bands;
+        plane++;
+    }
+
+    y = band * rows;
+    end = y + rows < plane->y.dst ? y + rows : plane->y.dst;
+    n = (size_t) plane->x.src * plane->bpp;
+    dst_n = (size_t) plane->x.dst * plane->bpp;
+
+    for(; y < end; y++) {
+        src = &job->src[plane->src_offset + plane->y.start[y] * plane->src_stride];
+        dst = &job->dst[plane->dst_offset + y * plane->dst_stride];
+
+        if(plane->box) {
+            glc_scale_sum_rows(src, plane->src_stride, plane->y.ratio, n, (u_int16_t *) tmp);
+            glc_scale_box_row((const u_int16_t *) tmp, plane->bpp, plane->x.ratio, plane->recip,
+                              plane->x.ratio * plane->y.ratio / 2, dst_n, dst);
+        } else {
+            glc_scale_filter_rows(src, plane->src_stride, &plane->y.weights[y * plane->y.taps],
+                                  plane->y.taps, n, tmp);
+            glc_scale_filter_row(tmp, plane->bpp, &plane->x, dst);
+        }
+
+        /* keep the alignment padding reproducible for the compressor */
+        if(plane->dst_stride > dst_n)
+            memset(&dst[dst_n], 0, plane->dst_stride - dst_n);
+    }
+}
+
+/**
+ * Adds up rows bytes of consecutive rows, 16 at a time in 16 bit lanes.
+ */
+__attribute__ ((target_clones ("avx2", "default")))
+static void glc_scale_sum_rows(const unsigned char *src, size_t stride, unsigned int rows, size_t n,
+                               u_int16_t *sums) {
+    glc_scale_sums acc;
+    glc_scale_bytes b;
+    unsigned int r;
+    size_t x;
+
+    for(x = 0; x + 16 <= n; x += 16) {
+        memcpy(&b, &src[x], sizeof(b));
+        acc = __builtin_convertvector(b, glc_scale_sums);
+        for(r = 1; r < rows; r++) {
+            memcpy(&b, &src[r * stride + x], sizeof(b));
+            acc += __builtin_convertvector(b, glc_scale_sums);
+        }
+        memcpy(&sums[x], &acc, sizeof(acc));
+    }
+
+    for(; x < n; x++) {
+        sums[x] = 0;
+        for(r = 0; r < rows; r++)
+            sums[x] += src[r * stride + x];
+    }
+}
+
+/**
+ * Adds up ratio neighbouring pixels of summed rows and turns the sums
+ * into averages. Pairs of single byte or BGRA pixels take the vector path,
+ * that is every 2:1 downscale.
+ */
+__attribute__ ((target_clones ("avx2", "default")))
+static void glc_scale_box_row(const u_int16_t *sums, unsigned int bpp, unsigned int ratio, u_int32_t recip,
+                              unsigned int half, size_t n, unsigned char *dst) {
+    const glc_scale_half lo1 = {0, 2, 4, 6, 8, 10, 12, 14}, hi1 = {1, 3, 5, 7, 9, 11, 13, 15};
+    const glc_scale_half lo4 = {0, 1, 2, 3, 8, 9, 10, 11}, hi4 = {4, 5, 6, 7, 12, 13, 14, 15};
+    glc_scale_half a, b, s;
+    glc_scale_uvec v;
+    glc_scale_bytes8 out;
+    unsigned int i, c, sum;
+    size_t x = 0, p;
+
+    for(; ratio == 2 && (bpp == 1 || bpp == 4) && x + 8 <= n; x += 8) {
+        memcpy(&a, &sums[x * 2], sizeof(a));
+        memcpy(&b, &sums[x * 2 + 8], sizeof(b));
+        /* constant masks, so each is a single shuffle */
+        if(bpp == 4)
+            s = __builtin_shuffle(a, b, lo4) + __builtin_shuffle(a, b, hi4);
+        else
+            s = __builtin_shuffle(a, b, lo1) + __builtin_shuffle(a, b, hi1);
+        v = ((__builtin_convertvector(s, glc_scale_uvec) + half) * recip) >> 16;
+        out = __builtin_convertvector(v, glc_scale_bytes8);
+        memcpy(&dst[x], &out, sizeof(out));
+    }
+
+    for(; x < n; x += bpp) {
+        p = x * ratio;
+        for(c = 0; c < bpp; c++) {
+            sum = 0;
+            for(i = 0; i < ratio; i++)
+                sum += sums[p + i * bpp + c];
+            dst[x + c] = ((sum + half) * recip) >> 16;
+        }
+    }
+}
+
+/**
+ * Weighted sum of taps consecutive rows, 16 bytes at a time in 32 bit
+ * lanes. Bytes are widened to 16 bit first, GCC does not vectorize a
+ * direct conversion to 32 bit.
+ */
+__attribute__ ((target_clones ("avx2", "default")))
+static void glc_scale_filter_rows(const unsigned char *src, size_t stride, const int16_t *weights,
+                                  unsigned int taps, size_t n, unsigned char *dst) {
+    glc_scale_vec acc[2];
+    glc_scale_half half[2];
+    glc_scale_sums wide;
+    glc_scale_bytes b;
+    glc_scale_bytes8 out;
+    unsigned int t, i;
+    int32_t sum;
+    size_t x;
+
+    for(x = 0; x + 16 <= n; x += 16) {
+        acc[0] = acc[1] = (glc_scale_vec) {} + (1 << (GLC_SCALE_BITS - 1));
+        for(t = 0; t < taps; t++) {
+            memcpy(&b, &src[t * stride + x], sizeof(b));
+            wide = __builtin_convertvector(b, glc_scale_sums);
+            memcpy(half, &wide, sizeof(wide));
+            for(i = 0; i < 2; i++)
+                acc[i] += weights[t] * __builtin_convertvector(half[i], glc_scale_vec);
+        }
+        for(i = 0; i < 2; i++) {
+            out = __builtin_convertvector(__builtin_convertvector(acc[i] >> GLC_SCALE_BITS, glc_scale_half),
+                                          glc_scale_bytes8);
+            memcpy(&dst[x + i * 8], &out, sizeof(out));
+        }
+    }
+
+    for(; x < n; x++) {
+        sum = 1 << (GLC_SCALE_BITS - 1);
+        for(t = 0; t < taps; t++)
+            sum += weights[t] * src[t * stride + x];
+        dst[x] = sum >> GLC_SCALE_BITS;
+    }
+}
+
+/**
+ * Weighted sum of neighbouring pixels of a filtered row, BGRA pixels with
+ * all four channels in one vector.
+ */
+__attribute__ ((target_clones ("avx2", "default")))
+static void glc_scale_filter_row(const unsigned char *src, unsigned int bpp, const struct glc_scale_axis_s *axis,
+                                 unsigned char *dst) {
+    const glc_scale_pixel shift = {0, 8, 16, 24};
+    const int16_t *w = axis->weights;
+    const unsigned char *p;
+    glc_scale_pixel acc;
+    unsigned int x, t, c;
+    u_int32_t pixel;
+    int32_t sum;
+
+    if(bpp == 4) {
+        for(x = 0; x < axis->dst; x++, w += axis->taps) {
+            p = &src[(size_t) axis->start[x] * 4];
+            acc = (glc_scale_pixel) {} + (1 << (GLC_SCALE_BITS - 1));
+            for(t = 0; t < axis->taps; t++) {
+                memcpy(&pixel, &p[t * 4], sizeof(pixel));
+                acc += w[t] * (((glc_scale_pixel) {} + (int32_t) pixel) >> shift & 0xff);
+            }
+            acc >>= GLC_SCALE_BITS;
+            pixel = acc[0] | acc[1] << 8 | acc[2] << 16 | (u_int32_t) acc[3] << 24;
+            memcpy(&dst[x * 4], &pixel, sizeof(pixel));
+        }
+        return;
+    }
+
+    for(x = 0; x < axis->dst; x++, w += axis->taps) {
+        p = &src[(size_t) axis->start[x] * bpp];
+        for(c = 0; c < bpp; c++) {
+            sum = 1 << (GLC_SCALE_BITS - 1);
+            for(t = 0; t < axis->taps; t++)
+                sum += w[t] * p[t * bpp + c];
+            dst[x * bpp + c] = sum >> GLC_SCALE_BITS;
+        }
+    }
+}
+
+/**  \} */
@@ -0,0 +1,116 @@
+/**
+ * \file src/server/scale.h
+ * \brief video scaling stage
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_scale video scaling
+ *  The scaling stage shrinks video frames to a smaller size, e.g. to
+ *  record a 4K game at 1080p without writing the full frames first. It
+ *  takes BGRA, BGR, RGB and GLC_VIDEO_YCBCR_420JPEG streams; the planes
+ *  of the latter are scaled one by one. Frames are never enlarged.
+ *
+ *  GLC_SCALE_BOX averages all source pixels a destination pixel covers,
+ *  GLC_SCALE_BILINEAR interpolates between the two nearest ones and is
+ *  cheaper but aliases at ratios above two. Both are separable filters
+ *  with 14 bit fixed point weights: source rows are filtered into one
+ *  row first, which is then filtered along the row. When the sizes are a
+ *  whole multiple of each other (3840x2160 to 1920x1080 or 1280x720) the
+ *  box filter sums the pixels of each block in 16 bit lanes instead. The
+ *  kernels are built with GCC vector extensions for AVX2 and the SSE2
+ *  baseline and picked at load time.
+ *
+ *  Frames are split into bands of destination rows which are scaled on
+ *  the worker pool with glc_pool_for(), so the submitting thread scales
+ *  bands too.
+ *
+ *  Video format messages of scaled streams are passed on with the new
+ *  width and height, frames of other streams and all other messages
+ *  unchanged, in order. The stage goes in front of the conversion, the
+ *  deduplication and the compression stage: delta frames of scaled
+ *  streams can not be scaled and are refused with ENOTSUP. It is not
+ *  thread-safe, it is fed by one thread at a time and calls the output
+ *  from glc_scale_submit().
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_SCALE_H
+#define GLC2_SERVER_SCALE_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "format.h"
+#include "pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_scale_s glc_scale;
+
+/**
+ * \brief receives the messages of a stage in submission order
+ * \param hdr message header
+ * \param iov payload segments, only valid during the call
+ * \param count number of segments
+ * \param udata data passed to glc_scale_create()
+ * \return 0 on success, an error is returned by the submit
+ */
+typedef int (*glc_scale_output)(glc_message_header_t *hdr, const struct iovec *iov, int count, void *udata);
+
+/** average all source pixels a destination pixel covers */
+#define GLC_SCALE_BOX        0x1
+/** interpolate between the two nearest source pixels */
+#define GLC_SCALE_BILINEAR   0x2
+
+typedef struct glc_scale_options_s {
+    /** destination width, 0 to keep the aspect ratio */
+    unsigned int width;
+    /** destination height, 0 to keep the aspect ratio */
+    unsigned int height;
+    /** GLC_SCALE_BOX or GLC_SCALE_BILINEAR, 0 for box */
+    int filter;
+    /** destination rows scaled by one job, 0 for 32 */
+    unsigned int band;
+} glc_scale_options;
+
+/**
+ * \brief create a scaling stage
+ * \param scale returned stage
+ * \param pool pool which scales the bands
+ * \param options options, width or height must be set
+ * \param output receives the messages
+ * \param udata data passed to output
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_scale_create(glc_scale **scale, glc_pool *pool, glc_scale_options *options,
+                              glc_scale_output output, void *udata);
+
+/**
+ * \brief destroy a stage
+ * \param scale the stage
+ * \return 0 on success
+ */
+__PUBLIC int glc_scale_destroy(glc_scale *scale);
+
+/**
+ * \brief submit a message
+ * \param scale the stage
+ * \param hdr message header
+ * \param iov payload segments
+ * \param count number of segments
+ * \return 0 on success, ENOTSUP for a delta frame of a scaled stream,
+ *         otherwise an error code
+ */
+__PUBLIC int glc_scale_submit(glc_scale *scale, glc_message_header_t *hdr, const struct iovec *iov, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
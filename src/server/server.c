@@ -1,8 +1,20 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 
 #include "server.h"
 
@@ -18,12 +30,46 @@
     for (i = 0; i < S; ++i) printf("%02X ", px[i]); \
 }
 
+#define GLC_SERVER_SLOT_MASK ((1 << GLC_SERVER_SLOT_BITS) - 1)
+/** generations must keep node ids positive */
+#define GLC_SERVER_GEN_MAX ((1 << (31 - GLC_SERVER_SLOT_BITS)) - 1)
+
 #define HANDLE_ERROR(S, R) (R == 0 ? 0 : (S->error_handler ? S->error_handler(R) : R ))
 
+static int glc_server_control_ready(glc_loop *loop, ps_buffer_t *buffer, void *udata);
+static int glc_server_client_ready(glc_loop *loop, ps_buffer_t *buffer, void *udata);
+static int glc_server_control_message(glc_server *server, glc_message_header_t *hdr, void *nmsg, size_t size);
+static int glc_server_dispatch(glc_server *server, glc_client *client, glc_message_header_t *hdr, void *msg, size_t size);
+static struct glc_server_slot_s *glc_server_slot(glc_server *server, int index);
+static int glc_server_slot_alloc(glc_server *server, int *index);
+static void glc_server_slot_free(glc_server *server, int index);
+static int glc_server_liveness_timer(glc_loop *loop, int fd, uint32_t events, void *udata);
+static int glc_server_client_exited(glc_loop *loop, int fd, uint32_t events, void *udata);
+static int glc_server_client_alive(glc_client *client);
+static void glc_server_client_reap(glc_server *server, glc_client *client);
+static int glc_server_client_attach(glc_client *client);
+static int glc_server_leases_create(glc_server *server, glc_server_options *options);
+static int glc_server_leases_reclaim(key_t key);
+static void glc_server_leases_destroy(glc_server *server);
+static int glc_server_ring_create(glc_server *server, struct glc_server_ring_s *ring);
+static void glc_server_ring_release(struct glc_server_ring_s *ring);
+static void glc_server_ring_recycle(glc_server *server, struct glc_server_ring_s *ring);
+static struct glc_server_ring_s *glc_server_ring_find(glc_server *server, int shmid, int data_shmid);
+static glc_lease_t *glc_server_lease(glc_server *server, int index);
+static int glc_server_client_insert(glc_server *server, glc_client *client, int index, pid_t pid);
+static int glc_server_client_new_memfd(glc_server *server, int fd, int data_fd, pid_t pid, int *client);
+static int glc_server_listen(glc_server *server, const char *name);
+static int glc_server_accept(glc_loop *loop, int fd, uint32_t events, void *udata);
+static int glc_server_hello(glc_loop *loop, int fd, uint32_t events, void *udata);
+static void glc_server_conn_close(glc_server *server, struct glc_server_conn_s *conn);
+static int glc_server_conn_release(glc_server *server, struct glc_server_conn_s *conn);
+static int glc_server_client_hangup(glc_loop *loop, int fd, uint32_t events, void *udata);
+
 
 glc_server *glc_server_create(glc_server_options *options, int *err) {
-    glc_server_options def = {0x676C6332, 0600, 1024 * 1024 * 25};
-    glc_server *s = malloc(sizeof(*s));
+    glc_server_options def = {0x676C6332, 0600, 1024 * 1024 * 25, 0, 2, 1024 * 1024 * 25, 1024 * 64,
+                               GLC_SOCKET_NAME, 0};
+    glc_server *s = calloc(1, sizeof(*s));
     if(!s) {
         *err = ENOMEM;
         return NULL;
@@ -33,10 +79,13 @@ glc_server *glc_server_create(glc_server_options *options, int *err) {
         options = &def;
     }
 
-    s->max_client = 1;
-    s->clients = NULL;
+    s->free_slot = -1;
+    s->timerfd = -1;
+    s->lease_shmid = -1;
+    s->listen_fd = -1;
+    s->caps = options->caps;
     s->error_handler = NULL;
-    
+
 
     int e;
     ps_bufferattr_t attr;
@@ -78,52 +127,224 @@ glc_server *glc_server_create(glc_server_options *options, int *err) {
         return NULL;
     }
 
-    // TODO start thread which handles client timeouts
+    if((e = glc_loop_create(&s->loop))) {
+        ps_packet_destroy(&s->packet);
+        ps_buffer_destroy(&s->buffer);
+        *err = e;
+        return NULL;
+    }
+
+    if((e = glc_pool_create(&s->pool, options->threads))) {
+        glc_loop_destroy(s->loop);
+        ps_packet_destroy(&s->packet);
+        ps_buffer_destroy(&s->buffer);
+        *err = e;
+        return NULL;
+    }
+
+    if((e = glc_loop_add_ring(s->loop, &s->buffer, glc_server_control_ready, s))) {
+        glc_pool_destroy(s->pool);
+        glc_loop_destroy(s->loop);
+        ps_packet_destroy(&s->packet);
+        ps_buffer_destroy(&s->buffer);
+        *err = e;
+        return NULL;
+    }
+
+    /* pidfds report dead clients at once, the timer catches the rest */
+    struct itimerspec interval = {{GLC_SERVER_LIVENESS_INTERVAL, 0}, {GLC_SERVER_LIVENESS_INTERVAL, 0}};
+    if((s->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1 ||
+       timerfd_settime(s->timerfd, 0, &interval, NULL) ||
+       glc_loop_add_fd(s->loop, s->timerfd, EPOLLIN, glc_server_liveness_timer, s)) {
+        e = errno;
+        if(s->timerfd != -1)
+            close(s->timerfd);
+        glc_pool_destroy(s->pool);
+        glc_loop_destroy(s->loop);
+        ps_packet_destroy(&s->packet);
+        ps_buffer_destroy(&s->buffer);
+        *err = e;
+        return NULL;
+    }
+
+    if(options->socket_name && (e = glc_server_listen(s, options->socket_name))) {
+        close(s->timerfd);
+        glc_pool_destroy(s->pool);
+        glc_loop_destroy(s->loop);
+        ps_packet_destroy(&s->packet);
+        ps_buffer_destroy(&s->buffer);
+        *err = e;
+        return NULL;
+    }
+
+    /* a private server is only reachable on its socket */
+    if(options->rings > 0 && options->shmkey != IPC_PRIVATE &&
+       (e = glc_server_leases_create(s, options))) {
+        if(s->listen_fd != -1)
+            close(s->listen_fd);
+        close(s->timerfd);
+        glc_pool_destroy(s->pool);
+        glc_loop_destroy(s->loop);
+        ps_packet_destroy(&s->packet);
+        ps_buffer_destroy(&s->buffer);
+        *err = e;
+        return NULL;
+    }
 
     *err = 0;
     return s;
 }
 
 void glc_server_destroy(glc_server *server) {
+    struct glc_server_slot_s *slot;
+    int i;
+
     assert(server != NULL);
 
+    for(i = 0; i < server->nslots; i++) {
+        slot = glc_server_slot(server, i);
+        if(slot->node)
+            glc_server_client_destroy(server, slot->node);
+    }
+
+    for(i = 0; i < GLC_SERVER_SLOT_CHUNKS && server->slots[i]; i++)
+        free(server->slots[i]);
+
+    glc_server_leases_destroy(server);
+
+    while(server->conns)
+        glc_server_conn_close(server, server->conns);
+    if(server->listen_fd != -1)
+        close(server->listen_fd);
+
+    glc_pool_destroy(server->pool);
+    glc_loop_destroy(server->loop);
+    close(server->timerfd);
+    free(server->scratch);
     ps_packet_destroy(&server->packet);
     ps_buffer_destroy(&server->buffer);
     free(server);
 }
 
-int glc_server_msg_receive(glc_server *server, glc_message_header_t *header, void **msg, size_t *msg_size, int flags) {
-    int err = 0, close_e = 0;
-    if((err = ps_packet_open(&server->packet, PS_PACKET_READ | flags)))
-        return err;
-
+static int glc_server_view_open(ps_packet_t *packet, glc_server_view *view, int flags) {
+    int err = 0;
     size_t size;
-    if((err = ps_packet_getsize(&server->packet, &size)))
-        goto close;
 
-    size -= sizeof(*header);
-    if((err = ps_packet_read(&server->packet, header, sizeof(*header))))
-        goto close;
+    if((err = ps_packet_open(packet, PS_PACKET_READ | flags)))
+        return err;
 
-    void *dest = malloc(size);
-    if(!dest) {
-        err = ENOMEM;
-        goto close;
+    if((err = ps_packet_getsize(packet, &size)))
+        goto error;
+
+    if(size < sizeof(view->header)) {
+        err = EPROTO;
+        goto error;
     }
 
-    if((err = ps_packet_read(&server->packet, dest, size)))
-        goto close;
+    size -= sizeof(view->header);
+    if((err = ps_packet_read(packet, &view->header, sizeof(view->header))))
+        goto error;
+
+    if((err = ps_packet_iov(packet, view->msg, &view->count, size)))
+        goto error;
+
+    view->size = size;
+    view->packet = packet;
+    return 0;
+
+error:
+    ps_packet_close(packet);
+    return err;
+}
+
+int glc_server_view_receive(glc_server *server, glc_server_view *view, int flags) {
+    return glc_server_view_open(&server->packet, view, flags);
+}
+
+int glc_server_client_view_receive(glc_server *server, glc_client *client, glc_server_view *view, int flags) {
+    (void) server;
+    return glc_server_view_open(&client->data_packet, view, flags);
+}
+
+int glc_server_view_copy(glc_server_view *view, void **msg) {
+    int i;
+    unsigned char *dest = malloc(view->size ? view->size : 1);
+    if(!dest)
+        return ENOMEM;
 
     *msg = dest;
-    *msg_size = size;
+    for(i = 0; i < view->count; i++) {
+        memcpy(dest, view->msg[i].iov_base, view->msg[i].iov_len);
+        dest += view->msg[i].iov_len;
+    }
 
-close:
-    close_e = ps_packet_close(&server->packet);
-    assert(close_e == 0);
+    return 0;
+}
 
+int glc_server_view_release(glc_server_view *view) {
+    int err = ps_packet_close(view->packet);
+    view->packet = NULL;
     return err;
 }
 
+/* contiguous payload, copied to the scratch buffer only if the view wraps */
+static int glc_server_view_flatten(glc_server *server, glc_server_view *view, void **msg) {
+    unsigned char *dest;
+    void *scratch;
+
+    if(view->count == 1) {
+        *msg = view->msg[0].iov_base;
+        return 0;
+    }
+
+    if(view->size > server->scratch_size) {
+        if(!(scratch = realloc(server->scratch, view->size)))
+            return ENOMEM;
+        server->scratch = scratch;
+        server->scratch_size = view->size;
+    }
+
+    dest = server->scratch;
+    memcpy(dest, view->msg[0].iov_base, view->msg[0].iov_len);
+    memcpy(dest + view->msg[0].iov_len, view->msg[1].iov_base, view->msg[1].iov_len);
+    *msg = server->scratch;
+    return 0;
+}
+
+static int glc_server_view_msg(glc_server_view *view, glc_message_header_t *header, void **msg, size_t *msg_size) {
+    int err, close_e;
+
+    err = glc_server_view_copy(view, msg);
+    close_e = glc_server_view_release(view);
+    assert(close_e == 0);
+    if(err)
+        return err;
+
+    *header = view->header;
+    *msg_size = view->size;
+    return 0;
+}
+
+int glc_server_msg_receive(glc_server *server, glc_message_header_t *header, void **msg, size_t *msg_size, int flags) {
+    glc_server_view view;
+    int err;
+
+    if((err = glc_server_view_receive(server, &view, flags)))
+        return err;
+
+    return glc_server_view_msg(&view, header, msg, msg_size);
+}
+
+int glc_server_client_msg_receive(glc_server *server, glc_client *client, glc_message_header_t *header, void **msg, size_t *msg_size, int flags) {
+    glc_server_view view;
+    int err;
+
+    if((err = glc_server_client_view_receive(server, client, &view, flags)))
+        return err;
+
+    return glc_server_view_msg(&view, header, msg, msg_size);
+}
+
 #if 0
 int glc_server_msg_get(glc_server *server, glc_server_msg *msg, int flags) {
     // TODO: split to receive and the rest (proxy like)
@@ -193,46 +414,111 @@ close:
 #endif
 
 int glc_server_run(glc_server *server, int flags) {
+    server->flags = flags;
+    return glc_loop_run(server->loop);
+}
+
+void glc_server_stop(glc_server *server) {
+    glc_loop_stop(server->loop);
+}
+
+static int glc_server_control_ready(glc_loop *loop, ps_buffer_t *buffer, void *udata) {
+    glc_server *server = udata;
+    glc_server_view view;
+    void *nmsg;
+    int err, close_e, i;
+    (void) loop;
+    (void) buffer;
+
+    for(i = 0; i < GLC_SERVER_BATCH; i++) {
+        err = glc_server_view_receive(server, &view, server->flags | PS_PACKET_TRY);
+        if(err == EBUSY)
+            return 0;
+        if((err = HANDLE_ERROR(server, err)))
+            return err;
+
+        if(!(err = glc_server_view_flatten(server, &view, &nmsg)))
+            err = glc_server_control_message(server, &view.header, nmsg, view.size);
+        close_e = glc_server_view_release(&view);
+        assert(close_e == 0);
+        if((err = HANDLE_ERROR(server, err)))
+            return err;
+    }
+
+    return EAGAIN;
+}
+
+static int glc_server_client_ready(glc_loop *loop, ps_buffer_t *buffer, void *udata) {
+    glc_client *client = udata;
+    glc_server *server = client->server;
+    glc_server_view view;
+    void *msg;
+    int err, close_e, i;
+    (void) loop;
+    (void) buffer;
+
+    for(i = 0; i < GLC_SERVER_BATCH; i++) {
+        err = glc_server_client_view_receive(server, client, &view, server->flags | PS_PACKET_TRY);
+        if(err == EBUSY)
+            return 0;
+        if((err = HANDLE_ERROR(server, err)))
+            return err;
+
+        if(!(err = glc_server_view_flatten(server, &view, &msg)))
+            err = glc_server_dispatch(server, client, &view.header, msg, view.size);
+        close_e = glc_server_view_release(&view);
+        assert(close_e == 0);
+        if((err = HANDLE_ERROR(server, err)))
+            return err;
+    }
+
+    return EAGAIN;
+}
+
+static int glc_server_control_message(glc_server *server, glc_message_header_t *hdr, void *nmsg, size_t size) {
     int err = 0;
-    glc_message_header_t hdr;
-    void *nmsg = NULL;
-    void *msg = NULL;
-    size_t size = 0;
 
-    while(1) {
-        if((err = HANDLE_ERROR(server, glc_server_msg_receive(server, &hdr, &nmsg, &size, flags))))
-            goto end;
+    if(hdr->type != GLC_MESSAGE_NETWORK || size < sizeof(glc_network_header_t))
+        return EPROTO;
 
-        if(hdr.type != GLC_MESSAGE_NETWORK && (err = HANDLE_ERROR(server, EPROTO)))
-            goto end;
+    glc_network_header_t *nhdr = nmsg;
+    glc_message_header_t payload_header = nhdr->payload_header;
+    void *msg = nmsg + sizeof(*nhdr);
+    size -= sizeof(*nhdr);
 
-        glc_network_header_t *nhdr = nmsg;
-        glc_message_type_t msg_type = nhdr->payload_header.type;
-        msg = nmsg + sizeof(*nhdr);
-        size -= sizeof(*nhdr);
+    if(payload_header.type == GLC_MESSAGE_CONNECT) {
+        glc_connect_message_t connect;
+        int node;
 
-        if(msg_type == GLC_MESSAGE_CONNECT) {
-            glc_connect_message_t *connect = msg;
-            if((err = HANDLE_ERROR(server, glc_server_client_new(server, connect->shmid, &connect->node))))
-                goto end;
+        /* older clients do not declare their frames */
+        memset(&connect, 0, sizeof(connect));
+        if(size < offsetof(glc_connect_message_t, frame_size))
+            return EPROTO;
+        memcpy(&connect, msg, size < sizeof(connect) ? size : sizeof(connect));
 
-            if((err = HANDLE_ERROR(server, glc_server_msg_sent(server, connect->node, &nhdr->payload_header, connect, sizeof(*connect), flags))))
-                goto end;
-        }
-        else {
-            printf("unknown message\n");
-        }
+        if((err = glc_server_client_new(server, connect.shmid, connect.data_shmid, &node)))
+            return err;
+
+        connect.node = node;
+        connect.msize = glc_server_ring_size(server, connect.frame_size, connect.frame_rate);
+        return glc_server_msg_sent(server, node, &payload_header, &connect, sizeof(connect), server->flags);
+    }
 
-        free(nmsg);
-        nmsg = NULL;
+    glc_client *client = glc_server_client_get(server, nhdr->node);
+    if(!client || !server->handlers[payload_header.type].handler) {
+        printf("unknown message\n");
+        return 0;
     }
 
+    return glc_server_dispatch(server, client, &payload_header, msg, size);
+}
 
-end:
-    if(nmsg != NULL)
-        free(nmsg);
+static int glc_server_dispatch(glc_server *server, glc_client *client, glc_message_header_t *hdr, void *msg, size_t size) {
+    glc_server_handler handler = server->handlers[hdr->type].handler;
+    if(!handler)
+        return 0;
 
-    return err;
+    return handler(server, client, hdr, msg, size, server->handlers[hdr->type].udata);
 }
 
 int glc_server_set_errorhandler(glc_server *server, int (*handler)(int)) {
@@ -241,17 +527,26 @@ int glc_server_set_errorhandler(glc_server *server, int (*handler)(int)) {
     return 0;
 }
 
+int glc_server_set_handler(glc_server *server, glc_message_type_t type, glc_server_handler handler, void *udata) {
+    assert(server != NULL);
+    server->handlers[type].handler = handler;
+    server->handlers[type].udata = udata;
+    return 0;
+}
+
 int glc_server_msg_sent(glc_server *server, int node, glc_message_header_t *hdr, void *msg, size_t size, int flags) {
     glc_client *c = glc_server_client_get(server, node);
+    if(!c)
+        return EINVAL;
 
     int err = 0;
-    if((err = ps_packet_open(&c->packet, PS_PACKET_WRITE | flags)))
+    if((err = ps_packet_open_sized(&c->packet, PS_PACKET_WRITE | flags, sizeof(*hdr) + size)))
         return err;
 
-    if((err = ps_packet_write(&c->packet, hdr, sizeof(*hdr))))
+    if((err = ps_packet_write_sized(&c->packet, hdr, sizeof(*hdr))))
         goto close;
 
-    if((err = ps_packet_write(&c->packet, msg, size)))
+    if((err = ps_packet_write_sized(&c->packet, msg, size)))
         goto close;
 
 close:
@@ -269,63 +564,811 @@ int glc_server_msg_destroy(glc_server_msg *msg) {
     return 0;
 }
 
-int glc_server_client_new(glc_server *server, int shmid, int *client) {
+size_t glc_server_ring_size(glc_server *server, size_t frame_size, double frame_rate) {
+    double frames = GLC_SERVER_RING_FRAMES;
+    size_t size;
+    (void) server;
+
+    if(!frame_size)
+        return 0;
+
+    /* the rate comes from the client, NaN would pass every comparison */
+    if(isfinite(frame_rate) && frame_rate > 0 &&
+       frame_rate * GLC_SERVER_RING_MSEC / 1000 > frames)
+        frames = frame_rate * GLC_SERVER_RING_MSEC / 1000;
+
+    /* every packet carries a header, a page is plenty for it */
+    if(frame_size > (GLC_SERVER_RING_MAX - 4096) / frames)
+        return GLC_SERVER_RING_MAX;
+    size = (frame_size + 4096) * (size_t) (frames + 0.5);
+
+    if(size < GLC_SERVER_RING_MIN)
+        size = GLC_SERVER_RING_MIN;
+    return (size + 4095) & ~(size_t) 4095;
+}
+
+int glc_server_client_new(glc_server *server, int shmid, int data_shmid, int *client) {
+    struct glc_server_slot_s *slot;
+    struct shmid_ds ds;
+    pid_t pid = 0;
+    int index, err = 0;
     glc_client *c = calloc(1, sizeof(*c));
     if(!c)
         return ENOMEM;
 
-    c->node = server->max_client++;
+    if((err = glc_server_slot_alloc(server, &index))) {
+        free(c);
+        return err;
+    }
+
+    slot = glc_server_slot(server, index);
+    c->node = (slot->gen << GLC_SERVER_SLOT_BITS) | index;
+    c->pidfd = -1;
+    c->sock = -1;
     c->shmid = shmid;
-    c->next = server->clients;
+    c->data_shmid = data_shmid;
+    c->server = server;
+
+    if((c->ring = glc_server_ring_find(server, shmid, data_shmid))) {
+        if(c->ring->client) {
+            c->ring = NULL;
+            err = EBUSY;
+            goto error;
+        }
 
-    int err = 0;
+        /* attached and touched long ago, nothing to do on the client's first frame */
+        c->buffer = c->ring->buffer;
+        c->data_buffer = c->ring->data_buffer;
+        c->ring->client = c;
+        pid = __atomic_load_n(&glc_server_lease(server, c->ring - server->rings)->pid, __ATOMIC_ACQUIRE);
+    } else if((err = glc_server_client_attach(c)))
+        goto error;
+    else if(!shmctl(data_shmid, IPC_STAT, &ds))
+        pid = ds.shm_cpid;
+
+    if((err = glc_server_client_insert(server, c, index, pid)))
+        goto error_rings;
+
+    *client = c->node;
+    return 0;
+
+error_rings:
+    if(c->ring) {
+        c->ring->client = NULL;
+    } else {
+        ps_buffer_detach(&c->data_buffer);
+        ps_buffer_detach(&c->buffer);
+    }
+error:
+    glc_server_slot_free(server, index);
+    free(c);
+    return err;
+}
+
+/* rings passed over the socket, takes over both fds */
+static int glc_server_client_new_memfd(glc_server *server, int fd, int data_fd, pid_t pid, int *client) {
+    struct glc_server_slot_s *slot;
     ps_bufferattr_t attr;
+    int index, err = 0;
+    glc_client *c = calloc(1, sizeof(*c));
+    if(!c) {
+        err = ENOMEM;
+        goto error_fds;
+    }
+
+    if((err = glc_server_slot_alloc(server, &index))) {
+        free(c);
+        goto error_fds;
+    }
+
+    slot = glc_server_slot(server, index);
+    c->node = (slot->gen << GLC_SERVER_SLOT_BITS) | index;
+    c->pidfd = -1;
+    c->sock = -1;
+    c->shmid = -1;
+    c->data_shmid = -1;
+    c->server = server;
+
     if((err = ps_bufferattr_init(&attr)))
         goto error;
 
+    if((err = ps_bufferattr_setflags(&attr, PS_BUFFER_PSHARED | PS_SHM_MEMFD)))
+        goto error_attr;
+
+    if((err = ps_bufferattr_setfd(&attr, fd)))
+        goto error_attr;
+
+    if((err = ps_buffer_init(&c->buffer, &attr)))
+        goto error_attr;
+    fd = -1;
+
+    if((err = ps_bufferattr_setfd(&attr, data_fd)))
+        goto error_buffer;
+
+    if((err = ps_buffer_init(&c->data_buffer, &attr)))
+        goto error_buffer;
+    data_fd = -1;
+
+    if((err = glc_server_client_insert(server, c, index, pid)))
+        goto error_data_buffer;
+
+    ps_bufferattr_destroy(&attr);
+    *client = c->node;
+    return 0;
+
+error_data_buffer:
+    ps_buffer_detach(&c->data_buffer);
+error_buffer:
+    ps_buffer_detach(&c->buffer);
+error_attr:
+    ps_bufferattr_destroy(&attr);
+error:
+    glc_server_slot_free(server, index);
+    free(c);
+error_fds:
+    if(fd != -1)
+        close(fd);
+    if(data_fd != -1)
+        close(data_fd);
+    return err;
+}
+
+/* common part of creating a client, the rings are attached */
+static int glc_server_client_insert(glc_server *server, glc_client *c, int index, pid_t pid) {
+    struct glc_server_slot_s *slot = glc_server_slot(server, index);
+    int err;
+
+    if((err = ps_packet_init(&c->packet, &c->buffer)))
+        return err;
+
+    if((err = ps_packet_init(&c->data_packet, &c->data_buffer)))
+        goto error_packet;
+
+    if((err = glc_pool_queue_create(server->pool, &c->queue)))
+        goto error_data_packet;
+
+    if((err = glc_loop_add_ring(server->loop, &c->data_buffer, glc_server_client_ready, c)))
+        goto error_queue;
+
+#ifdef SYS_pidfd_open
+    if(pid > 0 &&
+       (c->pidfd = syscall(SYS_pidfd_open, pid, 0)) != -1 &&
+       glc_loop_add_fd(server->loop, c->pidfd, EPOLLIN, glc_server_client_exited, c)) {
+        close(c->pidfd);
+        c->pidfd = -1;
+    }
+#else
+    (void) pid;
+#endif
+
+    /* client before node, glc_server_client_get() checks node twice */
+    __atomic_store_n(&slot->client, c, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot->node, c->node, __ATOMIC_SEQ_CST);
+    return 0;
+
+error_queue:
+    glc_pool_queue_destroy(c->queue);
+error_data_packet:
+    ps_packet_destroy(&c->data_packet);
+error_packet:
+    ps_packet_destroy(&c->packet);
+    return err;
+}
+
+/* attach rings the client created itself */
+static int glc_server_client_attach(glc_client *client) {
+    int err;
+    ps_bufferattr_t attr;
+    if((err = ps_bufferattr_init(&attr)))
+        return err;
+
     if((err = ps_bufferattr_setflags(&attr, PS_BUFFER_PSHARED)))
         goto error;
 
-    if((err = ps_bufferattr_setshmid(&attr, shmid)))
+    if((err = ps_bufferattr_setshmid(&attr, client->shmid)))
         goto error;
 
-    if((err = ps_buffer_init(&c->buffer, &attr)))
+    if((err = ps_buffer_init(&client->buffer, &attr)))
         goto error;
 
-    if((err = ps_packet_init(&c->packet, &c->buffer)))
-        goto error;
+    if((err = ps_bufferattr_setshmid(&attr, client->data_shmid)))
+        goto error_buffer;
+
+    if((err = ps_buffer_init(&client->data_buffer, &attr)))
+        goto error_buffer;
+
+    /* both sides are attached now, the kernel frees the rings when the
+       last of them detaches, even if the client crashes */
+    ps_buffer_unlink(&client->buffer);
+    ps_buffer_unlink(&client->data_buffer);
 
-    server->clients = c;
-    *client = server->max_client-1;
+    ps_bufferattr_destroy(&attr);
     return 0;
 
+error_buffer:
+    ps_buffer_detach(&client->buffer);
 error:
-    free(c);
+    ps_bufferattr_destroy(&attr);
     return err;
 }
 
 int glc_server_client_destroy(glc_server *server, int node) {
-    glc_client **client = &server->clients, *del;
-    while(*client) {
-        if((*client)->node == node) {
-            del = *client;
-            *client = (*client)->next;
-            free(del);
-            return 0;
+    glc_client *del = glc_server_client_get(server, node);
+    if(!del)
+        return EINVAL;
+
+    struct glc_server_slot_s *slot = glc_server_slot(server, node & GLC_SERVER_SLOT_MASK);
+    __atomic_store_n(&slot->node, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot->client, NULL, __ATOMIC_SEQ_CST);
+    glc_server_slot_free(server, node & GLC_SERVER_SLOT_MASK);
+
+    if(del->pidfd != -1) {
+        glc_loop_del_fd(server->loop, del->pidfd);
+        close(del->pidfd);
+    }
+    if(del->sock != -1) {
+        glc_loop_del_fd(server->loop, del->sock);
+        close(del->sock);
+    }
+    glc_loop_del_ring(server->loop, &del->data_buffer);
+    glc_pool_queue_destroy(del->queue);
+    ps_packet_destroy(&del->data_packet);
+    ps_packet_destroy(&del->packet);
+    if(del->ring) {
+        glc_server_ring_recycle(server, del->ring);
+    } else {
+        ps_buffer_detach(&del->data_buffer);
+        ps_buffer_detach(&del->buffer);
+    }
+    free(del);
+    return 0;
+}
+
+static int glc_server_client_alive(glc_client *client) {
+    struct pollfd pfd = {client->sock, POLLRDHUP, 0};
+    struct shmid_ds ds;
+
+    /* memfd rings can not be counted, but the client holds the socket */
+    if(client->sock != -1)
+        return poll(&pfd, 1, 0) == 0;
+
+    /* gone with the segment or only we are attached anymore */
+    if(shmctl(client->data_shmid, IPC_STAT, &ds))
+        return 0;
+    return ds.shm_nattch > 1;
+}
+
+static void glc_server_client_reap(glc_server *server, glc_client *client) {
+    /* hand on what the client managed to write, a partly written
+       packet is never committed and stays invisible */
+    while(glc_server_client_ready(server->loop, &client->data_buffer, client) == EAGAIN)
+        ;
+
+    glc_server_client_destroy(server, client->node);
+}
+
+static int glc_server_liveness_timer(glc_loop *loop, int fd, uint32_t events, void *udata) {
+    glc_server *server = udata;
+    struct glc_server_slot_s *slot;
+    struct glc_server_conn_s *conn, *next;
+    uint64_t expirations;
+    int i;
+    (void) loop;
+    (void) events;
+
+    if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return 0;
+
+    /* connections which never say hello would stay forever */
+    for(conn = server->conns; conn; conn = next) {
+        next = conn->next;
+        conn->waited += expirations * GLC_SERVER_LIVENESS_INTERVAL;
+        if(conn->waited >= GLC_SERVER_HELLO_TIMEOUT)
+            glc_server_conn_close(server, conn);
+    }
+
+    for(i = 0; i < server->nslots; i++) {
+        slot = glc_server_slot(server, i);
+        if(slot->node && !glc_server_client_alive(slot->client))
+            glc_server_client_reap(server, slot->client);
+    }
+
+    /* leases of clients which died before they connected or gave them back */
+    for(i = 0; server->leases && i < (int) server->leases->count; i++) {
+        glc_lease_t *lease = glc_server_lease(server, i);
+        u_int32_t state = __atomic_load_n(&lease->state, __ATOMIC_ACQUIRE);
+        pid_t pid = __atomic_load_n(&lease->pid, __ATOMIC_ACQUIRE);
+
+        if(server->rings[i].client || lease->shmid == -1)
+            continue;
+        if(state == GLC_LEASE_RETURNED ||
+           (state == GLC_LEASE_TAKEN && pid > 0 && kill(pid, 0) == -1 && errno == ESRCH))
+            glc_server_ring_recycle(server, &server->rings[i]);
+    }
+
+    return 0;
+}
+
+static int glc_server_client_exited(glc_loop *loop, int fd, uint32_t events, void *udata) {
+    glc_client *client = udata;
+    (void) events;
+
+    /* the creator of the ring is gone, but a child it forked may still
+       write to it, then the liveness timer finds out when it is done */
+    if(glc_server_client_alive(client)) {
+        glc_loop_del_fd(loop, fd);
+        close(fd);
+        client->pidfd = -1;
+        return 0;
+    }
+
+    glc_server_client_reap(client->server, client);
+    return 0;
+}
+
+static int glc_server_client_hangup(glc_loop *loop, int fd, uint32_t events, void *udata) {
+    glc_client *client = udata;
+    (void) loop;
+    (void) fd;
+    (void) events;
+
+    glc_server_client_reap(client->server, client);
+    return 0;
+}
+
+static int glc_server_listen(glc_server *server, const char *name) {
+    struct sockaddr_un addr;
+    size_t len = strlen(name);
+    int err;
+
+    /* abstract name, nothing to clean up in the file system */
+    if(len + 1 > sizeof(addr.sun_path))
+        return ENAMETOOLONG;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(&addr.sun_path[1], name, len);
+
+    if((server->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
+        return errno;
+
+    if(bind(server->listen_fd, (struct sockaddr *) &addr, offsetof(struct sockaddr_un, sun_path) + 1 + len) ||
+       listen(server->listen_fd, SOMAXCONN)) {
+        err = errno;
+        goto error;
+    }
+
+    if((err = glc_loop_add_fd(server->loop, server->listen_fd, EPOLLIN, glc_server_accept, server)))
+        goto error;
+
+    return 0;
+
+error:
+    close(server->listen_fd);
+    server->listen_fd = -1;
+    return err;
+}
+
+static int glc_server_accept(glc_loop *loop, int fd, uint32_t events, void *udata) {
+    glc_server *server = udata;
+    struct glc_server_conn_s *conn;
+    int conn_fd;
+    (void) events;
+
+    while((conn_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        /* refused connections see the hang up instead of a hello reply */
+        if(server->nconns >= GLC_SERVER_MAX_CONNS || !(conn = malloc(sizeof(*conn)))) {
+            close(conn_fd);
+            continue;
+        }
+
+        conn->fd = conn_fd;
+        conn->server = server;
+        conn->waited = 0;
+        if(glc_loop_add_fd(loop, conn_fd, EPOLLIN, glc_server_hello, conn)) {
+            close(conn_fd);
+            free(conn);
+            continue;
         }
-        client = &(*client)->next;
+
+        conn->next = server->conns;
+        server->conns = conn;
+        server->nconns++;
     }
-    return EINVAL;
+
+    return 0;
+}
+
+static int glc_server_hello(glc_loop *loop, int fd, uint32_t events, void *udata) {
+    struct glc_server_conn_s *conn = udata;
+    glc_server *server = conn->server;
+    glc_hello_message_t hello;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct iovec iov = {&hello, sizeof(hello)};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct ucred cred;
+    socklen_t cred_size = sizeof(cred);
+    glc_client *client;
+    int fds[2] = {-1, -1}, node = -1, err = 0, extra, i, n;
+    ssize_t size;
+    (void) events;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if((size = recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC)) == -1 &&
+       (errno == EAGAIN || errno == EINTR))
+        return 0;
+
+    for(cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for(i = 0; i < n; i++) {
+            if(i < 2 && fds[i] == -1)
+                memcpy(&fds[i], CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            else {
+                /* more than two, refuse the hello */
+                memcpy(&extra, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                close(extra);
+                size = -1;
+            }
+        }
+    }
+
+    if(size != sizeof(hello) || hello.signature != GLC_SIGNATURE ||
+       hello.version != GLC_HELLO_VERSION || fds[0] == -1 || fds[1] == -1) {
+        if(fds[0] != -1)
+            close(fds[0]);
+        if(fds[1] != -1)
+            close(fds[1]);
+        err = EPROTO;
+    } else if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_size)) {
+        err = errno;
+        close(fds[0]);
+        close(fds[1]);
+    } else if(cred.uid != geteuid()) {
+        /* an abstract socket has no permissions, anyone can connect */
+        err = EACCES;
+        close(fds[0]);
+        close(fds[1]);
+    } else {
+        err = glc_server_client_new_memfd(server, fds[0], fds[1], cred.pid, &node);
+    }
+
+    if(size == sizeof(hello)) {
+        hello.signature = GLC_SIGNATURE;
+        hello.version = GLC_HELLO_VERSION;
+        hello.node = err ? -1 : node;
+        hello.caps &= server->caps;
+        hello.msize = glc_server_ring_size(server, hello.frame_size, hello.frame_rate);
+        if(send(fd, &hello, sizeof(hello), MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(hello) && !err) {
+            glc_server_client_destroy(server, node);
+            err = EPIPE;
+        }
+    }
+
+    if(err || !(client = glc_server_client_get(server, node))) {
+        glc_server_conn_close(server, conn);
+        return 0;
+    }
+
+    /* the connection now tells when the client is gone, if it can not be
+       watched the liveness timer still polls it */
+    client->sock = glc_server_conn_release(server, conn);
+    glc_loop_add_fd(loop, client->sock, EPOLLRDHUP, glc_server_client_hangup, client);
+    return 0;
+}
+
+static void glc_server_conn_close(glc_server *server, struct glc_server_conn_s *conn) {
+    close(glc_server_conn_release(server, conn));
+}
+
+static int glc_server_conn_release(glc_server *server, struct glc_server_conn_s *conn) {
+    struct glc_server_conn_s **c;
+    int fd = conn->fd;
+
+    for(c = &server->conns; *c; c = &(*c)->next) {
+        if(*c == conn) {
+            *c = conn->next;
+            server->nconns--;
+            break;
+        }
+    }
+
+    glc_loop_del_fd(server->loop, fd);
+    free(conn);
+    return fd;
+}
+
+int glc_server_client_submit(glc_server *server, glc_client *client, glc_pool_func func, void *arg) {
+    (void) server;
+    return glc_pool_queue_submit(client->queue, func, arg);
 }
 
 glc_client *glc_server_client_get(glc_server *server, int node) {
-    glc_client *client = server->clients;
-    while(client) {
-        if(client->node == node)
-            return client;
-        client = client->next;
+    struct glc_server_slot_s *chunk, *slot;
+    glc_client *client;
+    int index = node & GLC_SERVER_SLOT_MASK;
+
+    if(node <= 0)
+        return NULL;
+
+    chunk = __atomic_load_n(&server->slots[index / GLC_SERVER_SLOT_CHUNK], __ATOMIC_ACQUIRE);
+    if(!chunk)
+        return NULL;
+
+    slot = &chunk[index % GLC_SERVER_SLOT_CHUNK];
+    if(__atomic_load_n(&slot->node, __ATOMIC_SEQ_CST) != node)
+        return NULL;
+
+    client = __atomic_load_n(&slot->client, __ATOMIC_SEQ_CST);
+
+    /* the slot may have been reused between the two loads */
+    if(__atomic_load_n(&slot->node, __ATOMIC_SEQ_CST) != node)
+        return NULL;
+
+    return client;
+}
+
+static struct glc_server_slot_s *glc_server_slot(glc_server *server, int index) {
+    return &server->slots[index / GLC_SERVER_SLOT_CHUNK][index % GLC_SERVER_SLOT_CHUNK];
+}
+
+static int glc_server_slot_alloc(glc_server *server, int *index) {
+    struct glc_server_slot_s *chunk;
+    int i;
+
+    if(server->free_slot == -1) {
+        if(server->nslots == GLC_SERVER_SLOT_CHUNKS * GLC_SERVER_SLOT_CHUNK)
+            return ENOSPC;
+
+        if(!(chunk = calloc(GLC_SERVER_SLOT_CHUNK, sizeof(*chunk))))
+            return ENOMEM;
+
+        for(i = 0; i < GLC_SERVER_SLOT_CHUNK; i++) {
+            chunk[i].gen = 1;
+            chunk[i].next_free = i + 1 < GLC_SERVER_SLOT_CHUNK ? server->nslots + i + 1 : -1;
+        }
+
+        __atomic_store_n(&server->slots[server->nslots / GLC_SERVER_SLOT_CHUNK], chunk, __ATOMIC_RELEASE);
+        server->free_slot = server->nslots;
+        server->nslots += GLC_SERVER_SLOT_CHUNK;
     }
-    return NULL;
+
+    *index = server->free_slot;
+    server->free_slot = glc_server_slot(server, *index)->next_free;
+    return 0;
+}
+
+static void glc_server_slot_free(glc_server *server, int index) {
+    struct glc_server_slot_s *slot = glc_server_slot(server, index);
+
+    if(++slot->gen > GLC_SERVER_GEN_MAX)
+        slot->gen = 1;
+    slot->next_free = server->free_slot;
+    server->free_slot = index;
+}
+
+static glc_lease_t *glc_server_lease(glc_server *server, int index) {
+    return &((glc_lease_t *) (server->leases + 1))[index];
+}
+
+static int glc_server_leases_create(glc_server *server, glc_server_options *options) {
+    key_t key = options->shmkey + GLC_LEASE_KEY_OFFSET;
+    size_t size = sizeof(glc_lease_table_t) + options->rings * sizeof(glc_lease_t);
+    glc_lease_t *lease;
+    int i, err;
+
+    server->lease_shmid = shmget(key, size, IPC_CREAT | IPC_EXCL | options->mmode);
+    if(server->lease_shmid == -1 && errno == EEXIST) {
+        if((err = glc_server_leases_reclaim(key)))
+            return err;
+        server->lease_shmid = shmget(key, size, IPC_CREAT | IPC_EXCL | options->mmode);
+    }
+    if(server->lease_shmid == -1)
+        return errno;
+
+    if((server->leases = shmat(server->lease_shmid, NULL, 0)) == (void *) -1) {
+        err = errno;
+        server->leases = NULL;
+        goto error;
+    }
+
+    if(!(server->rings = calloc(options->rings, sizeof(struct glc_server_ring_s)))) {
+        err = ENOMEM;
+        goto error;
+    }
+
+    server->lease_mode = options->mmode;
+    server->leases->count = options->rings;
+    server->leases->rsize = options->ring_rsize;
+    server->leases->msize = options->ring_msize;
+
+    for(i = 0; i < options->rings; i++) {
+        lease = glc_server_lease(server, i);
+        lease->state = GLC_LEASE_TAKEN;
+        lease->shmid = lease->data_shmid = -1;
+    }
+
+    for(i = 0; i < options->rings; i++) {
+        if((err = glc_server_ring_create(server, &server->rings[i])))
+            goto error;
+        glc_server_lease(server, i)->state = GLC_LEASE_FREE;
+    }
+
+    /* clients do not look at the table before it is complete */
+    __atomic_store_n(&server->leases->signature, GLC_SIGNATURE, __ATOMIC_RELEASE);
+    return 0;
+
+error:
+    glc_server_leases_destroy(server);
+    return err;
+}
+
+/* remove the table, and the rings, of a server which is gone */
+static int glc_server_leases_reclaim(key_t key) {
+    struct shmid_ds ds, ring_ds;
+    glc_lease_table_t *table;
+    glc_lease_t *lease;
+    int shmid, ids[2], complete, i, j;
+    u_int32_t count = 0;
+
+    if((shmid = shmget(key, 0, 0)) == -1 || shmctl(shmid, IPC_STAT, &ds))
+        return EEXIST;
+
+    if((table = shmat(shmid, NULL, SHM_RDONLY)) == (void *) -1)
+        return EEXIST;
+
+    complete = ds.shm_segsz >= sizeof(glc_lease_table_t) &&
+               __atomic_load_n(&table->signature, __ATOMIC_ACQUIRE) == GLC_SIGNATURE;
+
+    /* a running server stays attached to its complete table, clients only
+       attach for a moment */
+    if(!(kill(ds.shm_cpid, 0) == -1 && errno == ESRCH) && (ds.shm_nattch || !complete)) {
+        shmdt(table);
+        return EEXIST;
+    }
+
+    /* servers before rings were unlinked at once left them behind; the ids
+       are only trusted if their segments come from the same server */
+    if(complete && table->count <= (ds.shm_segsz - sizeof(glc_lease_table_t)) / sizeof(glc_lease_t))
+        count = table->count;
+
+    for(i = 0; i < (int) count; i++) {
+        lease = &((glc_lease_t *) (table + 1))[i];
+        ids[0] = lease->shmid;
+        ids[1] = lease->data_shmid;
+        for(j = 0; j < 2; j++) {
+            if(ids[j] != -1 && !shmctl(ids[j], IPC_STAT, &ring_ds) && ring_ds.shm_cpid == ds.shm_cpid)
+                shmctl(ids[j], IPC_RMID, 0);
+        }
+    }
+    shmdt(table);
+
+    if(shmctl(shmid, IPC_RMID, 0))
+        return errno;
+    return 0;
 }
 
+static void glc_server_leases_destroy(glc_server *server) {
+    int i;
+
+    if(server->leases) {
+        for(i = 0; server->rings && i < (int) server->leases->count; i++) {
+            if(glc_server_lease(server, i)->shmid != -1)
+                glc_server_ring_release(&server->rings[i]);
+        }
+        shmdt(server->leases);
+    }
+
+    if(server->lease_shmid != -1)
+        shmctl(server->lease_shmid, IPC_RMID, 0);
 
+    free(server->rings);
+    server->rings = NULL;
+    server->leases = NULL;
+    server->lease_shmid = -1;
+}
+
+static int glc_server_ring_buffer_create(ps_buffer_t *buffer, int mmode, size_t size) {
+    int err;
+    ps_bufferattr_t attr;
+    if((err = ps_bufferattr_init(&attr)))
+        return err;
+
+    if((err = ps_bufferattr_setflags(&attr, PS_BUFFER_PSHARED | PS_SHM_CREATE)))
+        goto error;
+
+    if((err = ps_bufferattr_setshmmode(&attr, mmode)))
+        goto error;
+
+    if((err = ps_bufferattr_setsize(&attr, size)))
+        goto error;
+
+    /* clears the data area, so all pages are there before a client comes */
+    err = ps_buffer_init(buffer, &attr);
+
+error:
+    ps_bufferattr_destroy(&attr);
+    return err;
+}
+
+static int glc_server_ring_create(glc_server *server, struct glc_server_ring_s *ring) {
+    glc_lease_t *lease = glc_server_lease(server, ring - server->rings);
+    int err;
+
+    if((err = glc_server_ring_buffer_create(&ring->buffer, server->lease_mode, server->leases->rsize)))
+        return err;
+
+    if((err = glc_server_ring_buffer_create(&ring->data_buffer, server->lease_mode, server->leases->msize))) {
+        ps_buffer_destroy(&ring->buffer);
+        return err;
+    }
+
+    /* clients attach by shmid, so the rings can go with the last process
+       which detaches, even if the server crashes */
+    ps_buffer_unlink(&ring->buffer);
+    ps_buffer_unlink(&ring->data_buffer);
+
+    ring->client = NULL;
+    lease->shmid = ring->buffer.shmid;
+    lease->data_shmid = ring->data_buffer.shmid;
+    return 0;
+}
+
+/* remove and detach the rings, also if a client cancelled them */
+static void glc_server_ring_release(struct glc_server_ring_s *ring) {
+    shmctl(ring->buffer.shmid, IPC_RMID, 0);
+    shmdt(ring->buffer.state);
+    shmctl(ring->data_buffer.shmid, IPC_RMID, 0);
+    shmdt(ring->data_buffer.state);
+    memset(ring, 0, sizeof(*ring));
+}
+
+static void glc_server_ring_recycle(glc_server *server, struct glc_server_ring_s *ring) {
+    glc_lease_t *lease = glc_server_lease(server, ring - server->rings);
+    struct shmid_ds ds, data_ds;
+
+    ring->client = NULL;
+
+    if(!shmctl(lease->shmid, IPC_STAT, &ds) && ds.shm_nattch == 1 &&
+       !shmctl(lease->data_shmid, IPC_STAT, &data_ds) && data_ds.shm_nattch == 1) {
+        /* only we are attached, whatever state the client left is ours */
+        ps_buffer_reset(&ring->buffer);
+        ps_buffer_reset(&ring->data_buffer);
+    } else {
+        /* the client may still write, it keeps the old rings until it
+           detaches and the next one gets new rings */
+        glc_server_ring_release(ring);
+        if(glc_server_ring_create(server, ring)) {
+            /* stays taken, the entry is lost */
+            lease->shmid = lease->data_shmid = -1;
+            return;
+        }
+    }
+
+    __atomic_store_n(&lease->pid, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&lease->state, GLC_LEASE_FREE, __ATOMIC_RELEASE);
+}
+
+static struct glc_server_ring_s *glc_server_ring_find(glc_server *server, int shmid, int data_shmid) {
+    glc_lease_t *lease;
+    int i;
+
+    for(i = 0; server->leases && i < (int) server->leases->count; i++) {
+        lease = glc_server_lease(server, i);
+        if(lease->shmid != -1 && lease->shmid == shmid && lease->data_shmid == data_shmid)
+            return &server->rings[i];
+    }
+
+    return NULL;
+}
@@ -13,15 +13,61 @@
 #ifndef GLC2_SERVER_SERVER_H
 #define GLC2_SERVER_SERVER_H
 
+#include <sys/uio.h>
+
 #include "packetstream.h"
 #include "format.h"
+#include "loop.h"
+#include "pool.h"
+
+/** maximum number of packets read from one ring before others are served */
+#define GLC_SERVER_BATCH 32
+
+/** seconds after which dead clients are found at the latest */
+#define GLC_SERVER_LIVENESS_INTERVAL 1
+
+/** seconds a connection may take to send its hello */
+#define GLC_SERVER_HELLO_TIMEOUT 5
+/** connections waiting for their hello at most, more are refused */
+#define GLC_SERVER_MAX_CONNS 64
 
-#define __PUBLIC __attribute__ ((visibility ("default")))
+/** data rings hold at least this many declared frames */
+#define GLC_SERVER_RING_FRAMES 8
+/** and at least this many milliseconds of them */
+#define GLC_SERVER_RING_MSEC 250
+/** recommended data ring sizes are clamped to these */
+#define GLC_SERVER_RING_MIN (1024 * 1024)
+#define GLC_SERVER_RING_MAX ((size_t) 1024 * 1024 * 1024)
+
+/** bits of a node id which hold the client's slot, the rest is the generation */
+#define GLC_SERVER_SLOT_BITS 14
+/** slots per chunk of the client table */
+#define GLC_SERVER_SLOT_CHUNK 64
+/** chunks of the client table */
+#define GLC_SERVER_SLOT_CHUNKS ((1 << GLC_SERVER_SLOT_BITS) / GLC_SERVER_SLOT_CHUNK)
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct glc_server_s;
+struct glc_client_s;
+
+/**
+ * \brief handler for messages a client sends
+ * \param server the server
+ * \param client the sending client
+ * \param hdr message header
+ * \param msg message payload, only valid during the call
+ * \param size payload size
+ * \param udata data passed to glc_server_set_handler()
+ * \note msg points into the client's ring, which stays blocked until the
+ *       handler returns; the handler must not destroy the sending client
+ * \return 0 on success otherwise an error code
+ */
+typedef int (*glc_server_handler)(struct glc_server_s *server, struct glc_client_s *client,
+                                  glc_message_header_t *hdr, void *msg, size_t size, void *udata);
+
 typedef struct glc_server_options_s {
     /** shared memory key */
     key_t shmkey;
@@ -29,24 +75,144 @@ typedef struct glc_server_options_s {
     int mmode;
     /** memory size; buffer size */
     size_t msize;
+    /** worker threads for client jobs, 0 for one per cpu */
+    int threads;
+    /** ring pairs kept ready for clients to lease, 0 for none */
+    int rings;
+    /** size of leased data rings */
+    size_t ring_msize;
+    /** size of leased rings the server answers on */
+    size_t ring_rsize;
+    /**
+     * abstract UNIX socket name to listen on or NULL, see
+     * glc_hello_message_t. Only processes of the server's user are accepted.
+     */
+    const char *socket_name;
+    /** GLC_CAP_* flags offered to clients connecting on the socket */
+    glc_flags_t caps;
 } glc_server_options;
 
+/**
+ * \brief entry of the client table
+ *
+ * A node id is the slot index plus a generation which changes whenever
+ * the slot is reused, so ids of destroyed clients never match again.
+ */
+struct glc_server_slot_s {
+    /** node id of the client in this slot, 0 if the slot is free */
+    int node;
+    /** generation of the next client in this slot */
+    int gen;
+    struct glc_client_s *client;
+    /** index of the next free slot, -1 for none */
+    int next_free;
+};
+
+/**
+ * \brief ring pair of the lease pool
+ *
+ * The rings are created and their pages touched when the server starts,
+ * so a connecting client only attaches them. They stay attached by the
+ * server and are reset instead of freed when the client is gone.
+ */
+struct glc_server_ring_s {
+    ps_buffer_t buffer;
+    ps_buffer_t data_buffer;
+    /** client using the rings or NULL */
+    struct glc_client_s *client;
+};
+
+/** socket connection waiting for its hello message */
+struct glc_server_conn_s {
+    int fd;
+    struct glc_server_s *server;
+    /** seconds waited for the hello, counted by the liveness timer */
+    unsigned int waited;
+    struct glc_server_conn_s *next;
+};
+
 typedef struct glc_server_s {
     ps_buffer_t buffer;
     ps_packet_t packet;
-    int max_client;
-    struct glc_client_s *clients;
+    glc_loop *loop;
+    /** workers running jobs submitted with glc_server_client_submit() */
+    glc_pool *pool;
+    /** fires every GLC_SERVER_LIVENESS_INTERVAL seconds to look for dead clients */
+    int timerfd;
+    /** packet flags passed to glc_server_run() */
+    int flags;
+    /** client table, chunks are allocated on demand and never move */
+    struct glc_server_slot_s *slots[GLC_SERVER_SLOT_CHUNKS];
+    /** number of slots in allocated chunks */
+    int nslots;
+    /** head of the free slot list, -1 for none */
+    int free_slot;
+    /** shared lease table, NULL if there are no rings to lease */
+    glc_lease_table_t *leases;
+    int lease_shmid;
+    /** memory mode of the lease table and the leased rings */
+    int lease_mode;
+    /** listening socket or -1 */
+    int listen_fd;
+    /** accepted connections without hello yet */
+    struct glc_server_conn_s *conns;
+    int nconns;
+    glc_flags_t caps;
+    /** lease pool, one ring pair per lease table entry */
+    struct glc_server_ring_s *rings;
     int (*error_handler)(int);
+    struct {
+        glc_server_handler handler;
+        void *udata;
+    } handlers[256];
+    /** loop thread copy of messages which wrap around the end of a ring */
+    void *scratch;
+    size_t scratch_size;
 } glc_server;
 
 typedef struct glc_client_s {
     int node;
+    /** pidfd of the client process, readable when it exits, or -1 */
+    int pidfd;
+    /** socket the client connected on, hung up when it is gone, or -1 */
+    int sock;
+    /** -1 for rings passed as memfd */
     int shmid;
+    /** ring the server writes answers to */
     ps_buffer_t buffer;
     ps_packet_t packet;
-    struct glc_client_s *next;
+    int data_shmid;
+    /** ring the client writes its data to */
+    ps_buffer_t data_buffer;
+    ps_packet_t data_packet;
+    /** runs the client's jobs in submission order */
+    glc_pool_queue *queue;
+    /** leased ring pair or NULL if the client created its own rings */
+    struct glc_server_ring_s *ring;
+    struct glc_server_s *server;
 } glc_client;
 
+/**
+ * \brief message received in place
+ *
+ * The payload is not copied out of the ring, it is one segment or two if
+ * it wraps around the end of the ring. The view keeps the packet open and
+ * blocks the ring, so it must be released with glc_server_view_release()
+ * as soon as possible. Use glc_server_view_copy() for messages which must
+ * be kept longer.
+ */
+typedef struct glc_server_view_s {
+    glc_message_header_t header;
+    /** payload segments */
+    struct iovec msg[2];
+    /** number of payload segments */
+    int count;
+    /** payload size */
+    size_t size;
+    /** open packet the view references */
+    ps_packet_t *packet;
+} glc_server_view;
+
 typedef struct {
     int node;
     glc_message_header_t header;
@@ -59,24 +225,140 @@ __PUBLIC glc_server *glc_server_create(glc_server_options *options, int *err);
 
 __PUBLIC void glc_server_destroy(glc_server *server);
 
+/**
+ * \brief serve the control ring and all client data rings until stopped
+ * \param server the server
+ * \param flags additional packet flags
+ * \return 0 if stopped with glc_server_stop() otherwise an error code
+ */
 __PUBLIC int glc_server_run(glc_server *server, int flags);
 
+/**
+ * \brief make glc_server_run() return
+ * \note this is async-signal-safe
+ */
+__PUBLIC void glc_server_stop(glc_server *server);
+
 __PUBLIC int glc_server_msg_receive(glc_server *server, glc_message_header_t *hdr, void **msg, size_t *msg_size,  int flags);
 
+/**
+ * \brief receive a message from a client's data ring
+ * \note the returned msg must be freed
+ */
+__PUBLIC int glc_server_client_msg_receive(glc_server *server, glc_client *client, glc_message_header_t *hdr, void **msg, size_t *msg_size, int flags);
+
+/**
+ * \brief receive a message from the control ring without copying it
+ * \param server the server
+ * \param view returned view, release with glc_server_view_release()
+ * \param flags additional packet flags
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_server_view_receive(glc_server *server, glc_server_view *view, int flags);
+
+/**
+ * \brief receive a message from a client's data ring without copying it
+ * \param server the server
+ * \param client the client
+ * \param view returned view, release with glc_server_view_release()
+ * \param flags additional packet flags
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_server_client_view_receive(glc_server *server, glc_client *client, glc_server_view *view, int flags);
+
+/**
+ * \brief copy the payload of a view to memory which outlives the view
+ * \note the returned msg must be freed
+ * \param view the view
+ * \param msg returned copy of the payload
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_server_view_copy(glc_server_view *view, void **msg);
+
+/**
+ * \brief close the packet of a view
+ * \param view the view, its segments are invalid afterwards
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_server_view_release(glc_server_view *view);
+
+/**
+ * \brief send a message to a client on its answer ring
+ * \note loop thread only, the answer ring is written without a lock and
+ *       the loop thread sends on it too
+ * \param server the server
+ * \param node the client's node id
+ * \param hdr message header
+ * \param msg payload
+ * \param size payload size
+ * \param flags ps_packet flags, e.g. PS_PACKET_TRY
+ * \return 0 on success, EINVAL if node is unknown, otherwise an error code
+ */
 __PUBLIC int glc_server_msg_sent(glc_server *server, int node, glc_message_header_t *hdr, void *msg, size_t size, int flags);
 
 __PUBLIC int glc_server_set_errorhandler(glc_server *server, int (*handler)(int));
 
+/**
+ * \brief set the handler for a message type sent by clients
+ * \param server the server
+ * \param type message type
+ * \param handler the handler or NULL to ignore the type
+ * \param udata data passed to the handler
+ * \return 0 on success
+ */
+__PUBLIC int glc_server_set_handler(glc_server *server, glc_message_type_t type, glc_server_handler handler, void *udata);
+
 __PUBLIC int glc_server_msg_destroy(glc_server_msg *msg);
 
-__PUBLIC int glc_server_client_new(glc_server *server, int shmid, int *client);
+/**
+ * \brief data ring size for a client's declared frames
+ *
+ * Room for GLC_SERVER_RING_FRAMES frames or GLC_SERVER_RING_MSEC worth
+ * of them, whichever is more, so the client does not stall while the
+ * server is briefly behind.
+ * \param server the server
+ * \param frame_size expected frame size in bytes
+ * \param frame_rate expected frames per second, 0, negative or
+ *        non-finite if unknown
+ * \return recommended size or 0 if frame_size is 0
+ */
+__PUBLIC size_t glc_server_ring_size(glc_server *server, size_t frame_size, double frame_rate);
+
+__PUBLIC int glc_server_client_new(glc_server *server, int shmid, int data_shmid, int *client);
 
+/**
+ * \brief destroy a client and free its node id
+ * \note clients are created and destroyed on the loop thread only
+ */
 __PUBLIC int glc_server_client_destroy(glc_server *server, int node);
 
+/**
+ * \brief look up a client by node id in constant time
+ * \note loop thread only, clients are destroyed there without a reference
+ *       being taken; jobs use the client glc_server_client_submit() was
+ *       given, it stays valid until they are done
+ * \return the client or NULL if node is unknown or stale
+ */
 __PUBLIC glc_client *glc_server_client_get(glc_server *server, int node);
 
+/**
+ * \brief run a job for a client on the worker pool
+ *
+ * Jobs of one client run one after another in submission order, jobs of
+ * different clients run in parallel. Handlers use this to move expensive
+ * processing off the loop thread; the job must own its data because the
+ * message passed to the handler is freed when the handler returns.
+ * \note all jobs of a client are done before glc_server_client_destroy() returns
+ * \param server the server
+ * \param client the client
+ * \param func job function
+ * \param arg argument passed to func
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_server_client_submit(glc_server *server, glc_client *client, glc_pool_func func, void *arg);
+
 #ifdef __cplusplus
-extern "C" {
+}
 #endif
 
 #endif
@@ -0,0 +1,533 @@
+/**
+ * \file src/server/writer.c
+ * \brief asynchronous stream writer
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \addtogroup server_writer
+ *  \{
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "writer.h"
+
+#define GLC_WRITER_BLOCK_SIZE (4 * 1024 * 1024)
+#define GLC_WRITER_BLOCKS 8
+#define GLC_WRITER_PREALLOC (256 * 1024 * 1024)
+/** workers of the pool a writer starts when it is given none */
+#define GLC_WRITER_THREADS 2
+
+#define GLC_WRITER_ROUND(S) (((S) + GLC_WRITER_ALIGN - 1) & ~((size_t) GLC_WRITER_ALIGN - 1))
+
+struct glc_writer_block_s {
+    glc_writer *writer;
+    unsigned char *data;
+    /** file offset of the block */
+    off_t offset;
+    /** bytes of data in the block */
+    size_t fill;
+    /** bytes to write, fill padded to GLC_WRITER_ALIGN for O_DIRECT */
+    size_t len;
+    /** bytes written so far */
+    size_t done;
+    /** segment submitted to io_uring, must stay valid until completion */
+    struct iovec iov;
+    int busy;
+};
+
+struct glc_writer_uring_s {
+    int fd;
+    unsigned int *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+};
+
+struct glc_writer_s {
+    int fd;
+    int flags;
+    size_t block_size;
+    int nblocks;
+    struct glc_writer_block_s *blocks;
+    /** block being filled */
+    struct glc_writer_block_s *cur;
+    /** logical file size */
+    size_t size;
+    /** file space reserved with fallocate() */
+    off_t allocated;
+    size_t prealloc;
+
+    /** io_uring, fd is -1 if the pool is used */
+    struct glc_writer_uring_s uring;
+    glc_pool *pool;
+    int own_pool;
+
+    /** protects busy flags and err for pool workers */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    /** first error of a background write */
+    int err;
+};
+
+static int glc_writer_uring_init(struct glc_writer_uring_s *uring, unsigned int entries);
+static void glc_writer_uring_destroy(struct glc_writer_uring_s *uring);
+static int glc_writer_uring_submit(glc_writer *writer, struct glc_writer_block_s *block);
+static int glc_writer_uring_reap(glc_writer *writer, int wait);
+static void glc_writer_job(void *arg);
+static void glc_writer_complete(glc_writer *writer, struct glc_writer_block_s *block, int err);
+static int glc_writer_submit(glc_writer *writer, struct glc_writer_block_s *block);
+static int glc_writer_wait(glc_writer *writer, struct glc_writer_block_s *block);
+static int glc_writer_next(glc_writer *writer);
+
+int glc_writer_create(glc_writer **writer, const char *path, glc_writer_options *options, glc_pool *pool) {
+    glc_writer_options def = {GLC_WRITER_BLOCK_SIZE, GLC_WRITER_BLOCKS, GLC_WRITER_PREALLOC, GLC_WRITER_DIRECT};
+    int err = 0, i, oflags;
+    struct stat st;
+    ssize_t ret;
+    glc_writer *w;
+
+    if(!options)
+        options = &def;
+
+    if(!(w = calloc(1, sizeof(*w))))
+        return ENOMEM;
+
+    w->fd = -1;
+    w->uring.fd = -1;
+    w->flags = options->flags;
+    w->block_size = GLC_WRITER_ROUND(options->block_size ? options->block_size : GLC_WRITER_BLOCK_SIZE);
+    w->nblocks = options->blocks < 2 ? 2 : options->blocks;
+    w->prealloc = GLC_WRITER_ROUND(options->prealloc);
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond, NULL);
+
+    oflags = O_WRONLY | O_CREAT | O_CLOEXEC | (w->flags & GLC_WRITER_APPEND ? 0 : O_TRUNC);
+    if(w->flags & GLC_WRITER_DIRECT) {
+        /* e.g. tmpfs has no O_DIRECT, write through the page cache then */
+        if((w->fd = open(path, oflags | O_DIRECT, 0644)) == -1 && errno == EINVAL)
+            w->flags &= ~GLC_WRITER_DIRECT;
+    }
+    if(w->fd == -1 && (w->fd = open(path, oflags, 0644)) == -1) {
+        err = errno;
+        goto error;
+    }
+
+    if(!(w->blocks = calloc(w->nblocks, sizeof(struct glc_writer_block_s)))) {
+        err = ENOMEM;
+        goto error;
+    }
+
+    for(i = 0; i < w->nblocks; i++) {
+        w->blocks[i].writer = w;
+        if((err = posix_memalign((void **) &w->blocks[i].data, GLC_WRITER_ALIGN, w->block_size)))
+            goto error;
+    }
+    w->cur = &w->blocks[0];
+
+    if(w->flags & GLC_WRITER_APPEND) {
+        if(fstat(w->fd, &st)) {
+            err = errno;
+            goto error;
+        }
+
+        /* blocks start aligned, so the partial tail is written again */
+        w->size = st.st_size;
+        w->allocated = st.st_size;
+        w->cur->offset = st.st_size & ~((off_t) GLC_WRITER_ALIGN - 1);
+        w->cur->fill = st.st_size - w->cur->offset;
+        if(w->cur->fill) {
+            int rfd = open(path, O_RDONLY | O_CLOEXEC);
+            if(rfd == -1) {
+                err = errno;
+                goto error;
+            }
+            ret = pread(rfd, w->cur->data, w->cur->fill, w->cur->offset);
+            err = ret == -1 ? errno : (size_t) ret != w->cur->fill ? EIO : 0;
+            close(rfd);
+            if(err)
+                goto error;
+        }
+    }
+
+    if(!(w->flags & GLC_WRITER_NO_URING) && !glc_writer_uring_init(&w->uring, w->nblocks)) {
+        w->pool = NULL;
+    } else if(pool) {
+        w->pool = pool;
+    } else {
+        if((err = glc_pool_create(&w->pool, GLC_WRITER_THREADS)))
+            goto error;
+        w->own_pool = 1;
+    }
+
+    *writer = w;
+    return 0;
+
+error:
+    if(w->blocks) {
+        for(i = 0; i < w->nblocks; i++)
+            free(w->blocks[i].data);
+        free(w->blocks);
+    }
+    if(w->fd != -1)
+        close(w->fd);
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->mutex);
+    free(w);
+    return err;
+}
+
+int glc_writer_destroy(glc_writer *writer) {
+    int err, i;
+
+    err = glc_writer_flush(writer);
+
+    /* drop O_DIRECT padding and unused preallocation */
+    if(ftruncate(writer->fd, writer->size) && !err)
+        err = errno;
+    if(close(writer->fd) && !err)
+        err = errno;
+
+    if(writer->uring.fd != -1)
+        glc_writer_uring_destroy(&writer->uring);
+    if(writer->own_pool)
+        glc_pool_destroy(writer->pool);
+
+    for(i = 0; i < writer->nblocks; i++)
+        free(writer->blocks[i].data);
+    free(writer->blocks);
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer);
+    return err;
+}
+
+int glc_writer_write(glc_writer *writer, const void *data, size_t size) {
+    struct iovec iov;
+    iov.iov_base = (void *) data;
+    iov.iov_len = size;
+    return glc_writer_writev(writer, &iov, 1);
+}
+
+int glc_writer_writev(glc_writer *writer, const struct iovec *iov, int count) {
+    const unsigned char *src;
+    size_t left, n;
+    int err, i;
+
+    if((err = __atomic_load_n(&writer->err, __ATOMIC_ACQUIRE)))
+        return err;
+
+    for(i = 0; i < count; i++) {
+        src = iov[i].iov_base;
+        left = iov[i].iov_len;
+        while(left) {
+            n = writer->block_size - writer->cur->fill;
+            if(n > left)
+                n = left;
+
+            memcpy(&writer->cur->data[writer->cur->fill], src, n);
+            writer->cur->fill += n;
+            writer->size += n;
+            src += n;
+            left -= n;
+
+            if(writer->cur->fill == writer->block_size && (err = glc_writer_next(writer)))
+                return err;
+        }
+    }
+
+    return 0;
+}
+
+int glc_writer_flush(glc_writer *writer) {
+    int err = 0, i;
+
+    /* the partial block stays current and is written again once it is full */
+    if(writer->cur->fill && !(err = glc_writer_submit(writer, writer->cur)))
+        err = glc_writer_wait(writer, writer->cur);
+
+    for(i = 0; i < writer->nblocks && !err; i++)
+        err = glc_writer_wait(writer, &writer->blocks[i]);
+
+    if(!err)
+        err = __atomic_load_n(&writer->err, __ATOMIC_ACQUIRE);
+    return err;
+}
+
+size_t glc_writer_size(glc_writer *writer) {
+    return writer->size;
+}
+
+/* submit the full current block and continue in a free one */
+static int glc_writer_next(glc_writer *writer) {
+    struct glc_writer_block_s *block = NULL;
+    off_t offset = writer->cur->offset + writer->block_size;
+    int err, i;
+
+    if((err = glc_writer_submit(writer, writer->cur)))
+        return err;
+
+    while(!block) {
+        pthread_mutex_lock(&writer->mutex);
+        for(i = 0; i < writer->nblocks && !block; i++) {
+            if(!writer->blocks[i].busy)
+                block = &writer->blocks[i];
+        }
+        if(!block && writer->uring.fd == -1)
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        pthread_mutex_unlock(&writer->mutex);
+
+        if(!block && writer->uring.fd != -1 && (err = glc_writer_uring_reap(writer, 1)))
+            return err;
+    }
+
+    block->offset = offset;
+    block->fill = 0;
+    writer->cur = block;
+    return __atomic_load_n(&writer->err, __ATOMIC_ACQUIRE);
+}
+
+static int glc_writer_submit(glc_writer *writer, struct glc_writer_block_s *block) {
+    off_t end;
+    int err;
+
+    block->len = block->fill;
+    if(writer->flags & GLC_WRITER_DIRECT) {
+        block->len = GLC_WRITER_ROUND(block->fill);
+        memset(&block->data[block->fill], 0, block->len - block->fill);
+    }
+    block->done = 0;
+
+    end = block->offset + block->len;
+    while(writer->prealloc && end > writer->allocated) {
+        /* not supported by every file system, just write without then */
+        if(!fallocate(writer->fd, FALLOC_FL_KEEP_SIZE, writer->allocated, writer->prealloc))
+            writer->allocated += writer->prealloc;
+        else
+            writer->prealloc = 0;
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    block->busy = 1;
+    pthread_mutex_unlock(&writer->mutex);
+
+    if(writer->uring.fd != -1)
+        err = glc_writer_uring_submit(writer, block);
+    else
+        err = glc_pool_submit(writer->pool, glc_writer_job, block);
+
+    /* nothing will complete the block, waiters must not wait for it */
+    if(err)
+        glc_writer_complete(writer, block, err);
+    return err;
+}
+
+static int glc_writer_wait(glc_writer *writer, struct glc_writer_block_s *block) {
+    int err;
+
+    if(writer->uring.fd != -1) {
+        while(__atomic_load_n(&block->busy, __ATOMIC_ACQUIRE)) {
+            if((err = glc_writer_uring_reap(writer, 1)))
+                return err;
+        }
+        return 0;
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    while(block->busy)
+        pthread_cond_wait(&writer->cond, &writer->mutex);
+    pthread_mutex_unlock(&writer->mutex);
+    return 0;
+}
+
+static void glc_writer_complete(glc_writer *writer, struct glc_writer_block_s *block, int err) {
+    pthread_mutex_lock(&writer->mutex);
+    if(err && !writer->err)
+        __atomic_store_n(&writer->err, err, __ATOMIC_RELEASE);
+    __atomic_store_n(&block->busy, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+static void glc_writer_job(void *arg) {
+    struct glc_writer_block_s *block = arg;
+    ssize_t ret;
+    int err = 0;
+
+    while(block->done < block->len) {
+        ret = pwrite(block->writer->fd, &block->data[block->done], block->len - block->done,
+                     block->offset + block->done);
+        if(ret == -1) {
+            if(errno == EINTR)
+                continue;
+            err = errno;
+            break;
+        } else if(ret == 0) {
+            err = EIO;
+            break;
+        }
+        block->done += ret;
+    }
+
+    glc_writer_complete(block->writer, block, err);
+}
+
+static int glc_writer_uring_init(struct glc_writer_uring_s *uring, unsigned int entries) {
+    struct io_uring_params p;
+    int err;
+
+    memset(&p, 0, sizeof(p));
+    if((uring->fd = syscall(__NR_io_uring_setup, entries, &p)) == -1)
+        return errno;
+
+    uring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    uring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(uring->cq_size > uring->sq_size)
+            uring->sq_size = uring->cq_size;
+        uring->cq_size = uring->sq_size;
+    }
+
+    uring->sq_ptr = mmap(NULL, uring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         uring->fd, IORING_OFF_SQ_RING);
+    if(uring->sq_ptr == MAP_FAILED) {
+        err = errno;
+        goto error;
+    }
+
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        uring->cq_ptr = uring->sq_ptr;
+    } else {
+        uring->cq_ptr = mmap(NULL, uring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             uring->fd, IORING_OFF_CQ_RING);
+        if(uring->cq_ptr == MAP_FAILED) {
+            err = errno;
+            munmap(uring->sq_ptr, uring->sq_size);
+            goto error;
+        }
+    }
+
+    uring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       uring->fd, IORING_OFF_SQES);
+    if(uring->sqes == MAP_FAILED) {
+        err = errno;
+        if(uring->cq_ptr != uring->sq_ptr)
+            munmap(uring->cq_ptr, uring->cq_size);
+        munmap(uring->sq_ptr, uring->sq_size);
+        goto error;
+    }
+
+    uring->sq_tail = (unsigned int *) ((char *) uring->sq_ptr + p.sq_off.tail);
+    uring->sq_mask = (unsigned int *) ((char *) uring->sq_ptr + p.sq_off.ring_mask);
+    uring->sq_array = (unsigned int *) ((char *) uring->sq_ptr + p.sq_off.array);
+    uring->cq_head = (unsigned int *) ((char *) uring->cq_ptr + p.cq_off.head);
+    uring->cq_tail = (unsigned int *) ((char *) uring->cq_ptr + p.cq_off.tail);
+    uring->cq_mask = (unsigned int *) ((char *) uring->cq_ptr + p.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *) ((char *) uring->cq_ptr + p.cq_off.cqes);
+    return 0;
+
+error:
+    close(uring->fd);
+    uring->fd = -1;
+    return err;
+}
+
+static void glc_writer_uring_destroy(struct glc_writer_uring_s *uring) {
+    munmap(uring->sqes, uring->sqes_size);
+    if(uring->cq_ptr != uring->sq_ptr)
+        munmap(uring->cq_ptr, uring->cq_size);
+    munmap(uring->sq_ptr, uring->sq_size);
+    close(uring->fd);
+    uring->fd = -1;
+}
+
+static int glc_writer_uring_submit(glc_writer *writer, struct glc_writer_block_s *block) {
+    struct glc_writer_uring_s *uring = &writer->uring;
+    struct io_uring_sqe *sqe;
+    unsigned int tail, index;
+
+    block->iov.iov_base = &block->data[block->done];
+    block->iov.iov_len = block->len - block->done;
+
+    /* never more blocks in flight than entries, so the ring has room */
+    tail = *uring->sq_tail;
+    index = tail & *uring->sq_mask;
+    sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = writer->fd;
+    sqe->off = block->offset + block->done;
+    sqe->addr = (unsigned long) &block->iov;
+    sqe->len = 1;
+    sqe->user_data = (unsigned long) block;
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while(syscall(__NR_io_uring_enter, uring->fd, 1, 0, 0, NULL, 0) == -1) {
+        if(errno != EINTR && errno != EAGAIN) {
+            /* the kernel did not take the entry, a later enter must not either */
+            __atomic_store_n(uring->sq_tail, tail, __ATOMIC_RELEASE);
+            return errno;
+        }
+    }
+
+    return 0;
+}
+
+static int glc_writer_uring_reap(glc_writer *writer, int wait) {
+    struct glc_writer_uring_s *uring = &writer->uring;
+    struct glc_writer_block_s *block;
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+    int err, res, reaped = 0;
+
+    while(1) {
+        head = *uring->cq_head;
+        if(head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+            if(reaped || !wait)
+                return 0;
+
+            if(syscall(__NR_io_uring_enter, uring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 &&
+               errno != EINTR)
+                return errno;
+            continue;
+        }
+
+        cqe = &uring->cqes[head & *uring->cq_mask];
+        block = (struct glc_writer_block_s *) (unsigned long) cqe->user_data;
+        res = cqe->res;
+        __atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+        reaped++;
+
+        err = res < 0 ? -res : res == 0 ? EIO : 0;
+        if(!err) {
+            block->done += res;
+            if(block->done < block->len) {
+                /* short write, submit the rest */
+                if((err = glc_writer_uring_submit(writer, block)))
+                    glc_writer_complete(writer, block, err);
+                continue;
+            }
+        }
+
+        glc_writer_complete(writer, block, err);
+    }
+}
+
+/**  \} */
@@ -0,0 +1,121 @@
+/**
+ * \file src/server/writer.h
+ * \brief asynchronous stream writer
+ * \author agent <agent@local>
+ * \date 2026
+ */
+
+/**
+ * \defgroup server_writer stream writer
+ *  The writer collects data in a fixed number of large aligned blocks and
+ *  writes full blocks in the background while the caller keeps filling the
+ *  next one. Blocks are submitted with io_uring if the kernel supports it,
+ *  otherwise pwrite() runs on a worker pool. Only when every block is in
+ *  flight does glc_writer_write() wait, so memory use is bounded by
+ *  block_size * blocks no matter how slow the disk is.
+ *
+ *  With GLC_WRITER_DIRECT the file is opened with O_DIRECT and data
+ *  bypasses the page cache. The file grows in preallocated steps with
+ *  fallocate() to keep extents large.
+ *
+ *  A writer is not thread-safe, it is fed by one thread at a time (e.g.
+ *  from one client's serial queue).
+ *  \{
+ */
+
+#ifndef GLC2_SERVER_WRITER_H
+#define GLC2_SERVER_WRITER_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "pool.h"
+
+/** alignment of block buffers, offsets and lengths for O_DIRECT */
+#define GLC_WRITER_ALIGN 4096
+
+/** bypass the page cache, ignored if the file system does not support it */
+#define GLC_WRITER_DIRECT    0x1
+/** always use the worker pool, never io_uring */
+#define GLC_WRITER_NO_URING  0x2
+/** append to an existing file instead of truncating it */
+#define GLC_WRITER_APPEND    0x4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct glc_writer_s glc_writer;
+
+typedef struct glc_writer_options_s {
+    /** block size, rounded up to GLC_WRITER_ALIGN */
+    size_t block_size;
+    /** number of blocks, at most blocks - 1 are written at the same time */
+    int blocks;
+    /** preallocation step, 0 to disable preallocation */
+    size_t prealloc;
+    /** GLC_WRITER_* flags */
+    int flags;
+} glc_writer_options;
+
+/**
+ * \brief open a file for writing
+ * \param writer returned writer
+ * \param path file to write
+ * \param options options or NULL for defaults (4 MiB * 8 blocks, 256 MiB
+ *        preallocation, O_DIRECT)
+ * \param pool pool for the pwrite() fallback or NULL to start an own one
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_writer_create(glc_writer **writer, const char *path, glc_writer_options *options, glc_pool *pool);
+
+/**
+ * \brief flush all data, trim the file and close it
+ * \param writer the writer
+ * \return 0 on success otherwise the first error which occured
+ */
+__PUBLIC int glc_writer_destroy(glc_writer *writer);
+
+/**
+ * \brief append data
+ *
+ * Data is copied to the current block, so the caller can release it
+ * right away (e.g. a glc_server_view).
+ * \param writer the writer
+ * \param data the data
+ * \param size bytes to write
+ * \return 0 on success otherwise an error code, errors of earlier
+ *         background writes are returned here too
+ */
+__PUBLIC int glc_writer_write(glc_writer *writer, const void *data, size_t size);
+
+/**
+ * \brief append data from several segments
+ * \param writer the writer
+ * \param iov segments
+ * \param count number of segments
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_writer_writev(glc_writer *writer, const struct iovec *iov, int count);
+
+/**
+ * \brief write everything appended so far and wait until it is done
+ * \param writer the writer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_writer_flush(glc_writer *writer);
+
+/**
+ * \brief get the number of bytes appended so far
+ * \param writer the writer
+ * \return logical file size
+ */
+__PUBLIC size_t glc_writer_size(glc_writer *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */